@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <jansson.h>
+
+#include "comm_decoder.h"
+#include "capacity.h"
+
+#define JSON_KEY_CAPACITY "capacity"
+
+void capacity_init(capacity_t *cap)
+{
+	memset(cap, 0, sizeof(*cap));
+}
+
+static int parse_count(json_t *config, const char *key, unsigned int max,
+		       unsigned int *count)
+{
+	json_t *value = json_object_get(config, key);
+	if (value == NULL) {
+		return 0;
+	}
+	if (!json_is_integer(value) || (json_integer_value(value) < 1) ||
+	    (json_integer_value(value) > max)) {
+		return -1;
+	}
+	*count = json_integer_value(value);
+	return 0;
+}
+
+int capacity_parse_config(const char *path, capacity_t *cap)
+{
+	json_error_t jerror;
+	int ret = 0;
+
+	json_t *root = json_load_file(path, 0, &jerror);
+	if (root == NULL) {
+		/* reported when the layout is read */
+		return 0;
+	}
+
+	json_t *config = json_object_get(root, JSON_KEY_CAPACITY);
+	if (config == NULL) {
+		json_decref(root);
+		return 0;
+	}
+	if (!json_is_object(config)) {
+		ret = -1;
+	}
+
+	cap->enabled = 1;
+	cap->scene.screens = CAPACITY_DEFAULT_SCREENS;
+	cap->scene.layers = CAPACITY_DEFAULT_LAYERS;
+	cap->scene.surfaces_per_layer = CAPACITY_DEFAULT_SURFACES_PER_LAYER;
+	cap->clients = CAPACITY_DEFAULT_CLIENTS;
+	cap->message_size = CAPACITY_DEFAULT_MESSAGE_SIZE;
+
+	if ((ret < 0) ||
+	    (parse_count(config, "screens", CAPACITY_MAX_COUNT,
+			 &cap->scene.screens) < 0) ||
+	    (parse_count(config, "layers", CAPACITY_MAX_COUNT,
+			 &cap->scene.layers) < 0) ||
+	    (parse_count(config, "surfaces_per_layer", CAPACITY_MAX_COUNT,
+			 &cap->scene.surfaces_per_layer) < 0) ||
+	    (parse_count(config, "clients", CAPACITY_MAX_COUNT,
+			 &cap->clients) < 0) ||
+	    (parse_count(config, "message_size", COMM_MAX_FRAME_SIZE,
+			 &cap->message_size) < 0)) {
+		fprintf(stderr, "%s(%d) ERROR: Invalid %s in %s\n", __func__,
+			__LINE__, JSON_KEY_CAPACITY, path);
+		ret = -1;
+	}
+
+	json_decref(root);
+	return ret;
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __CAPACITY_H__
+#define __CAPACITY_H__
+
+#include "scene.h"
+
+/*
+ * Bounded-memory mode, off unless the init config has a "capacity" object,
+ * e.g.
+ *   "capacity": { "screens": 2, "layers": 32, "surfaces_per_layer": 16,
+ *                 "clients": 8, "message_size": 65536 }
+ *
+ * The scene tables are preallocated for the screens, layers and surfaces
+ * given, and a command that would go over them fails, see scene.h. At
+ * most clients connections are served at once and a message body larger
+ * than message_size is refused. A limit left out takes its default.
+ */
+typedef struct _capacity {
+	int enabled;
+	scene_limits_t scene;
+	unsigned int clients;
+	unsigned int message_size;
+} capacity_t;
+
+#define CAPACITY_DEFAULT_SCREENS 4
+#define CAPACITY_DEFAULT_LAYERS 64
+#define CAPACITY_DEFAULT_SURFACES_PER_LAYER 32
+#define CAPACITY_DEFAULT_CLIENTS 16
+#define CAPACITY_DEFAULT_MESSAGE_SIZE (64 * 1024)
+
+/* the most screens, layers, surfaces per layer or clients */
+#define CAPACITY_MAX_COUNT 4096
+
+void capacity_init(capacity_t *cap);
+
+/* the "capacity" object of the init config, if any; -1 on a bad setting */
+int capacity_parse_config(const char *path, capacity_t *cap);
+
+#endif //__CAPACITY_H__
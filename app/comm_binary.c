@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "comm_binary.h"
+
+static inline void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static inline uint16_t get_le16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_lef32(uint8_t *p, float v)
+{
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	put_le32(p, u);
+}
+
+static inline float get_lef32(const uint8_t *p)
+{
+	uint32_t u = get_le32(p);
+	float v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+int comm_binary_parse_header(const void *buf, size_t size, WM_CMD_TYPE *type,
+			     uint32_t *nrecords)
+{
+	const uint8_t *p = buf;
+
+	if (size < COMM_BINARY_HEADER_SIZE) {
+		fprintf(stderr, "%s(%d) ERROR: Binary body too short (%zu)\n",
+			__func__, __LINE__, size);
+		return -1;
+	}
+
+	uint16_t version = get_le16(&p[0]);
+	if (version != COMM_BINARY_VERSION) {
+		fprintf(stderr, "%s(%d) ERROR: Binary version %u unsupported\n",
+			__func__, __LINE__, version);
+		return -1;
+	}
+
+	uint16_t cmd = get_le16(&p[2]);
+	if ((cmd == WM_CMD_NONE) || (cmd >= WM_CMD_MAX)) {
+		fprintf(stderr, "%s(%d) ERROR: Illegal binary command %u\n",
+			__func__, __LINE__, cmd);
+		return -1;
+	}
+
+	uint32_t n = get_le32(&p[4]);
+	if (n != (size - COMM_BINARY_HEADER_SIZE) / COMM_BINARY_RECORD_SIZE ||
+	    (size - COMM_BINARY_HEADER_SIZE) % COMM_BINARY_RECORD_SIZE) {
+		fprintf(stderr,
+			"%s(%d) ERROR: Binary size %zu does not match %u records\n",
+			__func__, __LINE__, size, n);
+		return -1;
+	}
+
+	*type = cmd;
+	*nrecords = n;
+	return 0;
+}
+
+void comm_binary_get_record(const void *buf, uint32_t idx, wm_record_t *rec)
+{
+	const uint8_t *p = (const uint8_t *)buf + COMM_BINARY_HEADER_SIZE +
+			   (size_t)idx * COMM_BINARY_RECORD_SIZE;
+
+	rec->kind = get_le16(&p[0]);
+	rec->insert_order = get_le16(&p[2]);
+	rec->id = get_le32(&p[4]);
+	rec->refid = get_le32(&p[8]);
+	rec->fields = get_le32(&p[12]);
+	rec->width = get_le32(&p[16]);
+	rec->height = get_le32(&p[20]);
+	rec->src_x = get_le32(&p[24]);
+	rec->src_y = get_le32(&p[28]);
+	rec->src_w = get_le32(&p[32]);
+	rec->src_h = get_le32(&p[36]);
+	rec->dst_x = get_le32(&p[40]);
+	rec->dst_y = get_le32(&p[44]);
+	rec->dst_w = get_le32(&p[48]);
+	rec->dst_h = get_le32(&p[52]);
+	rec->opacity = get_lef32(&p[56]);
+	rec->visibility = get_le32(&p[60]);
+}
+
+static void put_record(uint8_t *p, const wm_record_t *rec)
+{
+	put_le16(&p[0], rec->kind);
+	put_le16(&p[2], rec->insert_order);
+	put_le32(&p[4], rec->id);
+	put_le32(&p[8], rec->refid);
+	put_le32(&p[12], rec->fields);
+	put_le32(&p[16], rec->width);
+	put_le32(&p[20], rec->height);
+	put_le32(&p[24], rec->src_x);
+	put_le32(&p[28], rec->src_y);
+	put_le32(&p[32], rec->src_w);
+	put_le32(&p[36], rec->src_h);
+	put_le32(&p[40], rec->dst_x);
+	put_le32(&p[44], rec->dst_y);
+	put_le32(&p[48], rec->dst_w);
+	put_le32(&p[52], rec->dst_h);
+	put_lef32(&p[56], rec->opacity);
+	put_le32(&p[60], rec->visibility);
+}
+
+size_t comm_binary_encoded_size(const wm_command_t *cmd)
+{
+	return COMM_BINARY_HEADER_SIZE +
+	       (size_t)cmd->nrecords * COMM_BINARY_RECORD_SIZE;
+}
+
+size_t comm_binary_encode(const wm_command_t *cmd, void *buf)
+{
+	uint8_t *p = buf;
+	uint32_t i;
+
+	memset(p, 0, comm_binary_encoded_size(cmd));
+	put_le16(&p[0], COMM_BINARY_VERSION);
+	put_le16(&p[2], cmd->type);
+	put_le32(&p[4], cmd->nrecords);
+
+	for (i = 0; i < cmd->nrecords; i++) {
+		put_record(&p[COMM_BINARY_HEADER_SIZE +
+			     (size_t)i * COMM_BINARY_RECORD_SIZE],
+			   &cmd->records[i]);
+	}
+
+	return comm_binary_encoded_size(cmd);
+}
+
+wm_record_t *comm_binary_add_record(wm_command_t *cmd, WM_RECORD_KIND kind,
+				    uint32_t id)
+{
+	if (cmd->nrecords == cmd->capacity) {
+		uint32_t capacity = cmd->capacity ? cmd->capacity * 2 : 8;
+		wm_record_t *records =
+			realloc(cmd->records, capacity * sizeof(*records));
+		if (records == NULL) {
+			return NULL;
+		}
+		cmd->records = records;
+		cmd->capacity = capacity;
+	}
+
+	wm_record_t *rec = &cmd->records[cmd->nrecords++];
+	memset(rec, 0, sizeof(*rec));
+	rec->kind = kind;
+	rec->id = id;
+
+	return rec;
+}
+
+void comm_binary_free_command(wm_command_t *cmd)
+{
+	free(cmd->records);
+	memset(cmd, 0, sizeof(*cmd));
+}
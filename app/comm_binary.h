@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __COMM_BINARY_H__
+#define __COMM_BINARY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compact binary command encoding.
+ *
+ * The body is a 16 byte header followed by fixed size 64 byte records, with
+ * every field stored little-endian. Records keep the nesting of the json
+ * command by their order: a layer record belongs to the preceding screen
+ * record and a surface record to the preceding layer record.
+ *
+ *   header: u16 version, u16 command, u32 records, u32 flags, u32 reserved
+ *   record: u16 kind, u16 insert_order, u32 id, u32 referenceID, u32 fields,
+ *           u32 width, u32 height, u32 src_x, src_y, src_w, src_h,
+ *           u32 dst_x, dst_y, dst_w, dst_h, f32 opacity, u32 visibility,
+ *           u32 reserved
+ */
+/* entry points of the client library, which hides everything else */
+#define WM_EXPORT __attribute__((visibility("default")))
+
+#define COMM_BINARY_VERSION 1
+#define COMM_BINARY_HEADER_SIZE 16
+#define COMM_BINARY_RECORD_SIZE 64
+
+typedef enum _wm_cmd_type {
+	WM_CMD_NONE = 0,
+	WM_CMD_INITIAL_SCREEN,
+	WM_CMD_ADD_LAYER,
+	WM_CMD_REMOVE_LAYER,
+	WM_CMD_MODIFY_LAYER,
+	WM_CMD_ADD_SURFACE,
+	WM_CMD_REMOVE_SURFACE,
+	WM_CMD_MODIFY_SURFACE,
+	WM_CMD_GET_SCENE,
+	WM_CMD_MAX
+} WM_CMD_TYPE;
+
+typedef enum _wm_record_kind {
+	WM_RECORD_NONE = 0,
+	WM_RECORD_SCREEN,
+	WM_RECORD_LAYER,
+	WM_RECORD_SURFACE
+} WM_RECORD_KIND;
+
+typedef enum _insert_order {
+	INSERT_ORDER_NONE = 0,
+	INSERT_ORDER_PREPEND,
+	INSERT_ORDER_APPEND,
+	INSERT_ORDER_BEFORE,
+	INSERT_ORDER_AFTER
+} INSERT_ORDER;
+
+/* Fields carried by a record */
+#define WM_FIELD_WIDTH (1 << 0)
+#define WM_FIELD_HEIGHT (1 << 1)
+#define WM_FIELD_SRCX (1 << 2)
+#define WM_FIELD_SRCY (1 << 3)
+#define WM_FIELD_SRCW (1 << 4)
+#define WM_FIELD_SRCH (1 << 5)
+#define WM_FIELD_DSTX (1 << 6)
+#define WM_FIELD_DSTY (1 << 7)
+#define WM_FIELD_DSTW (1 << 8)
+#define WM_FIELD_DSTH (1 << 9)
+#define WM_FIELD_OPACITY (1 << 10)
+#define WM_FIELD_VISIBILITY (1 << 11)
+#define WM_FIELD_INSERT (1 << 12)
+/* get_scene: the surface exists in the compositor */
+#define WM_FIELD_ALIVE (1 << 13)
+
+#define WM_FIELD_LAYOUT_ALL (0x0ffc)
+#define WM_FIELD_LAYER_ALL (WM_FIELD_WIDTH | WM_FIELD_HEIGHT | WM_FIELD_LAYOUT_ALL)
+
+typedef struct _wm_record {
+	uint16_t kind;
+	uint16_t insert_order;
+	uint32_t id;
+	uint32_t refid;
+	uint32_t fields;
+	uint32_t width, height;
+	uint32_t src_x, src_y, src_w, src_h;
+	uint32_t dst_x, dst_y, dst_w, dst_h;
+	float opacity;
+	uint32_t visibility;
+} wm_record_t;
+
+typedef struct _wm_command {
+	WM_CMD_TYPE type;
+	uint32_t nrecords;
+	uint32_t capacity;
+	wm_record_t *records;
+} wm_command_t;
+
+/* decoding, reads the records in place */
+WM_EXPORT int comm_binary_parse_header(const void *buf, size_t size,
+				       WM_CMD_TYPE *type, uint32_t *nrecords);
+WM_EXPORT void comm_binary_get_record(const void *buf, uint32_t idx,
+				      wm_record_t *rec);
+
+/* encoding */
+WM_EXPORT size_t comm_binary_encoded_size(const wm_command_t *cmd);
+WM_EXPORT size_t comm_binary_encode(const wm_command_t *cmd, void *buf);
+
+/* command record list */
+WM_EXPORT wm_record_t *comm_binary_add_record(wm_command_t *cmd,
+					      WM_RECORD_KIND kind, uint32_t id);
+WM_EXPORT void comm_binary_free_command(wm_command_t *cmd);
+
+#endif //__COMM_BINARY_H__
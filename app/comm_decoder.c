@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "comm_decoder.h"
+#include "comm_receiver.h"
+#include "stats.h"
+
+char *comm_decoder_space(comm_decoder_t *decoder, unsigned int *space)
+{
+	unsigned int pending = decoder->len - decoder->start;
+	unsigned int need = decoder->need > pending ? decoder->need :
+						      pending + 1;
+
+	/* only a partial message is left, move it to the front */
+	if (decoder->start > 0) {
+		memmove(decoder->buf, &decoder->buf[decoder->start], pending);
+		decoder->start = 0;
+		decoder->len = pending;
+	}
+
+	if (decoder->size < need) {
+		unsigned int size = decoder->size ? decoder->size :
+						    COMM_DECODER_MIN_SIZE;
+		while (size < need) {
+			size *= 2;
+		}
+		char *buf = realloc(decoder->buf, size);
+		if (buf == NULL) {
+			*space = 0;
+			return NULL;
+		}
+		stats_count_buffer_alloc();
+		decoder->buf = buf;
+		decoder->size = size;
+	}
+
+	*space = decoder->size - decoder->len;
+	return &decoder->buf[decoder->len];
+}
+
+void comm_decoder_received(comm_decoder_t *decoder, unsigned int len,
+			   uint64_t now)
+{
+	decoder->len += len;
+	if ((decoder->started == 0) && (len > 0)) {
+		decoder->started = now;
+	}
+}
+
+/* a message is done, anything after it belongs to the next one */
+static void message_done(comm_decoder_t *decoder, uint64_t now)
+{
+	decoder->need = 0;
+	decoder->started = (decoder->start < decoder->len) ? now : 0;
+}
+
+int comm_decoder_next(comm_decoder_t *decoder, const char **body,
+		      unsigned int *size, uint64_t now)
+{
+	const char *p = &decoder->buf[decoder->start];
+	unsigned int pending = decoder->len - decoder->start;
+	uint32_t frame_size;
+
+	if (pending < sizeof(uint32_t)) {
+		return DECODER_NEED_MORE;
+	}
+
+	if (decoder->state == DECODER_STATE_MAGIC) {
+		memcpy(decoder->magic, p, sizeof(decoder->magic));
+		decoder->start += sizeof(decoder->magic);
+		if (comm_lookup_magiccode(decoder->magic, &decoder->encoding,
+					  &decoder->protocol) < 0) {
+			return DECODER_ERROR;
+		}
+		decoder->state = DECODER_STATE_FRAME;
+		if (decoder->protocol != COMM_PROTOCOL_V0) {
+			/* nothing pending until the first frame */
+			message_done(decoder, now);
+		}
+		return DECODER_HANDSHAKE;
+	}
+
+	memcpy(&frame_size, p, sizeof(frame_size));
+	frame_size = ntohl(frame_size);
+	if (frame_size > (decoder->max_size ? decoder->max_size :
+					      COMM_MAX_FRAME_SIZE)) {
+		fprintf(stderr, "%s(%d) ERROR: Frame of %u bytes is too large\n",
+			__func__, __LINE__, frame_size);
+		return DECODER_ERROR;
+	}
+
+	decoder->need = sizeof(frame_size) + frame_size;
+	if (pending < decoder->need) {
+		return DECODER_NEED_MORE;
+	}
+
+	*body = &p[sizeof(frame_size)];
+	*size = frame_size;
+	decoder->start += decoder->need;
+	if (decoder->protocol == COMM_PROTOCOL_V0) {
+		decoder->state = DECODER_STATE_MAGIC;
+	}
+	message_done(decoder, now);
+
+	return DECODER_MESSAGE;
+}
+
+void comm_decoder_release(comm_decoder_t *decoder)
+{
+	free(decoder->buf);
+	memset(decoder, 0, sizeof(*decoder));
+}
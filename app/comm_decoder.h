@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __COMM_DECODER_H__
+#define __COMM_DECODER_H__
+
+#include <stdint.h>
+
+/* bodies announced larger than this close the connection */
+#define COMM_MAX_FRAME_SIZE (1024 * 1024)
+
+/* first size of a receive buffer, doubled as larger frames need it */
+#define COMM_DECODER_MIN_SIZE 4096
+
+typedef enum _decoder_state {
+	DECODER_STATE_MAGIC = 0,
+	DECODER_STATE_FRAME,
+} DECODER_STATE;
+
+/* results of comm_decoder_next */
+#define DECODER_NEED_MORE 0
+#define DECODER_HANDSHAKE 1 /* magic code complete, to be echoed */
+#define DECODER_MESSAGE 2 /* body complete */
+#define DECODER_ERROR -1
+
+/*
+ * Incremental decoder of the client stream. Bytes are received straight
+ * into a buffer owned by the decoder, which is kept for the life of the
+ * connection and only grows, by doubling, when a frame does not fit.
+ * Complete messages are handed out in place, several per receive when
+ * they are available, and a partial one stays in the buffer until the
+ * rest arrives. v0 expects a magic code before each body, v1 and v2 only once.
+ */
+typedef struct _comm_decoder {
+	DECODER_STATE state;
+	int protocol;
+	int encoding;
+	char magic[4];
+
+	char *buf;
+	unsigned int size;
+	unsigned int start; /* first byte not decoded yet */
+	unsigned int len; /* end of the received bytes */
+	unsigned int need; /* bytes of the pending frame, once known */
+	unsigned int max_size; /* of a body, COMM_MAX_FRAME_SIZE when 0 */
+
+	/* CLOCK_MONOTONIC ns when the pending message started, 0 when idle */
+	uint64_t started;
+} comm_decoder_t;
+
+/*
+ * Returns where the next bytes are to be received and how many fit.
+ * Bodies returned by comm_decoder_next are no longer valid afterwards.
+ */
+char *comm_decoder_space(comm_decoder_t *decoder, unsigned int *space);
+
+/* accounts len bytes received into the space */
+void comm_decoder_received(comm_decoder_t *decoder, unsigned int len,
+			   uint64_t now);
+
+/* decodes the next handshake or message out of the received bytes */
+int comm_decoder_next(comm_decoder_t *decoder, const char **body,
+		      unsigned int *size, uint64_t now);
+
+void comm_decoder_release(comm_decoder_t *decoder);
+
+#endif //__COMM_DECODER_H__
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "comm_event.h"
+#include "schedule.h"
+
+#define JSON_KEY_EVENTS "events"
+#define JSON_KEY_IDS "ids"
+
+static const struct {
+	uint32_t type;
+	const char *name;
+} event_names[] = {
+	{ EVENT_SURFACE_CREATED, "surface_created" },
+	{ EVENT_SURFACE_DESTROYED, "surface_destroyed" },
+	{ EVENT_SURFACE_CONFIGURED, "surface_configured" },
+	{ EVENT_COMMAND_APPLIED, "command_applied" },
+	{ EVENT_SCENE_DELTA, "scene_delta" },
+};
+
+#define EVENT_NAMES (sizeof(event_names) / sizeof(event_names[0]))
+
+static comm_event_handler_t event_handler;
+
+void comm_event_set_handler(comm_event_handler_t handler)
+{
+	event_handler = handler;
+}
+
+void comm_event_publish(uint32_t type, uint32_t id, const char *command,
+			int result)
+{
+	comm_event_t event = { 0 };
+
+	if (event_handler == NULL) {
+		return;
+	}
+
+	event.type = type;
+	event.id = id;
+	event.command = command;
+	event.result = result;
+	event.time_ns = schedule_now();
+	event_handler(&event);
+}
+
+static const char *event_name(uint32_t type)
+{
+	unsigned int i;
+
+	for (i = 0; i < EVENT_NAMES; i++) {
+		if (event_names[i].type == type) {
+			return event_names[i].name;
+		}
+	}
+	return NULL;
+}
+
+static uint32_t event_type(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < EVENT_NAMES; i++) {
+		if (strcmp(event_names[i].name, name) == 0) {
+			return event_names[i].type;
+		}
+	}
+	return 0;
+}
+
+event_filter_t *comm_event_parse_filter(json_t *jobject)
+{
+	json_t *events = json_object_get(jobject, JSON_KEY_EVENTS);
+	json_t *ids = json_object_get(jobject, JSON_KEY_IDS);
+	json_t *value;
+	size_t idx;
+
+	if ((events && !json_is_array(events)) || (ids && !json_is_array(ids))) {
+		fprintf(stderr, "%s(%d) ERROR: events and ids must be arrays\n",
+			__func__, __LINE__);
+		return NULL;
+	}
+
+	event_filter_t *filter = calloc(1, sizeof(*filter));
+	if (filter == NULL) {
+		return NULL;
+	}
+	filter->types = events ? 0 : EVENT_ALL;
+
+	json_array_foreach(events, idx, value)
+	{
+		uint32_t type = json_is_string(value) ?
+					event_type(json_string_value(value)) :
+					0;
+		if (type == 0) {
+			fprintf(stderr, "%s(%d) ERROR: Unknown event type\n",
+				__func__, __LINE__);
+			comm_event_free_filter(filter);
+			return NULL;
+		}
+		filter->types |= type;
+	}
+
+	if (json_array_size(ids) > 0) {
+		filter->ids = calloc(json_array_size(ids), sizeof(uint32_t));
+		if (filter->ids == NULL) {
+			comm_event_free_filter(filter);
+			return NULL;
+		}
+	}
+	json_array_foreach(ids, idx, value)
+	{
+		if (!json_is_integer(value)) {
+			fprintf(stderr, "%s(%d) ERROR: ids must be integers\n",
+				__func__, __LINE__);
+			comm_event_free_filter(filter);
+			return NULL;
+		}
+		filter->ids[filter->nids++] = json_integer_value(value);
+	}
+
+	return filter;
+}
+
+void comm_event_free_filter(event_filter_t *filter)
+{
+	if (filter) {
+		free(filter->ids);
+		free(filter);
+	}
+}
+
+/* ids only select surface events, command events and deltas have none */
+int comm_event_match(const event_filter_t *filter, const comm_event_t *event)
+{
+	unsigned int i;
+
+	if ((filter->types & event->type) == 0) {
+		return 0;
+	}
+	if ((filter->nids == 0) || (event->type == EVENT_COMMAND_APPLIED) ||
+	    (event->type == EVENT_SCENE_DELTA)) {
+		return 1;
+	}
+	for (i = 0; i < filter->nids; i++) {
+		if (filter->ids[i] == event->id) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int comm_event_format(const comm_event_t *event, char *buf,
+		      unsigned int size)
+{
+	int len;
+
+	if (event->type == EVENT_COMMAND_APPLIED) {
+		len = snprintf(buf, size,
+			       "{\"event\":\"%s\",\"command\":\"%s\","
+			       "\"result\":%d,\"time_ns\":%" PRIu64 "}",
+			       event_name(event->type), event->command,
+			       event->result, event->time_ns);
+	} else {
+		len = snprintf(buf, size,
+			       "{\"event\":\"%s\",\"id\":%u,\"time_ns\":%" PRIu64
+			       "}",
+			       event_name(event->type), event->id,
+			       event->time_ns);
+	}
+
+	return ((len < 0) || ((unsigned int)len >= size)) ? -1 : len;
+}
+
+int comm_event_format_dropped(unsigned int count, char *buf,
+			      unsigned int size)
+{
+	int len = snprintf(buf, size,
+			   "{\"event\":\"events_dropped\",\"count\":%u}",
+			   count);
+
+	return ((len < 0) || ((unsigned int)len >= size)) ? -1 : len;
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __COMM_EVENT_H__
+#define __COMM_EVENT_H__
+
+#include <stdint.h>
+#include <jansson.h>
+
+/*
+ * Events pushed to subscribed clients. Surface events come from the
+ * compositor notifications, command events from the parser once a command
+ * is applied. Each event is sent as a json text, e.g.
+ *   {"event":"surface_created","id":10,"time_ns":123}
+ *   {"event":"command_applied","command":"modify_layer","result":0,...}
+ *
+ * Scene deltas come from the snapshots, one per publish, and are only sent
+ * to subscribers asking for them by name (see comm_query.h).
+ */
+#define EVENT_SURFACE_CREATED (1 << 0)
+#define EVENT_SURFACE_DESTROYED (1 << 1)
+#define EVENT_SURFACE_CONFIGURED (1 << 2)
+#define EVENT_COMMAND_APPLIED (1 << 3)
+#define EVENT_SCENE_DELTA (1 << 4)
+#define EVENT_ALL (0x0f)
+
+typedef struct _comm_event {
+	uint32_t type;
+	uint32_t id; /* surface id of surface events */
+	const char *command; /* command name of command events */
+	int result;
+	uint64_t time_ns;
+	/* scene deltas: the change from snapshot base to seq, as json text */
+	uint64_t seq;
+	uint64_t base;
+	char *text;
+	unsigned int len;
+} comm_event_t;
+
+/* event types and surface ids a subscriber wants, no ids for all */
+typedef struct _event_filter {
+	uint32_t types;
+	unsigned int nids;
+	uint32_t *ids;
+} event_filter_t;
+
+typedef void (*comm_event_handler_t)(const comm_event_t *event);
+void comm_event_set_handler(comm_event_handler_t handler);
+
+void comm_event_publish(uint32_t type, uint32_t id, const char *command,
+			int result);
+
+/* "events" and "ids" of a subscribe command, NULL on error */
+event_filter_t *comm_event_parse_filter(json_t *jobject);
+void comm_event_free_filter(event_filter_t *filter);
+int comm_event_match(const event_filter_t *filter, const comm_event_t *event);
+
+/* json text of an event, its length or -1 when buf is too small */
+int comm_event_format(const comm_event_t *event, char *buf,
+		      unsigned int size);
+/* json text telling a subscriber that count events were dropped */
+int comm_event_format_dropped(unsigned int count, char *buf,
+			      unsigned int size);
+
+#endif //__COMM_EVENT_H__
@@ -0,0 +1,500 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <jansson.h>
+
+#include "comm_json.h"
+
+#define UHMI_IVI_WM_VERSION "1.0.0"
+
+#define JSON_KEY_VERSION "version"
+#define JSON_KEY_COMMAND "command"
+#define JSON_KEY_TARGET "target"
+#define JSON_KEY_COMMANDS "commands"
+#define JSON_KEY_HOSTNAME "hostname"
+#define JSON_KEY_APPLY_AT "apply_at"
+#define JSON_KEY_APPLY_IN "apply_in"
+#define JSON_KEY_REPORT "report"
+#define JSON_KEY_PRIORITY "priority"
+#define JSON_KEY_FORMAT "format"
+#define JSON_KEY_SCREENS "screens"
+#define JSON_KEY_INSERTODR "insert_order"
+#define JSON_KEY_REFID "referenceID"
+#define JSON_KEY_LAYERS "layers"
+#define JSON_KEY_SURFACES "surfaces"
+#define JSON_KEY_ID "id"
+#define JSON_KEY_WIDTH "width"
+#define JSON_KEY_HEIGHT "height"
+#define JSON_KEY_SRCX "src_x"
+#define JSON_KEY_SRCY "src_y"
+#define JSON_KEY_SRCW "src_w"
+#define JSON_KEY_SRCH "src_h"
+#define JSON_KEY_DSTX "dst_x"
+#define JSON_KEY_DSTY "dst_y"
+#define JSON_KEY_DSTW "dst_w"
+#define JSON_KEY_DSTH "dst_h"
+#define JSON_KEY_OPACITY "opacity"
+#define JSON_KEY_VISIBILITY "visibility"
+
+static const char *const priority_names[COMM_PRIORITIES] = {
+	[COMM_PRIORITY_CRITICAL] = "critical",
+	[COMM_PRIORITY_INTERACTIVE] = "interactive",
+	[COMM_PRIORITY_BACKGROUND] = "background",
+};
+
+/* list key of each record kind */
+static const char *const record_keys[] = {
+	[WM_RECORD_SCREEN] = JSON_KEY_SCREENS,
+	[WM_RECORD_LAYER] = JSON_KEY_LAYERS,
+	[WM_RECORD_SURFACE] = JSON_KEY_SURFACES,
+};
+
+/* command name and the record kinds it is made of */
+static const struct {
+	const char *name;
+	WM_RECORD_KIND first;
+	WM_RECORD_KIND last;
+} command_table[WM_CMD_MAX] = {
+	[WM_CMD_INITIAL_SCREEN] = { "initial_screen", WM_RECORD_SCREEN,
+				    WM_RECORD_SURFACE },
+	[WM_CMD_ADD_LAYER] = { "add_layer", WM_RECORD_SCREEN, WM_RECORD_LAYER },
+	[WM_CMD_REMOVE_LAYER] = { "remove_layer", WM_RECORD_LAYER,
+				  WM_RECORD_LAYER },
+	[WM_CMD_MODIFY_LAYER] = { "modify_layer", WM_RECORD_LAYER,
+				  WM_RECORD_LAYER },
+	[WM_CMD_ADD_SURFACE] = { "add_surface", WM_RECORD_SCREEN,
+				 WM_RECORD_SURFACE },
+	[WM_CMD_REMOVE_SURFACE] = { "remove_surface", WM_RECORD_LAYER,
+				    WM_RECORD_SURFACE },
+	[WM_CMD_MODIFY_SURFACE] = { "modify_surface", WM_RECORD_SURFACE,
+				    WM_RECORD_SURFACE },
+	[WM_CMD_GET_SCENE] = { "get_scene", WM_RECORD_SCREEN,
+			       WM_RECORD_SURFACE },
+};
+
+/* a string that does not fit value, terminator included, is refused */
+static int get_json_string_value(json_t *jobject, char *key, char *value,
+				 size_t size)
+{
+	if (json_is_string(json_object_get(jobject, key))) {
+		const char *str =
+			json_string_value(json_object_get(jobject, key));
+		if (strlen(str) >= size) {
+			fprintf(stderr, "%s(%d) Error: %s is too long.\n",
+				__func__, __LINE__, key);
+			return -1;
+		}
+		memcpy(value, str, strlen(str) + 1);
+		return 0;
+	}
+
+	fprintf(stderr,
+		"%s(%d) Error: json type other than string, or for NULL. [%s]\n",
+		__func__, __LINE__, key);
+
+	return -1;
+}
+
+static int get_json_array(json_t *jobject, const char *key,
+			  json_t **array_jobj)
+{
+	if (json_is_array(json_object_get(jobject, key))) {
+		*array_jobj = json_object_get(jobject, key);
+		return 0;
+	}
+
+	fprintf(stderr,
+		"%s(%d) Error: json type other than array, or for NULL. [%s]\n",
+		__func__, __LINE__, key);
+	return -1;
+}
+
+/* optional record field, the field bit is set only when present */
+static void get_record_uint(json_t *jobject, char *key, uint32_t bit,
+			    uint32_t *value, wm_record_t *rec)
+{
+	json_t *jvalue = json_object_get(jobject, key);
+	if (json_is_integer(jvalue)) {
+		*value = json_integer_value(jvalue);
+		rec->fields |= bit;
+	}
+}
+
+static void get_record_real(json_t *jobject, char *key, uint32_t bit,
+			    float *value, wm_record_t *rec)
+{
+	json_t *jvalue = json_object_get(jobject, key);
+	if (json_is_integer(jvalue)) {
+		*value = (float)json_integer_value(jvalue);
+		rec->fields |= bit;
+	} else if (json_is_real(jvalue)) {
+		*value = json_real_value(jvalue);
+		rec->fields |= bit;
+	}
+}
+
+int comm_json_parse_target(json_t *jobject, json_t **array_jobj)
+{
+	if (get_json_array(jobject, JSON_KEY_TARGET, array_jobj) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int comm_json_parse_commands(json_t *jobject, json_t **array_jobj)
+{
+	if (get_json_array(jobject, JSON_KEY_COMMANDS, array_jobj) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+int comm_json_parse_deadline(json_t *jobject, uint64_t now,
+			     uint64_t *deadline)
+{
+	json_t *at_jobj = json_object_get(jobject, JSON_KEY_APPLY_AT);
+	json_t *in_jobj = json_object_get(jobject, JSON_KEY_APPLY_IN);
+	json_t *jvalue = at_jobj ? at_jobj : in_jobj;
+
+	if (jvalue == NULL) {
+		return 0;
+	}
+
+	if ((at_jobj && in_jobj) || !json_is_integer(jvalue) ||
+	    (json_integer_value(jvalue) < 0)) {
+		fprintf(stderr,
+			"%s(%d) Error: Either %s or %s, in nanoseconds\n",
+			__func__, __LINE__, JSON_KEY_APPLY_AT,
+			JSON_KEY_APPLY_IN);
+		return -1;
+	}
+
+	*deadline = json_integer_value(jvalue);
+	if (jvalue == in_jobj) {
+		*deadline += now;
+	}
+	return 1;
+}
+
+int comm_json_parse_report(json_t *jobject)
+{
+	return json_is_true(json_object_get(jobject, JSON_KEY_REPORT));
+}
+
+int comm_json_parse_format(json_t *jobject)
+{
+	json_t *jvalue = json_object_get(jobject, JSON_KEY_FORMAT);
+
+	if (jvalue == NULL) {
+		return 0;
+	}
+	if (json_is_string(jvalue)) {
+		if (strcmp(json_string_value(jvalue), "json") == 0) {
+			return 0;
+		}
+		if (strcmp(json_string_value(jvalue), "binary") == 0) {
+			return 1;
+		}
+	}
+	fprintf(stderr, "%s(%d) ERROR: Unknown reply format\n", __func__,
+		__LINE__);
+	return -1;
+}
+
+int comm_json_parse_priority(json_t *jobject)
+{
+	json_t *jvalue = json_object_get(jobject, JSON_KEY_PRIORITY);
+	int priority;
+
+	if (jvalue == NULL) {
+		return COMM_PRIORITY_NONE;
+	}
+	for (priority = 0; priority < COMM_PRIORITIES; priority++) {
+		if (json_is_string(jvalue) &&
+		    (strcmp(priority_names[priority],
+			    json_string_value(jvalue)) == 0)) {
+			return priority;
+		}
+	}
+	fprintf(stderr, "%s(%d) ERROR: Unknown priority\n", __func__,
+		__LINE__);
+	return -2;
+}
+
+const char *comm_json_priority_name(int priority)
+{
+	return priority_names[priority];
+}
+
+int comm_json_parse_hostname(json_t *jobject)
+{
+	char hostname[32] = { 0 };
+	if (get_json_string_value(jobject, JSON_KEY_HOSTNAME, hostname,
+				  sizeof(hostname)) < 0) {
+		fprintf(stderr, "%s(%d) Warning: Not find hostname property\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	char local_hostname[32] = { 0 };
+	gethostname(local_hostname, sizeof(local_hostname) - 1);
+
+	if (strcmp(local_hostname, hostname)) {
+		fprintf(stderr, "%s(%d) Status: %s is not covered.\n", __func__,
+			__LINE__, hostname);
+		return -1;
+	}
+
+	return 0;
+}
+
+int comm_json_parse_version(json_t *jobject)
+{
+	char version[32] = { 0 };
+	if (get_json_string_value(jobject, JSON_KEY_VERSION, version,
+				  sizeof(version)) < 0) {
+		fprintf(stderr, "%s(%d) Warning: Not find version property\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	if (strcmp(UHMI_IVI_WM_VERSION, version)) {
+		fprintf(stderr,
+			"%s(%d) Warning:%s Json format version is illegal. \n",
+			__func__, __LINE__, version);
+		return -1;
+	}
+
+	return 0;
+}
+
+int comm_json_parse_command(json_t *jobject, char *cmd_name, size_t size)
+{
+	if (get_json_string_value(jobject, JSON_KEY_COMMAND, cmd_name,
+				  size) < 0) {
+		fprintf(stderr, "%s(%d) Warning: Not find command property\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	return 0;
+}
+
+WM_CMD_TYPE comm_json_command_type(const char *cmd_name)
+{
+	int type;
+	for (type = WM_CMD_NONE + 1; type < WM_CMD_MAX; type++) {
+		if (strcmp(command_table[type].name, cmd_name) == 0) {
+			return type;
+		}
+	}
+	return WM_CMD_NONE;
+}
+
+const char *comm_json_command_name(WM_CMD_TYPE type)
+{
+	if ((type <= WM_CMD_NONE) || (type >= WM_CMD_MAX)) {
+		return "none";
+	}
+	return command_table[type].name;
+}
+
+static void parse_insert_info(json_t *jobject, wm_record_t *rec)
+{
+	json_t *order_jobj = json_object_get(jobject, JSON_KEY_INSERTODR);
+	if (order_jobj == NULL) {
+		return;
+	}
+
+	const char *val = json_string_value(order_jobj);
+	if (val == NULL) {
+		val = "";
+	}
+
+	if (strcmp("append", val) == 0) {
+		rec->insert_order = INSERT_ORDER_APPEND;
+	} else if (strcmp("prepend", val) == 0) {
+		rec->insert_order = INSERT_ORDER_PREPEND;
+	} else if (strcmp("before", val) == 0) {
+		rec->insert_order = INSERT_ORDER_BEFORE;
+	} else if (strcmp("after", val) == 0) {
+		rec->insert_order = INSERT_ORDER_AFTER;
+	} else {
+		fprintf(stderr,
+			"%s(%d) Warning:%s Json format insert_order is illegal. \n",
+			__func__, __LINE__, val);
+		return;
+	}
+	rec->fields |= WM_FIELD_INSERT;
+
+	json_t *refid_jobj = json_object_get(jobject, JSON_KEY_REFID);
+	if (json_is_integer(refid_jobj)) {
+		rec->refid = json_integer_value(refid_jobj);
+	}
+}
+
+static void parse_record_properties(json_t *jobject, wm_record_t *rec)
+{
+	if (rec->kind == WM_RECORD_LAYER) {
+		get_record_uint(jobject, JSON_KEY_WIDTH, WM_FIELD_WIDTH,
+				&rec->width, rec);
+		get_record_uint(jobject, JSON_KEY_HEIGHT, WM_FIELD_HEIGHT,
+				&rec->height, rec);
+	}
+	get_record_uint(jobject, JSON_KEY_SRCX, WM_FIELD_SRCX, &rec->src_x, rec);
+	get_record_uint(jobject, JSON_KEY_SRCY, WM_FIELD_SRCY, &rec->src_y, rec);
+	get_record_uint(jobject, JSON_KEY_SRCW, WM_FIELD_SRCW, &rec->src_w, rec);
+	get_record_uint(jobject, JSON_KEY_SRCH, WM_FIELD_SRCH, &rec->src_h, rec);
+	get_record_uint(jobject, JSON_KEY_DSTX, WM_FIELD_DSTX, &rec->dst_x, rec);
+	get_record_uint(jobject, JSON_KEY_DSTY, WM_FIELD_DSTY, &rec->dst_y, rec);
+	get_record_uint(jobject, JSON_KEY_DSTW, WM_FIELD_DSTW, &rec->dst_w, rec);
+	get_record_uint(jobject, JSON_KEY_DSTH, WM_FIELD_DSTH, &rec->dst_h, rec);
+	get_record_real(jobject, JSON_KEY_OPACITY, WM_FIELD_OPACITY,
+			&rec->opacity, rec);
+	get_record_uint(jobject, JSON_KEY_VISIBILITY, WM_FIELD_VISIBILITY,
+			&rec->visibility, rec);
+}
+
+/* fields a record of an add command must carry */
+static uint32_t required_fields(WM_CMD_TYPE type, WM_RECORD_KIND kind)
+{
+	if ((kind == WM_RECORD_LAYER) && ((type == WM_CMD_INITIAL_SCREEN) ||
+					  (type == WM_CMD_ADD_LAYER))) {
+		return WM_FIELD_LAYER_ALL;
+	}
+	if ((kind == WM_RECORD_SURFACE) && ((type == WM_CMD_INITIAL_SCREEN) ||
+					    (type == WM_CMD_ADD_SURFACE))) {
+		return WM_FIELD_LAYOUT_ALL;
+	}
+	return 0;
+}
+
+static int encode_records(json_t *jobject, WM_CMD_TYPE type,
+			  WM_RECORD_KIND kind, wm_command_t *cmd)
+{
+	size_t idx;
+	json_t *array_jobj = NULL;
+	json_t *elm_jobj;
+
+	if (get_json_array(jobject, record_keys[kind], &array_jobj) < 0) {
+		/* nested lists may be left out of initial_screen */
+		if ((type == WM_CMD_INITIAL_SCREEN) &&
+		    (kind != command_table[type].first)) {
+			return 0;
+		}
+		return -1;
+	}
+
+	json_array_foreach(array_jobj, idx, elm_jobj)
+	{
+		uint32_t id = 0;
+		json_t *id_jobj = json_object_get(elm_jobj, JSON_KEY_ID);
+		if (json_is_integer(id_jobj)) {
+			id = json_integer_value(id_jobj);
+		} else if ((kind != WM_RECORD_SCREEN) ||
+			   (type != WM_CMD_ADD_SURFACE)) {
+			/* add_surface does not use the screen id */
+			fprintf(stderr,
+				"%s(%d) Error: json type other than integer, or for NULL. [%s]\n",
+				__func__, __LINE__, JSON_KEY_ID);
+			return -1;
+		}
+
+		wm_record_t *rec = comm_binary_add_record(cmd, kind, id);
+		if (rec == NULL) {
+			return -1;
+		}
+
+		if (kind == WM_RECORD_SCREEN) {
+			parse_insert_info(elm_jobj, rec);
+		} else if ((type == WM_CMD_INITIAL_SCREEN) ||
+			   ((kind == command_table[type].last) &&
+			    (type != WM_CMD_REMOVE_LAYER) &&
+			    (type != WM_CMD_REMOVE_SURFACE))) {
+			parse_record_properties(elm_jobj, rec);
+		}
+
+		uint32_t required = required_fields(type, kind);
+		if ((rec->fields & required) != required) {
+			fprintf(stderr,
+				"%s(%d) Error: Not find properties of %s %u\n",
+				__func__, __LINE__, record_keys[kind], id);
+			return -1;
+		}
+
+		if (kind < command_table[type].last) {
+			if (encode_records(elm_jobj, type, kind + 1, cmd) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* the optional id lists of get_scene -> one record per id */
+static int encode_scene_filter(json_t *jobject, wm_command_t *cmd)
+{
+	WM_RECORD_KIND kind;
+	size_t idx;
+	json_t *value;
+
+	for (kind = WM_RECORD_SCREEN; kind <= WM_RECORD_SURFACE; kind++) {
+		json_t *ids = json_object_get(jobject, record_keys[kind]);
+		if (ids == NULL) {
+			continue;
+		}
+		if (!json_is_array(ids)) {
+			fprintf(stderr, "%s(%d) ERROR: %s must be an array\n",
+				__func__, __LINE__, record_keys[kind]);
+			return -1;
+		}
+		json_array_foreach(ids, idx, value)
+		{
+			if (!json_is_integer(value)) {
+				fprintf(stderr,
+					"%s(%d) ERROR: %s must be integers\n",
+					__func__, __LINE__, record_keys[kind]);
+				return -1;
+			}
+			if (comm_binary_add_record(cmd, kind,
+						   json_integer_value(value)) ==
+			    NULL) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int comm_json_encode_command(json_t *jobject, WM_CMD_TYPE type,
+			     wm_command_t *cmd)
+{
+	if ((type <= WM_CMD_NONE) || (type >= WM_CMD_MAX)) {
+		return -1;
+	}
+
+	cmd->type = type;
+	if (type == WM_CMD_GET_SCENE) {
+		return encode_scene_filter(jobject, cmd);
+	}
+	return encode_records(jobject, type, command_table[type].first, cmd);
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __COMM_JSON_H__
+#define __COMM_JSON_H__
+
+#include <jansson.h>
+#include "comm_binary.h"
+
+int comm_json_parse_version(json_t *jobject);
+int comm_json_parse_hostname(json_t *jobject);
+/* the name of the command, refused when it does not fit size bytes */
+int comm_json_parse_command(json_t *jobject, char *cmd_name, size_t size);
+int comm_json_parse_target(json_t *jobject, json_t **array_jobj);
+int comm_json_parse_commands(json_t *jobject, json_t **array_jobj);
+
+/* optional apply_at/apply_in, 1 when the command has a deadline */
+int comm_json_parse_deadline(json_t *jobject, uint64_t now,
+			     uint64_t *deadline);
+
+/* 1 when the sender asks for a report of the command */
+int comm_json_parse_report(json_t *jobject);
+
+/* optional reply format of a query, 1 for binary, -1 for an unknown one */
+int comm_json_parse_format(json_t *jobject);
+
+/* priority classes, served in this order */
+#define COMM_PRIORITY_NONE -1
+#define COMM_PRIORITY_CRITICAL 0
+#define COMM_PRIORITY_INTERACTIVE 1
+#define COMM_PRIORITY_BACKGROUND 2
+#define COMM_PRIORITIES 3
+
+/* optional priority, -2 for an unknown one */
+int comm_json_parse_priority(json_t *jobject);
+const char *comm_json_priority_name(int priority);
+
+WM_CMD_TYPE comm_json_command_type(const char *cmd_name);
+const char *comm_json_command_name(WM_CMD_TYPE type);
+
+/* json command -> records, appended to cmd */
+int comm_json_encode_command(json_t *jobject, WM_CMD_TYPE type,
+			     wm_command_t *cmd);
+
+#endif //__COMM_JSON_H__
@@ -16,392 +16,458 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <arpa/inet.h>
 #include <jansson.h>
 
 #include "ilm_control_wrapper.h"
 #include "comm_parser.h"
-
-#define UHMI_IVI_WM_VERSION "1.0.0"
-
-#define JSON_KEY_VERSION "version"
-#define JSON_KEY_COMMAND "command"
-#define JSON_KEY_TARGET "target"
-#define JSON_KEY_HOSTNAME "hostname"
-#define JSON_KEY_SCREENS "screens"
-#define JSON_KEY_INSERTODR "insert_order"
-#define JSON_KEY_REFID "referenceID"
-#define JSON_KEY_LAYERS "layers"
-#define JSON_KEY_SURFACES "surfaces"
-#define JSON_KEY_ID "id"
-#define JSON_KEY_WIDTH "width"
-#define JSON_KEY_HEIGHT "height"
-#define JSON_KEY_SRCX "src_x"
-#define JSON_KEY_SRCY "src_y"
-#define JSON_KEY_SRCW "src_w"
-#define JSON_KEY_SRCH "src_h"
-#define JSON_KEY_DSTX "dst_x"
-#define JSON_KEY_DSTY "dst_y"
-#define JSON_KEY_DSTW "dst_w"
-#define JSON_KEY_DSTH "dst_h"
-#define JSON_KEY_OPACITY "opacity"
-#define JSON_KEY_VISIBILITY "visibility"
-
-typedef enum _cmd_type {
-	CMD_TYPE_NONE = 0,
-	CMD_TYPE_ADD,
-	CMD_TYPE_MOD,
-} CMD_TYPE;
-
-typedef enum _insert_order {
-	INSERT_ORDER_NONE = 0,
-	INSERT_ORDER_PREPEND,
-	INSERT_ORDER_APPEND,
-	INSERT_ORDER_BEFORE,
-	INSERT_ORDER_AFTER
-} INSERT_ORDER;
-
-typedef struct _insert_info {
-	int order;
-	int refid;
-} insert_info_t;
+#include "comm_binary.h"
+#include "comm_json.h"
+#include "comm_query.h"
+#include "comm_template.h"
+#include "scene.h"
+#include "schedule.h"
+#include "shm_ring.h"
+#include "snapshot.h"
+#include "stats.h"
 
 static insert_info_t insert_info_default = { INSERT_ORDER_APPEND, 0 };
 
-static struct list_head screen_head;
-static struct list_head surface_properties_head;
+/* the published scene, the one the compositor shows */
+static scene_t *current_scene;
 
-static void init_list(struct list_head *list_head)
-{
-	TAILQ_INIT(list_head);
-}
+/* surfaces the compositor has, sorted, kept from its notifications */
+static t_ilm_uint *live_surfaces;
+static unsigned int nlive, live_capacity;
+
+/*
+ * Report of the message being handled, when its sender asked for one with
+ * "report": true. The objects the commands touch are listed with what was
+ * done to them, along with the ilm calls and commits and the time spent.
+ */
+typedef struct _report {
+	json_t *objects;
+	unsigned int ilm_calls, commits;
+	uint64_t start_ns, parsed_ns, started_ns, applied_ns;
+} report_t;
+
+static report_t *report;
 
-static int get_list_size(struct list_head *list_head)
+#define REPORT_APPLIED "applied"
+#define REPORT_SKIPPED "skipped"
+#define REPORT_NOT_FOUND "not_found"
+#define REPORT_ERROR "error"
+
+static void report_object(const char *type, t_ilm_uint id, const char *status)
 {
-	int size = 0;
-	list_element_t *elm;
-	TAILQ_FOREACH(elm, list_head, entry)
-	{
-		size++;
+	if (report == NULL) {
+		return;
 	}
-	return size;
+	json_array_append_new(report->objects,
+			      json_pack("{s:s,s:I,s:s}", "type", type, "id",
+					(json_int_t)id, "status", status));
 }
 
-static list_element_t *pop_list_element(struct list_head *list_head, int id)
+/* start of applying, and end of applying to the draft */
+static void report_started(void)
 {
-	list_element_t *elm;
-	TAILQ_FOREACH(elm, list_head, entry)
-	{
-		if (elm->id == id) {
-			TAILQ_REMOVE(list_head, elm, entry);
-			return elm;
-		}
+	if (report) {
+		report->started_ns = schedule_now();
+		wrap_ilm_get_counters(&report->ilm_calls, &report->commits);
 	}
-	return NULL;
 }
 
-static list_element_t *get_list_element(struct list_head *list_head, int id)
+static void report_applied(void)
 {
-	list_element_t *elm;
-	TAILQ_FOREACH(elm, list_head, entry)
-	{
-		if (elm->id == id) {
-			return elm;
-		}
+	if (report) {
+		report->applied_ns = schedule_now();
 	}
-	return NULL;
 }
 
-static void insert_list_element(struct list_head *list_head,
-				list_element_t *target_elm,
-				insert_info_t insert_info)
+/* the report goes after the result as u32 length and json text */
+static void report_finish(report_t *rep, int ret, parser_reply_t *reply)
 {
-	int insert_order = insert_info.order;
-	int insert_refId = insert_info.refid;
-
-	list_element_t *ref_elm;
-	if ((insert_order == INSERT_ORDER_BEFORE) ||
-	    (insert_order == INSERT_ORDER_AFTER)) {
-		ref_elm = get_list_element(list_head, insert_refId);
-		if (ref_elm == NULL) {
-			insert_order = INSERT_ORDER_APPEND;
+	unsigned int calls, commits, i;
+	uint64_t now = schedule_now();
+
+	/* a scheduled command is only queued, there is nothing to report */
+	if ((ret == PARSER_RESULT_QUEUED) ||
+	    (ret == PARSER_RESULT_DEFERRED)) {
+		json_decref(rep->objects);
+		return;
+	}
+
+	wrap_ilm_get_counters(&calls, &commits);
+	if (rep->applied_ns == 0) {
+		rep->applied_ns = rep->started_ns;
+	}
+
+	/* queue is the time the job waited for the apply thread */
+	json_t *jreport = json_pack(
+		"{s:i,s:o,s:i,s:i,s:{s:I,s:I,s:I,s:I}}", "result", ret,
+		"objects", rep->objects, "ilm_calls", calls - rep->ilm_calls,
+		"commits", commits - rep->commits, "time_us", "parse",
+		(json_int_t)((rep->parsed_ns - rep->start_ns) / 1000), "queue",
+		(json_int_t)((rep->started_ns - rep->parsed_ns) / 1000),
+		"apply",
+		(json_int_t)((rep->applied_ns - rep->started_ns) / 1000),
+		"commit", (json_int_t)((now - rep->applied_ns) / 1000));
+	rep->objects = NULL;
+	if (jreport == NULL) {
+		return;
+	}
+
+	/* batch results are part of the report */
+	if (reply->size > 0) {
+		const uint32_t *p = (const uint32_t *)reply->data;
+		json_t *jresults = json_array();
+		for (i = 0; i < ntohl(p[0]); i++) {
+			json_array_append_new(
+				jresults, json_integer((int32_t)ntohl(p[i + 1])));
 		}
+		json_object_set_new(jreport, "results", jresults);
 	}
 
-	switch (insert_order) {
-	case INSERT_ORDER_PREPEND:
-		TAILQ_INSERT_HEAD(list_head, target_elm, entry);
-		break;
-	case INSERT_ORDER_APPEND:
-		TAILQ_INSERT_TAIL(list_head, target_elm, entry);
-		break;
-	case INSERT_ORDER_BEFORE:
-		TAILQ_INSERT_BEFORE(ref_elm, target_elm, entry);
-		break;
-	case INSERT_ORDER_AFTER:
-		TAILQ_INSERT_AFTER(list_head, ref_elm, target_elm, entry);
-		break;
-	default:
-		break;
+	char *text = json_dumps(jreport, JSON_COMPACT);
+	json_decref(jreport);
+	if (text == NULL) {
+		return;
 	}
-}
-
-static int add_surface_properties(surface_properties_t *prop, int surface_id)
-{
-	list_element_t *surface_properties_elm =
-		get_list_element(&surface_properties_head, surface_id);
 
-	if (surface_properties_elm == NULL) {
-		surface_properties_elm =
-			calloc(1, sizeof(*surface_properties_elm));
-		surface_properties_elm->id = surface_id;
-		surface_properties_elm->prop =
-			calloc(1, sizeof(surface_properties_t));
-		insert_list_element(&surface_properties_head,
-				    surface_properties_elm,
-				    insert_info_default);
+	uint32_t len = strlen(text);
+	char *data = malloc(sizeof(len) + len);
+	if (data) {
+		uint32_t len_n = htonl(len);
+		memcpy(data, &len_n, sizeof(len_n));
+		memcpy(&data[sizeof(len_n)], text, len);
+		free(reply->data);
+		reply->data = data;
+		reply->size = sizeof(len) + len;
 	}
+	free(text);
+}
 
-	prop->referred_cnt++;
-	memcpy(surface_properties_elm->prop, prop,
-	       sizeof(surface_properties_t));
+/* ids of a render order handed to ilm, kept from one commit to the next */
+static t_ilm_uint *render_order;
+static unsigned int render_capacity;
 
-	return 0;
+static t_ilm_uint *render_order_space(unsigned int count)
+{
+	if (count > render_capacity) {
+		t_ilm_uint *ids = realloc(render_order, count * sizeof(*ids));
+		if (ids == NULL) {
+			fprintf(stderr, "%s(%d) ERROR: Out of memory\n",
+				__func__, __LINE__);
+			return NULL;
+		}
+		render_order = ids;
+		render_capacity = count;
+	}
+	return render_order;
 }
 
-static void remove_surface_properties(int surface_id)
+static void set_layer_render_order(const scene_layer_t *layer)
 {
-	list_element_t *surface_properties_elm =
-		get_list_element(&surface_properties_head, surface_id);
-	if (surface_properties_elm) {
-		surface_properties_t *prop =
-			(surface_properties_t *)surface_properties_elm->prop;
-		prop->referred_cnt--;
-		if (prop->referred_cnt == 0) {
-			pop_list_element(&surface_properties_head, surface_id);
-
-			free(surface_properties_elm->prop);
-			free(surface_properties_elm);
+	t_ilm_surface *surface_array_n = render_order_space(layer->nsurfaces);
+	int surfaces = 0;
+	unsigned int i;
+
+	if ((surface_array_n == NULL) && (layer->nsurfaces > 0)) {
+		return;
+	}
+	for (i = 0; i < layer->nsurfaces; i++) {
+		if (wrap_ilm_surface_exists(layer->surfaces[i])) {
+			surface_array_n[surfaces] = layer->surfaces[i];
+			surfaces++;
 		}
 	}
+
+	wrap_ilm_add_surface_to_layer(layer->id, surface_array_n, surfaces);
 }
 
-static list_element_t *add_surface(list_element_t *layer_elm,
-				   surface_properties_t *prop, int surface_id,
-				   insert_info_t insert_info)
+static void set_screen_render_order(const scene_screen_t *screen)
 {
-	list_element_t *surface_elm = calloc(1, sizeof(*surface_elm));
-	surface_elm->id = surface_id;
+	t_ilm_layer *layer_array_n = render_order_space(screen->nlayers);
+	unsigned int i;
 
-	add_surface_properties(prop, surface_id);
-	insert_list_element(&layer_elm->list_head, surface_elm, insert_info);
+	if ((layer_array_n == NULL) && (screen->nlayers > 0)) {
+		return;
+	}
+	for (i = 0; i < screen->nlayers; i++) {
+		layer_array_n[i] = screen->layers[i]->id;
+	}
 
-	return surface_elm;
+	wrap_ilm_add_layer_to_screen(screen->id, layer_array_n,
+				     screen->nlayers);
 }
 
-static int remove_surface(list_element_t *layer_elm, int surface_id)
+static int same_surface_order(const scene_layer_t *a, const scene_layer_t *b)
 {
-	list_element_t *surface_elm =
-		pop_list_element(&layer_elm->list_head, surface_id);
-	if (surface_elm) {
-		free(surface_elm);
-		remove_surface_properties(surface_id);
-		return 1;
+	if (a->nsurfaces != b->nsurfaces) {
+		return 0;
 	}
-	return 0;
+	return (a->nsurfaces == 0) ||
+	       (memcmp(a->surfaces, b->surfaces,
+		       a->nsurfaces * sizeof(*a->surfaces)) == 0);
 }
 
-static void remove_all_surface(list_element_t *layer_elm)
+static int same_layer_order(const scene_screen_t *a, const scene_screen_t *b)
 {
-	while (!TAILQ_EMPTY(&layer_elm->list_head)) {
-		list_element_t *surface_elm =
-			TAILQ_FIRST(&layer_elm->list_head);
-		t_ilm_uint surface_id = surface_elm->id;
+	unsigned int i;
 
-		TAILQ_REMOVE(&layer_elm->list_head, surface_elm, entry);
-		free(surface_elm);
-		remove_surface_properties(surface_id);
+	if (a->nlayers != b->nlayers) {
+		return 0;
 	}
+	for (i = 0; i < a->nlayers; i++) {
+		if (a->layers[i]->id != b->layers[i]->id) {
+			return 0;
+		}
+	}
+	return 1;
 }
 
-static list_element_t *add_layer(list_element_t *screen_elm,
-				 layer_properties_t *prop, int layer_id,
-				 insert_info_t insert_info)
+/*
+ * Brings the compositor from scene old to scene new. Nodes the two scenes
+ * share are unchanged and skipped, so only what the commands changed is
+ * sent to the compositor.
+ */
+static void sync_scene(const scene_t *old, const scene_t *new)
 {
-	list_element_t *layer_elm = calloc(1, sizeof(*layer_elm));
-	layer_elm->id = layer_id;
+	unsigned int i, j, k;
+
+	/* removed layers, and surfaces removed from a layer */
+	for (i = 0; i < old->nscreens; i++) {
+		const scene_screen_t *screen = old->screens[i];
+		for (j = 0; j < screen->nlayers; j++) {
+			const scene_layer_t *old_layer = screen->layers[j];
+			const scene_layer_t *layer =
+				scene_get_layer(new, old_layer->id);
+			if (layer == NULL) {
+				wrap_ilm_remove_layer(old_layer->id);
+				continue;
+			}
+			if (layer == old_layer) {
+				continue;
+			}
+			for (k = 0; k < old_layer->nsurfaces; k++) {
+				if (!scene_layer_has_surface(
+					    layer, old_layer->surfaces[k])) {
+					wrap_ilm_remove_surface(
+						old_layer->id,
+						old_layer->surfaces[k]);
+				}
+			}
+		}
+	}
 
-	layer_elm->prop = calloc(1, sizeof(layer_properties_t));
-	memcpy(layer_elm->prop, prop, sizeof(layer_properties_t));
+	/* layer properties */
+	for (i = 0; i < new->nscreens; i++) {
+		scene_screen_t *screen = new->screens[i];
+		for (j = 0; j < screen->nlayers; j++) {
+			scene_layer_t *layer = screen->layers[j];
+			const scene_layer_t *old_layer =
+				scene_get_layer(old, layer->id);
+			if (old_layer == layer) {
+				continue;
+			}
+			if ((old_layer == NULL) ||
+			    memcmp(&old_layer->prop, &layer->prop,
+				   sizeof(layer->prop))) {
+				wrap_ilm_set_layer(&layer->prop, layer->id);
+			}
+		}
+	}
 
-	/* initialize surface list */
-	init_list(&layer_elm->list_head);
+	/* surface properties */
+	for (i = 0; i < new->nsurfaces; i++) {
+		scene_surface_t *surface = new->surfaces[i];
+		const scene_surface_t *old_surface =
+			scene_get_surface(old, surface->id);
+		if (old_surface == surface) {
+			continue;
+		}
+		if ((old_surface == NULL) ||
+		    memcmp(&old_surface->prop.lp, &surface->prop.lp,
+			   sizeof(surface->prop.lp))) {
+			wrap_ilm_set_surface(&surface->prop, surface->id);
+		}
+	}
 
-	insert_list_element(&screen_elm->list_head, layer_elm, insert_info);
-	return layer_elm;
+	/* render orders */
+	for (i = 0; i < new->nscreens; i++) {
+		const scene_screen_t *screen = new->screens[i];
+		const scene_screen_t *old_screen =
+			scene_get_screen(old, screen->id);
+		if (old_screen == screen) {
+			continue;
+		}
+		for (j = 0; j < screen->nlayers; j++) {
+			const scene_layer_t *layer = screen->layers[j];
+			const scene_layer_t *old_layer =
+				scene_get_layer(old, layer->id);
+			if (old_layer == layer) {
+				continue;
+			}
+			if ((old_layer == NULL) ||
+			    !same_surface_order(old_layer, layer)) {
+				set_layer_render_order(layer);
+			}
+		}
+		if (old_screen ? !same_layer_order(old_screen, screen) :
+				 (screen->nlayers > 0)) {
+			set_screen_render_order(screen);
+		}
+	}
 }
 
-static list_element_t *get_layer(int layer_id)
+/*
+ * Commands are applied to a draft of the current scene. A draft is
+ * published only when all of its commands succeeded: the compositor gets
+ * the differences to the current scene and the draft becomes current. A
+ * failed draft is dropped, leaving the scene and the compositor untouched.
+ */
+static int publish_scene(void)
 {
-	list_element_t *screen_elm;
-	TAILQ_FOREACH(screen_elm, &screen_head, entry)
-	{
-		list_element_t *layer_elm =
-			get_list_element(&screen_elm->list_head, layer_id);
-		if (layer_elm) {
-			return layer_elm;
-		}
-	}
-	return NULL;
+	return snapshot_publish(current_scene, live_surfaces, nlive);
 }
 
-static list_element_t *pop_layer(int layer_id)
+/* index of the first live surface not below id */
+static unsigned int live_index(t_ilm_uint id)
 {
-	list_element_t *screen_elm;
-	TAILQ_FOREACH(screen_elm, &screen_head, entry)
-	{
-		list_element_t *layer_elm =
-			pop_list_element(&screen_elm->list_head, layer_id);
-		if (layer_elm) {
-			return layer_elm;
+	unsigned int lo = 0, hi = nlive;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (live_surfaces[mid] < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
 		}
 	}
-	return NULL;
+
+	return lo;
 }
 
-static int remove_layer(int layer_id)
+static int live_reserve(unsigned int capacity)
 {
-	list_element_t *layer_elm = pop_layer(layer_id);
-	if (layer_elm) {
-		remove_all_surface(layer_elm);
-		free(layer_elm->prop);
-		free(layer_elm);
-		return 1;
+	t_ilm_uint *surfaces =
+		realloc(live_surfaces, capacity * sizeof(*surfaces));
+	if (surfaces == NULL) {
+		return -1;
 	}
+	live_surfaces = surfaces;
+	live_capacity = capacity;
 	return 0;
 }
 
-static list_element_t *add_screen(int screen_id)
+void parser_surface_created(t_ilm_uint surface_id)
 {
-	list_element_t *screen_elm = calloc(1, sizeof(*screen_elm));
-	screen_elm->id = screen_id;
-
-	/* initialize layer list */
-	init_list(&screen_elm->list_head);
+	unsigned int idx = live_index(surface_id);
 
-	insert_list_element(&screen_head, screen_elm, insert_info_default);
-
-	return screen_elm;
+	if ((idx < nlive) && (live_surfaces[idx] == surface_id)) {
+		return;
+	}
+	if ((nlive == live_capacity) &&
+	    (live_reserve(live_capacity ? live_capacity * 2 : 16) < 0)) {
+		return;
+	}
+	memmove(&live_surfaces[idx + 1], &live_surfaces[idx],
+		(nlive - idx) * sizeof(*live_surfaces));
+	live_surfaces[idx] = surface_id;
+	nlive++;
+	publish_scene();
 }
 
-static void add_exists_surfaces_to_layer(list_element_t *layer_elm)
+void parser_surface_destroyed(t_ilm_uint surface_id)
 {
-	int surfaces = get_list_size(&layer_elm->list_head);
-	t_ilm_surface *surface_array_n =
-		malloc(surfaces * sizeof(t_ilm_surface));
-
-	surfaces = 0;
-	list_element_t *surface_elm;
-	TAILQ_FOREACH(surface_elm, &layer_elm->list_head, entry)
-	{
-		if (wrap_ilm_surface_exists(surface_elm->id)) {
-			surface_array_n[surfaces] = surface_elm->id;
-			surfaces++;
-		}
-	}
+	unsigned int idx = live_index(surface_id);
 
-	wrap_ilm_add_surface_to_layer(layer_elm->id, surface_array_n, surfaces);
-
-	if (surface_array_n) {
-		free(surface_array_n);
+	if ((idx == nlive) || (live_surfaces[idx] != surface_id)) {
+		return;
 	}
+	nlive--;
+	memmove(&live_surfaces[idx], &live_surfaces[idx + 1],
+		(nlive - idx) * sizeof(*live_surfaces));
+	publish_scene();
 }
 
-static void add_layers_to_screen(list_element_t *screen_elm)
+static int finish_draft(scene_t *draft, int ret)
 {
-	int layers = get_list_size(&screen_elm->list_head);
-	t_ilm_layer *layer_array_n = malloc(layers * sizeof(t_ilm_layer));
-
-	layers = 0;
-	list_element_t *layer_elm;
-	TAILQ_FOREACH(layer_elm, &screen_elm->list_head, entry)
-	{
-		wrap_ilm_set_layer(layer_elm->prop, layer_elm->id);
-
-		add_exists_surfaces_to_layer(layer_elm);
-
-		layer_array_n[layers] = layer_elm->id;
-		layers++;
+	if (ret < 0) {
+		scene_release(draft);
+		return ret;
 	}
 
-	wrap_ilm_add_layer_to_screen(screen_elm->id, layer_array_n, layers);
+	sync_scene(current_scene, draft);
+	scene_release(current_scene);
+	current_scene = draft;
+	publish_scene();
 
-	if (layer_array_n) {
-		free(layer_array_n);
-	}
+	return ret;
 }
 
 int parser_add_ivi_surface_by_event_notification(t_ilm_uint surface_id)
 {
-	list_element_t *screen_elm;
-	TAILQ_FOREACH(screen_elm, &screen_head, entry)
-	{
-		list_element_t *layer_elm;
-		TAILQ_FOREACH(layer_elm, &screen_elm->list_head, entry)
-		{
-			list_element_t *ref_surface_elm;
-			TAILQ_FOREACH(ref_surface_elm, &layer_elm->list_head,
-				      entry)
-			{
-				if (surface_id == ref_surface_elm->id) {
-					list_element_t *surface_properties_elm;
-					surface_properties_elm =
-						get_list_element(
-							&surface_properties_head,
-							surface_id);
-
-					wrap_ilm_set_surface(
-						surface_properties_elm->prop,
-						surface_id);
-
-					add_exists_surfaces_to_layer(layer_elm);
-				}
+	const scene_surface_t *surface =
+		scene_get_surface(current_scene, surface_id);
+	unsigned int i, j;
+
+	if (surface == NULL) {
+		return 0;
+	}
+
+	wrap_ilm_begin_transaction();
+	for (i = 0; i < current_scene->nscreens; i++) {
+		const scene_screen_t *screen = current_scene->screens[i];
+		for (j = 0; j < screen->nlayers; j++) {
+			const scene_layer_t *layer = screen->layers[j];
+			if (scene_layer_has_surface(layer, surface_id)) {
+				wrap_ilm_set_surface(
+					(surface_properties_t *)&surface->prop,
+					surface_id);
+				set_layer_render_order(layer);
 			}
 		}
 	}
+	wrap_ilm_end_transaction();
 
 	return 0;
 }
 
 int parser_check_registered_surface_in_list_tree(t_ilm_uint surface_id)
 {
-	if (get_list_element(&surface_properties_head, surface_id)) {
+	if (scene_get_surface(current_scene, surface_id)) {
 		return 1;
 	}
 	return 0;
 }
 
+/* printed from the published snapshot, as any other thread could */
 static void debug_print_all_list(void)
 {
-	list_element_t *screen_elm;
-	TAILQ_FOREACH(screen_elm, &screen_head, entry)
-	{
-		fprintf(stderr, "SCR: %d\n", screen_elm->id);
-		list_element_t *layer_elm;
-		TAILQ_FOREACH(layer_elm, &screen_elm->list_head, entry)
-		{
-			fprintf(stderr, "   |- LYR: %d\n", layer_elm->id);
-			list_element_t *surface_elm;
-			TAILQ_FOREACH(surface_elm, &layer_elm->list_head, entry)
-			{
-				fprintf(stderr, "         |- SFC: %d",
-					surface_elm->id);
-				list_element_t *surface_properties_elm = NULL;
-				surface_properties_elm = get_list_element(
-					&surface_properties_head,
-					surface_elm->id);
-				if (surface_properties_elm) {
+	unsigned int i, j, k;
+
+	const snapshot_t *snapshot = snapshot_read_lock();
+	if (snapshot == NULL) {
+		snapshot_read_unlock();
+		return;
+	}
+
+	for (i = 0; i < snapshot->nscreens; i++) {
+		const snapshot_screen_t *screen = &snapshot->screens[i];
+		fprintf(stderr, "SCR: %d\n", screen->id);
+		for (j = 0; j < screen->nlayers; j++) {
+			const snapshot_layer_t *layer =
+				&snapshot->layers[screen->first_layer + j];
+			fprintf(stderr, "   |- LYR: %d\n", layer->id);
+			for (k = 0; k < layer->nsurfaces; k++) {
+				t_ilm_uint id = snapshot->surface_ids
+							[layer->first_surface + k];
+				fprintf(stderr, "         |- SFC: %d", id);
+				if (snapshot_get_surface(snapshot, id)) {
 					fprintf(stderr, " (SFC Prop Exist) \n");
 				} else {
 					fprintf(stderr,
@@ -410,830 +476,1064 @@ static void debug_print_all_list(void)
 			}
 		}
 	}
+	snapshot_read_unlock();
 }
 
-static int get_json_string_value(json_t *jobject, char *key, char *value)
+static void set_layout_properties(layout_properties_t *prop,
+				  const wm_record_t *rec)
 {
-	if (json_is_string(json_object_get(jobject, key))) {
-		sprintf(value, "%s",
-			json_string_value(json_object_get(jobject, key)));
-		return 0;
-	}
-
-	fprintf(stderr,
-		"%s(%d) Error: json type other than string, or for NULL. [%s]\n",
-		__func__, __LINE__, key);
-
-	return -1;
+	if (rec->fields & WM_FIELD_SRCX)
+		prop->src_x = rec->src_x;
+	if (rec->fields & WM_FIELD_SRCY)
+		prop->src_y = rec->src_y;
+	if (rec->fields & WM_FIELD_SRCW)
+		prop->src_w = rec->src_w;
+	if (rec->fields & WM_FIELD_SRCH)
+		prop->src_h = rec->src_h;
+	if (rec->fields & WM_FIELD_DSTX)
+		prop->dst_x = rec->dst_x;
+	if (rec->fields & WM_FIELD_DSTY)
+		prop->dst_y = rec->dst_y;
+	if (rec->fields & WM_FIELD_DSTW)
+		prop->dst_w = rec->dst_w;
+	if (rec->fields & WM_FIELD_DSTH)
+		prop->dst_h = rec->dst_h;
+	if (rec->fields & WM_FIELD_OPACITY)
+		prop->opacity = rec->opacity;
+	if (rec->fields & WM_FIELD_VISIBILITY)
+		prop->visibility = rec->visibility;
 }
 
-static int get_json_integer_value(json_t *jobject, char *key, t_ilm_uint *value)
+static void set_layer_properties(layer_properties_t *prop,
+				 const wm_record_t *rec)
 {
-	if (json_is_integer(json_object_get(jobject, key))) {
-		*value = json_integer_value(json_object_get(jobject, key));
-		return 0;
-	}
-
-	fprintf(stderr,
-		"%s(%d) Error: json type other than integer, or for NULL. [%s]\n",
-		__func__, __LINE__, key);
-
-	return -1;
+	if (rec->fields & WM_FIELD_WIDTH)
+		prop->width = rec->width;
+	if (rec->fields & WM_FIELD_HEIGHT)
+		prop->height = rec->height;
+	set_layout_properties(&prop->lp, rec);
 }
 
-static int get_json_real_value(json_t *jobject, char *key, t_ilm_float *value)
+/*
+ * Records are applied one by one to a draft. The screen and layer a record
+ * refers to are the ones of the preceding screen and layer records.
+ */
+typedef struct _apply_state {
+	WM_CMD_TYPE type;
+	scene_t *scene;
+	int has_screen;
+	t_ilm_uint screen_id;
+	int has_layer;
+	t_ilm_uint layer_id;
+	insert_info_t insert_info;
+} apply_state_t;
+
+static int apply_screen_record(apply_state_t *state, const wm_record_t *rec)
 {
-	if (json_is_integer(json_object_get(jobject, key))) {
-		*value = (t_ilm_float)json_integer_value(
-			json_object_get(jobject, key));
-		return 0;
+	state->has_screen = 0;
+	state->has_layer = 0;
+	state->screen_id = rec->id;
+
+	state->insert_info = insert_info_default;
+	if (rec->fields & WM_FIELD_INSERT) {
+		state->insert_info.order = rec->insert_order;
+		state->insert_info.refid = rec->refid;
 	}
 
-	if (json_is_real(json_object_get(jobject, key))) {
-		*value = json_real_value(json_object_get(jobject, key));
-		return 0;
+	switch (state->type) {
+	case WM_CMD_INITIAL_SCREEN:
+		if (wrap_ilm_screen_exists(rec->id) == 0) {
+			fprintf(stderr, "%s(%d) ERROR: Screen %d not found\n",
+				__func__, __LINE__, rec->id);
+			report_object("screen", rec->id, REPORT_NOT_FOUND);
+			return -1;
+		}
+		if (scene_add_screen(state->scene, rec->id) < 0) {
+			report_object("screen", rec->id, REPORT_ERROR);
+			return -1;
+		}
+		state->has_screen = 1;
+		report_object("screen", rec->id, REPORT_APPLIED);
+		break;
+	case WM_CMD_ADD_LAYER:
+		/* only when matches screens id */
+		state->has_screen =
+			(scene_get_screen(state->scene, rec->id) != NULL);
+		if (!state->has_screen) {
+			report_object("screen", rec->id, REPORT_NOT_FOUND);
+		}
+		break;
+	case WM_CMD_ADD_SURFACE:
+		break;
+	default:
+		return -1;
 	}
 
-	fprintf(stderr,
-		"%s(%d) Error: json type other than real, or for NULL. [%s]\n",
-		__func__, __LINE__, key);
-	return -1;
+	return 0;
 }
 
-static int get_json_array(json_t *jobject, char *key, json_t **array_jobj)
+static int apply_layer_record(apply_state_t *state, const wm_record_t *rec)
 {
-	if (json_is_array(json_object_get(jobject, key))) {
-		*array_jobj = json_object_get(jobject, key);
-		return 0;
-	}
+	layer_properties_t *layer_prop;
 
-	fprintf(stderr,
-		"%s(%d) Error: json type other than array, or for NULL. [%s]\n",
-		__func__, __LINE__, key);
-	return -1;
-}
+	state->has_layer = 0;
+	state->layer_id = rec->id;
 
-static int parse_target(json_t *jobject, json_t **array_jobj)
-{
-	if (get_json_array(jobject, JSON_KEY_TARGET, array_jobj) < 0) {
+	switch (state->type) {
+	case WM_CMD_INITIAL_SCREEN:
+		if (!state->has_screen) {
+			report_object("layer", rec->id, REPORT_ERROR);
+			return -1;
+		}
+		layer_prop = scene_set_layer(state->scene, state->screen_id,
+					     rec->id, insert_info_default);
+		if (layer_prop == NULL) {
+			report_object("layer", rec->id, REPORT_ERROR);
+			return -1;
+		}
+		set_layer_properties(layer_prop, rec);
+		state->has_layer = 1;
+		report_object("layer", rec->id, REPORT_APPLIED);
+		break;
+	case WM_CMD_ADD_LAYER:
+		if (state->has_screen) {
+			layer_prop = scene_set_layer(state->scene,
+						     state->screen_id, rec->id,
+						     state->insert_info);
+			if (layer_prop == NULL) {
+				report_object("layer", rec->id, REPORT_ERROR);
+				return -1;
+			}
+			set_layer_properties(layer_prop, rec);
+			report_object("layer", rec->id, REPORT_APPLIED);
+		} else {
+			report_object("layer", rec->id, REPORT_SKIPPED);
+		}
+		break;
+	case WM_CMD_REMOVE_LAYER:
+		report_object("layer", rec->id,
+			      scene_get_layer(state->scene, rec->id) ?
+				      REPORT_APPLIED :
+				      REPORT_NOT_FOUND);
+		scene_remove_layer(state->scene, rec->id);
+		break;
+	case WM_CMD_MODIFY_LAYER:
+		if (scene_get_layer(state->scene, rec->id)) {
+			layer_prop = scene_modify_layer(state->scene, rec->id);
+			if (layer_prop == NULL) {
+				report_object("layer", rec->id, REPORT_ERROR);
+				return -1;
+			}
+			set_layer_properties(layer_prop, rec);
+			report_object("layer", rec->id, REPORT_APPLIED);
+		} else {
+			report_object("layer", rec->id, REPORT_NOT_FOUND);
+		}
+		break;
+	case WM_CMD_ADD_SURFACE:
+	case WM_CMD_REMOVE_SURFACE:
+		state->has_layer =
+			(scene_get_layer(state->scene, rec->id) != NULL);
+		if (!state->has_layer) {
+			report_object("layer", rec->id, REPORT_NOT_FOUND);
+		}
+		break;
+	default:
 		return -1;
 	}
+
 	return 0;
 }
 
-static int parse_screens(json_t *jobject, json_t **array_jobj)
+static int apply_surface_record(apply_state_t *state, const wm_record_t *rec)
 {
-	if (get_json_array(jobject, JSON_KEY_SCREENS, array_jobj) < 0) {
+	surface_properties_t *surface_prop;
+
+	switch (state->type) {
+	case WM_CMD_INITIAL_SCREEN:
+	case WM_CMD_ADD_SURFACE:
+		if (!state->has_layer) {
+			/* add_surface skips surfaces of unknown layers */
+			if (state->type == WM_CMD_INITIAL_SCREEN) {
+				report_object("surface", rec->id, REPORT_ERROR);
+				return -1;
+			}
+			report_object("surface", rec->id, REPORT_SKIPPED);
+			return 0;
+		}
+		surface_prop = scene_set_surface(
+			state->scene, state->layer_id, rec->id,
+			(state->type == WM_CMD_INITIAL_SCREEN) ?
+				insert_info_default :
+				state->insert_info);
+		if (surface_prop == NULL) {
+			report_object("surface", rec->id, REPORT_ERROR);
+			return -1;
+		}
+		set_layout_properties(&surface_prop->lp, rec);
+		report_object("surface", rec->id, REPORT_APPLIED);
+		break;
+	case WM_CMD_REMOVE_SURFACE:
+		if (!state->has_layer) {
+			report_object("surface", rec->id, REPORT_SKIPPED);
+			break;
+		}
+		if (scene_remove_surface(state->scene, state->layer_id,
+					 rec->id) < 0) {
+			report_object("surface", rec->id, REPORT_NOT_FOUND);
+			return -1;
+		}
+		report_object("surface", rec->id, REPORT_APPLIED);
+		break;
+	case WM_CMD_MODIFY_SURFACE:
+		surface_prop = scene_modify_surface(state->scene, rec->id);
+		if (surface_prop == NULL) {
+			report_object("surface", rec->id, REPORT_NOT_FOUND);
+			return -1;
+		}
+		set_layout_properties(&surface_prop->lp, rec);
+		report_object("surface", rec->id, REPORT_APPLIED);
+		break;
+	default:
 		return -1;
 	}
+
 	return 0;
 }
 
-static int parse_layers(json_t *jobject, json_t **array_jobj)
+static void apply_begin(apply_state_t *state, WM_CMD_TYPE type,
+			scene_t *scene)
 {
-	if (get_json_array(jobject, JSON_KEY_LAYERS, array_jobj) < 0) {
-		return -1;
+	memset(state, 0, sizeof(*state));
+	state->type = type;
+	state->scene = scene;
+	state->insert_info = insert_info_default;
+
+	if (type == WM_CMD_INITIAL_SCREEN) {
+		scene_clear(scene);
 	}
-	return 0;
 }
 
-static int parse_surfaces(json_t *jobject, json_t **array_jobj)
+static int apply_record(apply_state_t *state, const wm_record_t *rec)
 {
-	if (get_json_array(jobject, JSON_KEY_SURFACES, array_jobj) < 0) {
+	switch (rec->kind) {
+	case WM_RECORD_SCREEN:
+		return apply_screen_record(state, rec);
+	case WM_RECORD_LAYER:
+		return apply_layer_record(state, rec);
+	case WM_RECORD_SURFACE:
+		return apply_surface_record(state, rec);
+	default:
+		fprintf(stderr, "%s(%d) ERROR: Illegal record kind %d\n",
+			__func__, __LINE__, rec->kind);
 		return -1;
 	}
-	return 0;
 }
 
-static int parse_id(json_t *jobject, int *id)
+static int apply_command(scene_t *draft, const wm_command_t *cmd)
 {
-	if (get_json_integer_value(jobject, JSON_KEY_ID, id) < 0) {
-		return -1;
+	apply_state_t state;
+	uint32_t i;
+	int ret = 0;
+
+	apply_begin(&state, cmd->type, draft);
+	for (i = 0; (ret == 0) && (i < cmd->nrecords); i++) {
+		ret = apply_record(&state, &cmd->records[i]);
 	}
-	return 0;
+
+	return ret;
 }
 
-static int parse_hostname(json_t *jobject)
+static int init_default_config(void)
 {
-	char hostname[32] = { 0 };
-	if (get_json_string_value(jobject, JSON_KEY_HOSTNAME, hostname) < 0) {
-		fprintf(stderr, "%s(%d) Warning: Not find hostname property\n",
-			__func__, __LINE__);
-		return -1;
-	}
+	fprintf(stderr, "%s(%d) WARNING: Init default config\n", __func__,
+		__LINE__);
 
-	char local_hostname[32] = { 0 };
-	gethostname(local_hostname, sizeof(local_hostname) - 1);
+	int screen_idx;
+	int ret = 0;
 
-	if (strcmp(local_hostname, hostname)) {
-		fprintf(stderr, "%s(%d) Status: %s is not covered.\n", __func__,
-			__LINE__, hostname);
-		return -1;
-	}
+	t_ilm_uint count = 0;
+	t_ilm_uint *screen_array_n = NULL;
 
-	return 0;
-}
+	wrap_ilm_get_screen_ids(&count, &screen_array_n);
 
-static int parse_version(json_t *jobject)
-{
-	char version[32] = { 0 };
-	if (get_json_string_value(jobject, JSON_KEY_VERSION, version) < 0) {
-		fprintf(stderr, "%s(%d) Warning: Not find version property\n",
-			__func__, __LINE__);
+	scene_t *draft = scene_begin(current_scene);
+	if (draft == NULL) {
 		return -1;
 	}
 
-	if (strcmp(UHMI_IVI_WM_VERSION, version)) {
-		fprintf(stderr,
-			"%s(%d) Warning:%s Json format version is illegal. \n",
-			__func__, __LINE__, version);
-		return -1;
+	for (screen_idx = 0; (ret == 0) && (screen_idx < count);
+	     screen_idx++) {
+		ret = scene_add_screen(draft, screen_array_n[screen_idx]);
 	}
 
-	return 0;
+	return finish_draft(draft, ret);
 }
 
-static int parse_command(json_t *jobject, char *cmd_name)
+static int parse_init_json_config(char *json_cfg_path)
 {
-	if (get_json_string_value(jobject, JSON_KEY_COMMAND, cmd_name) < 0) {
-		fprintf(stderr, "%s(%d) Warning: Not find command property\n",
-			__func__, __LINE__);
+	int target_idx;
+	int ret = 0;
+
+	json_error_t jerror;
+	json_t *root_jobj;
+
+	root_jobj = json_load_file(json_cfg_path, 0, &jerror);
+	if (!root_jobj) {
+		fprintf(stderr,
+			"%s(%d) WARNING: %s file. Invalid line %d: %s\n",
+			__func__, __LINE__, json_cfg_path, jerror.line,
+			jerror.text);
 		return -1;
 	}
 
-	return 0;
-}
+	if (comm_json_parse_version(root_jobj) < 0) {
+		/*return -1;*/
+	}
 
-static int parse_insert_info(json_t *jobject, insert_info_t *insert_info)
-{
-	int ret = 0;
+	json_t *target_ary_jobj = NULL;
+	comm_json_parse_target(root_jobj, &target_ary_jobj);
 
-	char val[32] = { 0 };
-	ret = get_json_string_value(jobject, JSON_KEY_INSERTODR, val);
-	if (ret < 0) {
-		fprintf(stderr,
-			"%s(%d) Warning: Not find insert_order property. \n",
-			__func__, __LINE__);
-		insert_info->order = INSERT_ORDER_NONE;
-		ret = -1;
-	} else if (strcmp("append", val) == 0) {
-		insert_info->order = INSERT_ORDER_APPEND;
-	} else if (strcmp("prepend", val) == 0) {
-		insert_info->order = INSERT_ORDER_PREPEND;
-	} else if (strcmp("before", val) == 0) {
-		insert_info->order = INSERT_ORDER_BEFORE;
-	} else if (strcmp("after", val) == 0) {
-		insert_info->order = INSERT_ORDER_AFTER;
-	} else {
-		fprintf(stderr,
-			"%s(%d) Warning:%s Json format insert_order is illegal. \n",
-			__func__, __LINE__, val);
-		insert_info->order = INSERT_ORDER_NONE;
-		ret = -1;
+	wm_command_t cmd = { 0 };
+	json_t *target_jobj;
+	json_array_foreach(target_ary_jobj, target_idx, target_jobj)
+	{
+		if (comm_json_parse_hostname(target_jobj) < 0) {
+			continue;
+		}
+
+		ret = comm_json_encode_command(target_jobj,
+					       WM_CMD_INITIAL_SCREEN, &cmd);
+		if (ret < 0) {
+			break;
+		}
 	}
 
-	if (get_json_integer_value(jobject, JSON_KEY_REFID,
-				   &insert_info->refid) < 0) {
-		ret = -1;
+	if ((ret == 0) && (cmd.nrecords > 0)) {
+		scene_t *draft = scene_begin(current_scene);
+		if (draft == NULL) {
+			ret = -1;
+		} else {
+			wrap_ilm_begin_transaction();
+			ret = finish_draft(draft, apply_command(draft, &cmd));
+			wrap_ilm_end_transaction();
+		}
 	}
 
-	return ret;
-}
+	comm_binary_free_command(&cmd);
+	json_decref(root_jobj);
 
-static int parse_mod_properties(layout_properties_t *dst_prop, json_t *jobject)
-{
-	layout_properties_t src_prop;
-	memcpy(&src_prop, dst_prop, sizeof(src_prop));
-
-	get_json_integer_value(jobject, JSON_KEY_SRCX, &src_prop.src_x);
-	get_json_integer_value(jobject, JSON_KEY_SRCY, &src_prop.src_y);
-	get_json_integer_value(jobject, JSON_KEY_SRCW, &src_prop.src_w);
-	get_json_integer_value(jobject, JSON_KEY_SRCH, &src_prop.src_h);
-	get_json_integer_value(jobject, JSON_KEY_DSTX, &src_prop.dst_x);
-	get_json_integer_value(jobject, JSON_KEY_DSTY, &src_prop.dst_y);
-	get_json_integer_value(jobject, JSON_KEY_DSTW, &src_prop.dst_w);
-	get_json_integer_value(jobject, JSON_KEY_DSTH, &src_prop.dst_h);
-	get_json_real_value(jobject, JSON_KEY_OPACITY, &src_prop.opacity);
-	get_json_integer_value(jobject, JSON_KEY_VISIBILITY,
-			       &src_prop.visibility);
-
-	memcpy(dst_prop, &src_prop, sizeof(src_prop));
-	return 0;
+	return ret;
 }
 
-static int parse_add_properties(layout_properties_t *dst_prop, json_t *jobject)
+int parser_init(char *json_cfg_path)
 {
-	layout_properties_t src_prop;
-	memcpy(&src_prop, dst_prop, sizeof(src_prop));
-
-	if (get_json_integer_value(jobject, JSON_KEY_SRCX, &src_prop.src_x) <
-	    0) {
+	/* bounded, the render orders and live surfaces of the scene fit */
+	const scene_limits_t *limits = scene_get_limits();
+	unsigned int max_surfaces =
+		limits->layers * limits->surfaces_per_layer;
+	unsigned int max_order = (limits->layers > limits->surfaces_per_layer) ?
+					 limits->layers :
+					 limits->surfaces_per_layer;
+	if ((max_surfaces > 0) && ((render_order_space(max_order) == NULL) ||
+				   (live_reserve(max_surfaces) < 0))) {
 		return -1;
 	}
-	if (get_json_integer_value(jobject, JSON_KEY_SRCY, &src_prop.src_y) <
-	    0) {
-		return -1;
-	}
-	if (get_json_integer_value(jobject, JSON_KEY_SRCW, &src_prop.src_w) <
-	    0) {
-		return -1;
-	}
-	if (get_json_integer_value(jobject, JSON_KEY_SRCH, &src_prop.src_h) <
-	    0) {
-		return -1;
-	}
-	if (get_json_integer_value(jobject, JSON_KEY_DSTX, &src_prop.dst_x) <
-	    0) {
-		return -1;
-	}
-	if (get_json_integer_value(jobject, JSON_KEY_DSTY, &src_prop.dst_y) <
-	    0) {
-		return -1;
-	}
-	if (get_json_integer_value(jobject, JSON_KEY_DSTW, &src_prop.dst_w) <
-	    0) {
+
+	current_scene = scene_new();
+	if ((current_scene == NULL) || (publish_scene() < 0)) {
 		return -1;
 	}
-	if (get_json_integer_value(jobject, JSON_KEY_DSTH, &src_prop.dst_h) <
-	    0) {
-		return -1;
+
+	if (json_cfg_path) {
+		parse_init_json_config(json_cfg_path);
 	}
-	if (get_json_real_value(jobject, JSON_KEY_OPACITY, &src_prop.opacity) <
-	    0) {
-		return -1;
+
+	if (current_scene->nscreens == 0) {
+		init_default_config();
 	}
-	if (get_json_integer_value(jobject, JSON_KEY_VISIBILITY,
-				   &src_prop.visibility) < 0) {
-		return -1;
+
+	wrap_ilm_set_notification_callback();
+
+	/* surfaces created from now on are notified */
+	t_ilm_int i, count;
+	t_ilm_uint *surfaces;
+	wrap_ilm_get_surface_ids(&count, &surfaces);
+	for (i = 0; i < count; i++) {
+		parser_surface_created(surfaces[i]);
 	}
+	free(surfaces);
+
+	debug_print_all_list();
 
-	memcpy(dst_prop, &src_prop, sizeof(src_prop));
 	return 0;
 }
 
-static int parse_layer_properties(layer_properties_t *dst_prop, json_t *jobject,
-				  CMD_TYPE type)
+/* scene command, or a template invocation of one -> records */
+static int encode_json_command(json_t *jobject, wm_command_t *cmd)
 {
-	layer_properties_t src_prop;
-	memcpy(&src_prop, dst_prop, sizeof(src_prop));
+	char cmd_name[32] = { 0 };
+	if (comm_json_parse_command(jobject, cmd_name, sizeof(cmd_name)) < 0) {
+		fprintf(stderr, "%s(%d) ERROR: Not find command property\n",
+			__func__, __LINE__);
+		return -1;
+	}
 
-	if (type == CMD_TYPE_ADD) {
-		if (get_json_integer_value(jobject, JSON_KEY_WIDTH,
-					   &src_prop.width) < 0) {
-			return -1;
-		}
-		if (get_json_integer_value(jobject, JSON_KEY_HEIGHT,
-					   &src_prop.height) < 0) {
-			return -1;
-		}
-		parse_add_properties(&src_prop.lp, jobject);
-	} else {
-		get_json_integer_value(jobject, JSON_KEY_WIDTH,
-				       &src_prop.width);
-		get_json_integer_value(jobject, JSON_KEY_HEIGHT,
-				       &src_prop.height);
-		parse_mod_properties(&src_prop.lp, jobject);
+	WM_CMD_TYPE type = comm_json_command_type(cmd_name);
+	if (type != WM_CMD_NONE) {
+		return comm_json_encode_command(jobject, type, cmd);
 	}
 
-	memcpy(dst_prop, &src_prop, sizeof(src_prop));
-	return 0;
+	if (strcmp("invoke_template", cmd_name) == 0) {
+		/* a template never expands into another template command */
+		json_t *cmd_jobj = comm_template_instantiate(jobject);
+		return cmd_jobj ? encode_json_command(cmd_jobj, cmd) : -1;
+	}
+
+	fprintf(stderr, "%s(%d) ERROR: Illegal command name %s\n", __func__,
+		__LINE__, cmd_name);
+	return -1;
 }
 
-static int parse_surface_properties(surface_properties_t *dst_prop,
-				    json_t *jobject, CMD_TYPE type)
+/* reply of a batch: u32 count, then one s32 result per command */
+static void set_batch_reply(parser_reply_t *reply, const int *results,
+			    unsigned int count)
 {
-	surface_properties_t src_prop;
-	memcpy(&src_prop, dst_prop, sizeof(src_prop));
+	unsigned int i;
 
-	if (type == CMD_TYPE_ADD) {
-		parse_add_properties(&src_prop.lp, jobject);
-	} else {
-		parse_mod_properties(&src_prop.lp, jobject);
+	reply->size = sizeof(uint32_t) * (count + 1);
+	reply->data = malloc(reply->size);
+	if (reply->data == NULL) {
+		reply->size = 0;
+		return;
 	}
 
-	memcpy(dst_prop, &src_prop, sizeof(src_prop));
-	return 0;
+	uint32_t *p = (uint32_t *)reply->data;
+	p[0] = htonl(count);
+	for (i = 0; i < count; i++) {
+		p[i + 1] = htonl(results[i]);
+	}
 }
 
-static list_element_t *decide_add_or_update_layer(list_element_t *screen_elm,
-						  json_t *layer_jobj,
-						  int layer_id, CMD_TYPE type,
-						  insert_info_t insert_info)
+static void free_commands(wm_command_t *cmds, unsigned int count)
 {
-	list_element_t *layer_elm = pop_layer(layer_id);
-	if (layer_elm == NULL) {
-		layer_properties_t layer_prop;
-		parse_layer_properties(&layer_prop, layer_jobj, type);
+	unsigned int i;
 
-		layer_elm = add_layer(screen_elm, &layer_prop, layer_id,
-				      insert_info);
-
-		wrap_ilm_set_layer(&layer_prop, layer_id);
-	} else {
-		parse_layer_properties(layer_elm->prop, layer_jobj, type);
-
-		insert_list_element(&screen_elm->list_head, layer_elm,
-				    insert_info);
-
-		wrap_ilm_set_layer(layer_elm->prop, layer_id);
+	for (i = 0; i < count; i++) {
+		comm_binary_free_command(&cmds[i]);
 	}
-
-	return layer_elm;
+	free(cmds);
 }
 
-static list_element_t *decide_add_or_update_surface(list_element_t *layer_elm,
-						    json_t *surface_jobj,
-						    int surface_id,
-						    CMD_TYPE type,
-						    insert_info_t insert_info)
+/*
+ * The commands are applied in order to one draft, and the first failure
+ * drops the draft: they are applied entirely or not at all. results may be
+ * NULL when nobody is waiting for them.
+ */
+static int apply_commands(const wm_command_t *cmds, unsigned int count,
+			  int *results)
 {
-	list_element_t *surface_elm =
-		pop_list_element(&layer_elm->list_head, surface_id);
-	if (surface_elm == NULL) {
-		surface_properties_t surface_prop;
-		parse_surface_properties(&surface_prop, surface_jobj, type);
+	unsigned int idx;
+	int initial = 0;
+	int ret = 0;
 
-		surface_elm = add_surface(layer_elm, &surface_prop, surface_id,
-					  insert_info);
+	scene_t *draft = scene_begin(current_scene);
+	if (draft == NULL) {
+		return -1;
+	}
 
-		wrap_ilm_set_surface(&surface_prop, surface_id);
-	} else {
-		list_element_t *surface_properties_elm;
-		surface_properties_elm =
-			get_list_element(&surface_properties_head, surface_id);
-		parse_surface_properties(surface_properties_elm->prop,
-					 surface_jobj, type);
+	for (idx = 0; (ret == 0) && (idx < count); idx++) {
+		ret = apply_command(draft, &cmds[idx]);
+		if (results) {
+			results[idx] = ret;
+		}
+		if (cmds[idx].type == WM_CMD_INITIAL_SCREEN) {
+			initial = 1;
+		}
+	}
+
+	report_applied();
+	ret = finish_draft(draft, ret);
 
-		insert_list_element(&layer_elm->list_head, surface_elm,
-				    insert_info);
+	if (initial && (ret == 0)) {
+		wrap_ilm_set_notification_callback();
+	}
 
-		wrap_ilm_set_surface(surface_properties_elm->prop, surface_id);
+	for (idx = 0; (ret == 0) && (idx < count); idx++) {
+		comm_event_publish(EVENT_COMMAND_APPLIED, 0,
+				   comm_json_command_name(cmds[idx].type), ret);
 	}
 
-	return surface_elm;
+	return ret;
 }
 
-static int init_default_config(void)
+/*
+ * All commands of a batch are converted to records before anything is
+ * applied, so a malformed command rejects the whole batch.
+ */
+static int encode_batch_command(json_t *jobject, wm_command_t *cmds,
+				int *results, unsigned int count)
 {
-	fprintf(stderr, "%s(%d) WARNING: Init default config\n", __func__,
-		__LINE__);
+	json_t *cmd_ary_jobj = NULL;
+	comm_json_parse_commands(jobject, &cmd_ary_jobj);
 
-	int screen_idx;
-
-	t_ilm_uint count = 0;
-	t_ilm_uint *screen_array_n = NULL;
-
-	wrap_ilm_get_screen_ids(&count, &screen_array_n);
-
-	for (screen_idx = 0; screen_idx < count; screen_idx++) {
-		add_screen(screen_array_n[screen_idx]);
+	int ret = 0;
+	size_t idx;
+	json_t *cmd_jobj;
+	json_array_foreach(cmd_ary_jobj, idx, cmd_jobj)
+	{
+		/* cmds and results have room for count commands */
+		if (idx >= count) {
+			ret = -1;
+			break;
+		}
+		results[idx] = encode_json_command(cmd_jobj, &cmds[idx]);
+		if (results[idx] < 0) {
+			ret = -1;
+		}
 	}
 
-	return 0;
+	return ret;
 }
 
-static int parse_all_in_screen(json_t *jobject)
-{
-	int screen_idx, layer_idx, surface_idx;
+/* commands with a deadline wait in the schedule until they are due */
+typedef struct _scheduled_commands {
+	unsigned int count;
+	wm_command_t *cmds;
+	int *results;
+	int is_batch;
+	uint64_t tag;
+	int ret;
+} scheduled_commands_t;
 
-	//1. screens(list)
-	json_t *screen_ary_jobj = NULL;
-	parse_screens(jobject, &screen_ary_jobj);
+static parser_completion_t completion_handler;
 
-	json_t *screen_jobj;
-	json_array_foreach(screen_ary_jobj, screen_idx, screen_jobj)
-	{
-		int screen_id = 0;
-		parse_id(screen_jobj, &screen_id);
-		if (wrap_ilm_screen_exists(screen_id) == 0) {
-			fprintf(stderr, "%s(%d) ERROR: Screen %d not found\n",
-				__func__, __LINE__, screen_id);
-			return -1;
-		}
+void parser_set_completion_handler(parser_completion_t handler)
+{
+	completion_handler = handler;
+}
 
-		list_element_t *screen_elm;
-		screen_elm = get_list_element(&screen_head, screen_id);
-		if (screen_elm == NULL) {
-			screen_elm = add_screen(screen_id);
-		}
+/* commands a failed batch did not apply are marked as such */
+static void finish_results(int ret, int *results, unsigned int count)
+{
+	unsigned int idx;
 
-		//2. layers(list)
-		json_t *layer_ary_jobj = NULL;
-		parse_layers(screen_jobj, &layer_ary_jobj);
-
-		json_t *layer_jobj;
-		json_array_foreach(layer_ary_jobj, layer_idx, layer_jobj)
-		{
-			int layer_id = 0;
-			parse_id(layer_jobj, &layer_id);
-
-			list_element_t *layer_elm;
-			layer_elm = decide_add_or_update_layer(
-				screen_elm, layer_jobj, layer_id, CMD_TYPE_ADD,
-				insert_info_default);
-
-			//3. surfaces(list)
-			json_t *surface_ary_jobj = NULL;
-			parse_surfaces(layer_jobj, &surface_ary_jobj);
-
-			json_t *surface_jobj;
-			json_array_foreach(surface_ary_jobj, surface_idx,
-					   surface_jobj)
-			{
-				int surface_id = 0;
-				parse_id(surface_jobj, &surface_id);
-
-				decide_add_or_update_surface(
-					layer_elm, surface_jobj, surface_id,
-					CMD_TYPE_ADD, insert_info_default);
-			}
+	for (idx = 0; idx < count; idx++) {
+		if (ret == PARSER_RESULT_QUEUED) {
+			results[idx] = PARSER_RESULT_QUEUED;
+		} else if ((ret < 0) && (results[idx] == PARSER_RESULT_OK)) {
+			results[idx] = PARSER_RESULT_NOT_APPLIED;
 		}
-		add_layers_to_screen(screen_elm);
 	}
-	return 0;
 }
 
-static int parse_init_json_config(char *json_cfg_path)
+static int schedule_commands(uint64_t deadline, wm_command_t *cmds,
+			     unsigned int count, int is_batch, uint64_t tag)
 {
-	int target_idx;
-
-	json_error_t jerror;
-	json_t *root_jobj;
-
-	root_jobj = json_load_file(json_cfg_path, 0, &jerror);
-	if (!root_jobj) {
-		fprintf(stderr,
-			"%s(%d) WARNING: %s file. Invalid line %d: %s\n",
-			__func__, __LINE__, json_cfg_path, jerror.line,
-			jerror.text);
+	scheduled_commands_t *entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
 		return -1;
 	}
-
-	if (parse_version(root_jobj) < 0) {
-		/*return -1;*/
+	entry->results = calloc(count, sizeof(*entry->results));
+	if (entry->results == NULL) {
+		free(entry);
+		return -1;
 	}
+	entry->count = count;
+	entry->cmds = cmds;
+	entry->is_batch = is_batch;
+	entry->tag = tag;
 
-	json_t *target_ary_jobj = NULL;
-	parse_target(root_jobj, &target_ary_jobj);
-
-	json_t *target_jobj;
-	json_array_foreach(target_ary_jobj, target_idx, target_jobj)
-	{
-		if (parse_hostname(target_jobj) < 0) {
-			continue;
-		}
-
-		if (parse_all_in_screen(target_jobj) < 0) {
-			return -1;
-		}
+	if (schedule_add(deadline, entry) < 0) {
+		free(entry->results);
+		free(entry);
+		return -1;
 	}
-
-	json_decref(root_jobj);
-
 	return 0;
 }
 
-static void remove_all(void)
+int parser_run_scheduled_commands(void)
 {
-	list_element_t *screen_elm;
-	TAILQ_FOREACH(screen_elm, &screen_head, entry)
-	{
-		while (!TAILQ_EMPTY(&screen_elm->list_head)) {
-			list_element_t *layer_elm =
-				TAILQ_FIRST(&screen_elm->list_head);
-
-			TAILQ_REMOVE(&screen_elm->list_head, layer_elm, entry);
+	void *entries[SCHEDULE_MAX_ENTRIES];
+	uint64_t deadlines[SCHEDULE_MAX_ENTRIES];
+	unsigned int count, i;
 
-			remove_all_surface(layer_elm);
+	count = schedule_pop_due(schedule_now(), entries, deadlines,
+				 SCHEDULE_MAX_ENTRIES);
+	if (count == 0) {
+		return 0;
+	}
 
-			free(layer_elm->prop);
-			free(layer_elm);
+	/* everything due in this tick is committed at once */
+	wrap_ilm_begin_transaction();
+	for (i = 0; i < count; i++) {
+		scheduled_commands_t *entry = entries[i];
+		entry->ret = apply_commands(entry->cmds, entry->count,
+					    entry->results);
+		if (entry->ret < 0) {
+			fprintf(stderr,
+				"%s(%d) ERROR: Scheduled command not applied\n",
+				__func__, __LINE__);
 		}
 	}
+	wrap_ilm_end_transaction();
+
+	uint64_t applied = schedule_now();
+	for (i = 0; i < count; i++) {
+		scheduled_commands_t *entry = entries[i];
+		stats_add_lateness(applied - deadlines[i]);
+
+		/* deferred commands are answered once committed */
+		if (entry->tag && completion_handler) {
+			parser_reply_t reply = { 0 };
+			finish_results(entry->ret, entry->results,
+				       entry->count);
+			if (entry->is_batch) {
+				set_batch_reply(&reply, entry->results,
+						entry->count);
+			}
+			completion_handler(entry->tag, entry->ret, &reply);
+			free(reply.data);
+		}
 
-	while (!TAILQ_EMPTY(&screen_head)) {
-		list_element_t *screen_elm = TAILQ_FIRST(&screen_head);
-
-		TAILQ_REMOVE(&screen_head, screen_elm, entry);
-		free(screen_elm);
+		free_commands(entry->cmds, entry->count);
+		free(entry->results);
+		free(entry);
 	}
 
 	debug_print_all_list();
+
+	return count;
 }
 
-int parser_init(char *json_cfg_path)
+/* json command -> commands of the job, nothing is applied yet */
+static int encode_job(json_t *jobject, parser_job_t *job)
 {
-	init_list(&screen_head);
-	init_list(&surface_properties_head);
-
-	if (json_cfg_path) {
-		parse_init_json_config(json_cfg_path);
+	char cmd_name[32] = { 0 };
+	if (comm_json_parse_command(jobject, cmd_name, sizeof(cmd_name)) < 0) {
+		fprintf(stderr, "%s(%d) ERROR: Not find command property\n",
+			__func__, __LINE__);
+		return -1;
 	}
 
-	if (TAILQ_EMPTY(&screen_head)) {
-		init_default_config();
+	/* templates are only used by the parser, they are defined here */
+	if (strcmp("define_template", cmd_name) == 0) {
+		return comm_template_define(jobject);
 	}
 
-	wrap_ilm_set_notification_callback();
+	if (strcmp("subscribe", cmd_name) == 0) {
+		job->subscribe = comm_event_parse_filter(jobject);
+		return job->subscribe ? 0 : -1;
+	}
 
-	debug_print_all_list();
-}
+	if (strcmp("get_scene", cmd_name) == 0) {
+		job->binary_reply = comm_json_parse_format(jobject);
+		if (job->binary_reply < 0) {
+			return -1;
+		}
+	}
 
-static int parse_add_layer_command(json_t *jobject)
-{
-	int screen_idx, lyr_idx;
+	/* the connection takes the priority, there is nothing to apply */
+	if (strcmp("set_priority", cmd_name) == 0) {
+		job->set_priority = 1;
+		return (job->priority == COMM_PRIORITY_NONE) ? -1 : 0;
+	}
 
-	//only when matches screens id
-	json_t *screen_ary_jobj = NULL;
-	if (parse_screens(jobject, &screen_ary_jobj) < 0) {
+	job->scheduled = comm_json_parse_deadline(jobject, schedule_now(),
+						  &job->deadline);
+	if (job->scheduled < 0) {
 		return -1;
 	}
 
-	json_t *screen_jobj;
-	json_array_foreach(screen_ary_jobj, screen_idx, screen_jobj)
-	{
-		int screen_id = 0;
-		parse_id(screen_jobj, &screen_id);
-
-		insert_info_t insert_info = insert_info_default;
-		parse_insert_info(screen_jobj, &insert_info);
+	int is_batch = (strcmp("batch", cmd_name) == 0);
+	unsigned int count = 1;
+	if (is_batch) {
+		json_t *cmd_ary_jobj = NULL;
+		if (comm_json_parse_commands(jobject, &cmd_ary_jobj) < 0) {
+			return -1;
+		}
+		count = json_array_size(cmd_ary_jobj);
+		if (count == 0) {
+			return 0;
+		}
+	}
 
-		list_element_t *screen_elm =
-			get_list_element(&screen_head, screen_id);
-		if (screen_elm != NULL) {
-			json_t *layer_ary_jobj = NULL;
-			if (parse_layers(screen_jobj, &layer_ary_jobj) < 0) {
-				return -1;
-			}
+	job->cmds = calloc(count, sizeof(*job->cmds));
+	job->results = calloc(count, sizeof(*job->results));
+	if ((job->cmds == NULL) || (job->results == NULL)) {
+		return -1;
+	}
+	job->count = count;
+	job->is_batch = is_batch;
 
-			json_t *layer_jobj;
-			json_array_foreach(layer_ary_jobj, lyr_idx, layer_jobj)
-			{
-				int layer_id = 0;
-				if (parse_id(layer_jobj, &layer_id) < 0) {
-					return -1;
-				}
+	if (is_batch) {
+		return encode_batch_command(jobject, job->cmds, job->results,
+					    count);
+	}
+	return job->results[0] = encode_json_command(jobject, &job->cmds[0]);
+}
 
-				decide_add_or_update_layer(screen_elm,
-							   layer_jobj, layer_id,
-							   CMD_TYPE_ADD,
-							   insert_info);
-			}
+/*
+ * Template commands depend on the templates defined by the messages before
+ * them, they are encoded by parser_finish_job in message order.
+ */
+static int uses_templates(json_t *jobject)
+{
+	const char *name =
+		json_string_value(json_object_get(jobject, "command"));
+	size_t idx;
+	json_t *cmd_jobj;
 
-			add_layers_to_screen(screen_elm);
+	if (name == NULL) {
+		return 0;
+	}
+	if ((strcmp("define_template", name) == 0) ||
+	    (strcmp("invoke_template", name) == 0)) {
+		return 1;
+	}
+	if (strcmp("batch", name) != 0) {
+		return 0;
+	}
+	json_array_foreach(json_object_get(jobject, "commands"), idx, cmd_jobj)
+	{
+		name = json_string_value(json_object_get(cmd_jobj, "command"));
+		if (name && (strcmp("invoke_template", name) == 0)) {
+			return 1;
 		}
 	}
-
 	return 0;
 }
 
-static int parse_remove_layer_command(json_t *jobject)
+static parser_job_t *new_job(void)
 {
-	int layer_idx;
+	parser_job_t *job = calloc(1, sizeof(*job));
+	if (job == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Out of memory\n", __func__,
+			__LINE__);
+		return NULL;
+	}
+	job->received_ns = schedule_now();
+	job->priority = COMM_PRIORITY_NONE;
+	return job;
+}
 
-	json_t *layer_ary_jobj = NULL;
-	if (parse_layers(jobject, &layer_ary_jobj) < 0) {
-		return -1;
+parser_job_t *parser_parse_command(const char *msg, unsigned int size)
+{
+	parser_job_t *job = new_job();
+	if (job == NULL) {
+		return NULL;
 	}
 
-	json_t *layer_jobj;
-	json_array_foreach(layer_ary_jobj, layer_idx, layer_jobj)
-	{
-		int layer_id = 0;
-		if (parse_id(layer_jobj, &layer_id) < 0) {
-			return -1;
-		}
+	/* the body is parsed where it was received, without its terminator */
+	json_t *jobject;
+	json_error_t jerror;
+	jobject = json_loadb(msg, strnlen(msg, size), 0, &jerror);
+	if (!jobject) {
+		fprintf(stderr, "%s(%d) ERROR: Invalid line %d: %s\n", __func__,
+			__LINE__, jerror.line, jerror.text);
+		job->result = PARSER_RESULT_ERROR;
+		job->parsed_ns = schedule_now();
+		return job;
+	}
 
-		remove_layer(layer_id);
+	if (comm_json_parse_version(jobject) < 0) {
+		/*return -1;*/
+	}
 
-		wrap_ilm_remove_layer(layer_id);
+	job->report = comm_json_parse_report(jobject);
+	job->priority = comm_json_parse_priority(jobject);
+	if (job->priority < COMM_PRIORITY_NONE) {
+		job->priority = COMM_PRIORITY_NONE;
+		job->result = PARSER_RESULT_ERROR;
+		json_decref(jobject);
+	} else if (uses_templates(jobject)) {
+		job->pending = jobject;
+	} else {
+		job->result = encode_job(jobject, job);
+		json_decref(jobject);
 	}
+	job->parsed_ns = schedule_now();
 
-	return 0;
+	return job;
 }
 
-static int parse_modify_layer_command(json_t *jobject)
+void parser_finish_job(parser_job_t *job)
 {
-	int layer_idx;
-
-	json_t *layer_ary_jobj = NULL;
-	if (parse_layers(jobject, &layer_ary_jobj) < 0) {
-		return -1;
+	if (job->pending == NULL) {
+		return;
 	}
+	job->result = encode_job(job->pending, job);
+	json_decref(job->pending);
+	job->pending = NULL;
+}
 
-	json_t *layer_jobj;
-	json_array_foreach(layer_ary_jobj, layer_idx, layer_jobj)
-	{
-		int layer_id = 0;
-		if (parse_id(layer_jobj, &layer_id) < 0) {
-			return -1;
-		}
-
-		list_element_t *layer_elm = get_layer(layer_id);
-		if (layer_elm != NULL) {
-			parse_layer_properties(layer_elm->prop, layer_jobj,
-					       CMD_TYPE_MOD);
-			wrap_ilm_set_layer(layer_elm->prop, layer_id);
+parser_job_t *parser_parse_binary_command(const char *msg, unsigned int size)
+{
+	WM_CMD_TYPE type;
+	uint32_t nrecords, i;
+
+	parser_job_t *job = new_job();
+	if (job == NULL) {
+		return NULL;
+	}
+
+	if (comm_binary_parse_header(msg, size, &type, &nrecords) < 0) {
+		job->result = PARSER_RESULT_ERROR;
+		job->parsed_ns = schedule_now();
+		return job;
+	}
+
+	/* the message buffer is reused, the records are copied out of it */
+	job->cmds = calloc(1, sizeof(*job->cmds));
+	if (job->cmds == NULL) {
+		job->result = PARSER_RESULT_ERROR;
+		job->parsed_ns = schedule_now();
+		return job;
+	}
+	job->count = 1;
+	job->cmds[0].type = type;
+	job->binary_reply = (type == WM_CMD_GET_SCENE);
+	if (nrecords > 0) {
+		job->cmds[0].records = malloc(nrecords * sizeof(wm_record_t));
+		if (job->cmds[0].records == NULL) {
+			job->result = PARSER_RESULT_ERROR;
+			job->parsed_ns = schedule_now();
+			return job;
 		}
 	}
+	for (i = 0; i < nrecords; i++) {
+		comm_binary_get_record(msg, i, &job->cmds[0].records[i]);
+	}
+	job->cmds[0].nrecords = job->cmds[0].capacity = nrecords;
+	job->parsed_ns = schedule_now();
 
-	return 0;
+	return job;
 }
 
-static int parse_add_surface_command(json_t *jobject)
+parser_job_t *parser_parse_records(const wm_record_t *recs, unsigned int count)
 {
-	int screen_idx, lyr_idx, surface_idx;
-	json_t *screen_ary_jobj = NULL;
-	if (parse_screens(jobject, &screen_ary_jobj) < 0) {
-		return -1;
+	parser_job_t *job = new_job();
+	if (job == NULL) {
+		return NULL;
 	}
 
-	json_t *screen_jobj;
-	json_array_foreach(screen_ary_jobj, screen_idx, screen_jobj)
-	{
-		insert_info_t insert_info = insert_info_default;
-		parse_insert_info(screen_jobj, &insert_info);
+	job->records = malloc(count * sizeof(*recs));
+	if (job->records == NULL) {
+		parser_free_job(job);
+		return NULL;
+	}
+	memcpy(job->records, recs, count * sizeof(*recs));
+	job->nrecords = count;
+	job->parsed_ns = schedule_now();
 
-		json_t *layer_ary_jobj = NULL;
-		if (parse_layers(screen_jobj, &layer_ary_jobj) < 0) {
-			return -1;
+	return job;
+}
+
+/* records are applied as modify_layer and modify_surface, in one commit */
+static int apply_records(const wm_record_t *recs, unsigned int count)
+{
+	apply_state_t state;
+	unsigned int i, skipped = 0;
+
+	scene_t *draft = scene_begin(current_scene);
+	if (draft == NULL) {
+		return PARSER_RESULT_ERROR;
+	}
+
+	wrap_ilm_begin_transaction();
+	for (i = 0; i < count; i++) {
+		apply_begin(&state,
+			    (recs[i].kind == WM_RECORD_LAYER) ?
+				    WM_CMD_MODIFY_LAYER :
+				    WM_CMD_MODIFY_SURFACE,
+			    draft);
+		if (apply_record(&state, &recs[i]) < 0) {
+			skipped++;
 		}
+	}
+	finish_draft(draft, 0);
+	wrap_ilm_end_transaction();
 
-		json_t *layer_jobj;
-		json_array_foreach(layer_ary_jobj, lyr_idx, layer_jobj)
-		{
-			int layer_id = 0;
-			parse_id(layer_jobj, &layer_id);
-
-			list_element_t *layer_elm = get_layer(layer_id);
-			if (layer_elm != NULL) {
-				json_t *surface_ary_jobj = NULL;
-				if (parse_surfaces(layer_jobj,
-						   &surface_ary_jobj) < 0) {
-					return -1;
-				}
+	if (skipped > 0) {
+		fprintf(stderr, "%s(%d) WARNING: %u records skipped\n",
+			__func__, __LINE__, skipped);
+	}
 
-				json_t *surface_jobj;
-				json_array_foreach(surface_ary_jobj,
-						   surface_idx, surface_jobj)
-				{
-					int surface_id = 0;
-					if (parse_id(surface_jobj,
-						     &surface_id) < 0) {
-						return -1;
-					}
-
-					decide_add_or_update_surface(
-						layer_elm, surface_jobj,
-						surface_id, CMD_TYPE_ADD,
-						insert_info);
-				}
-				add_exists_surfaces_to_layer(layer_elm);
+	return PARSER_RESULT_OK;
+}
+
+int parser_apply_job(parser_job_t *job, parser_reply_t *reply)
+{
+	report_t rep = { 0 };
+
+	if (job->records) {
+		return apply_records(job->records, job->nrecords);
+	}
+	if (parser_job_is_query(job)) {
+		return parser_run_query(job, reply);
+	}
+
+	/* the filter goes to the connection */
+	reply->subscribe = job->subscribe;
+	job->subscribe = NULL;
+
+	if (job->report) {
+		rep.objects = json_array();
+		rep.start_ns = job->received_ns;
+		rep.parsed_ns = job->parsed_ns;
+		report = &rep;
+	}
+	report_started();
+
+	/* everything a message changes is committed at once */
+	wrap_ilm_begin_transaction();
+	int ret = job->result;
+	if ((ret == 0) && (job->count > 0)) {
+		if (job->scheduled) {
+			ret = schedule_commands(job->deadline, job->cmds,
+						job->count, job->is_batch,
+						reply->tag);
+			if (ret == 0) {
+				/* the schedule owns the commands now */
+				job->cmds = NULL;
+				ret = reply->tag ? PARSER_RESULT_DEFERRED :
+						   PARSER_RESULT_QUEUED;
 			}
+		} else {
+			ret = apply_commands(job->cmds, job->count,
+					     job->results);
 		}
 	}
 
-	return 0;
+	if (job->results) {
+		finish_results(ret, job->results, job->count);
+	}
+	if (job->is_batch && (ret != PARSER_RESULT_DEFERRED)) {
+		set_batch_reply(reply, job->results, job->count);
+	}
+	wrap_ilm_end_transaction();
+
+	if (report) {
+		report = NULL;
+		report_finish(&rep, ret, reply);
+	}
+
+	debug_print_all_list();
+
+	return ret;
 }
 
-static int parse_remove_surface_command(json_t *jobject)
+int parser_job_is_query(const parser_job_t *job)
 {
-	int lyr_idx, surface_idx;
+	return (job->result == 0) && (job->count == 1) && !job->is_batch &&
+	       (job->cmds[0].type == WM_CMD_GET_SCENE);
+}
 
-	json_t *layer_ary_jobj = NULL;
-	if (parse_layers(jobject, &layer_ary_jobj) < 0) {
-		return -1;
-	}
+int parser_run_query(const parser_job_t *job, parser_reply_t *reply)
+{
+	const snapshot_t *snapshot = snapshot_read_lock();
+	int ret = snapshot ? comm_query_scene(snapshot, &job->cmds[0],
+					      job->binary_reply, reply) :
+			     PARSER_RESULT_ERROR;
+	snapshot_read_unlock();
 
-	json_t *layer_jobj;
-	json_array_foreach(layer_ary_jobj, lyr_idx, layer_jobj)
-	{
-		int layer_id = 0;
-		if (parse_id(layer_jobj, &layer_id) < 0) {
-			return -1;
-		}
+	return ret;
+}
 
-		list_element_t *layer_elm = get_layer(layer_id);
-		if (layer_elm != NULL) {
-			json_t *surface_ary_jobj = NULL;
-			if (parse_surfaces(layer_jobj, &surface_ary_jobj) < 0) {
-				return -1;
-			}
+int parser_job_is_modify(const parser_job_t *job)
+{
+	return (job->result == 0) && (job->records == NULL) &&
+	       (job->count == 1) && !job->is_batch && !job->scheduled &&
+	       !job->report && !job->set_priority && (job->subscribe == NULL) &&
+	       ((job->cmds[0].type == WM_CMD_MODIFY_LAYER) ||
+		(job->cmds[0].type == WM_CMD_MODIFY_SURFACE));
+}
 
-			json_t *surface_jobj;
-			json_array_foreach(surface_ary_jobj, surface_idx,
-					   surface_jobj)
-			{
-				int surface_id = 0;
-				if (parse_id(surface_jobj, &surface_id) < 0) {
-					return -1;
-				}
+/* whether the command would be applied on its own */
+static int modify_applies(const wm_command_t *cmd)
+{
+	uint32_t i;
 
-				remove_surface(layer_elm, surface_id);
+	for (i = 0; i < cmd->nrecords; i++) {
+		const wm_record_t *rec = &cmd->records[i];
 
-				/* set ivi config */
-				wrap_ilm_remove_surface(layer_elm->id,
-							surface_id);
+		if (cmd->type == WM_CMD_MODIFY_LAYER) {
+			if (rec->kind != WM_RECORD_LAYER) {
+				return 0;
 			}
+		} else if ((rec->kind != WM_RECORD_SURFACE) ||
+			   !scene_get_surface(current_scene, rec->id)) {
+			return 0;
 		}
 	}
 
-	return 0;
+	return 1;
 }
 
-static int parse_modify_surface_command(json_t *jobject)
+int parser_apply_merged(parser_job_t **jobs, unsigned int count, int *results)
 {
-	json_t *surface_ary_jobj = NULL;
-	if (parse_surfaces(jobject, &surface_ary_jobj) < 0) {
-		return -1;
-	}
+	unsigned int i, n = 0, total = 0;
+	wm_record_t *recs;
+	int ret;
 
-	int surface_idx;
-	json_t *surface_jobj;
-	json_array_foreach(surface_ary_jobj, surface_idx, surface_jobj)
-	{
-		int surface_id = 0;
-		if (parse_id(surface_jobj, &surface_id) < 0) {
-			return -1;
-		}
-
-		list_element_t *surface_properties_elm;
-		surface_properties_elm =
-			get_list_element(&surface_properties_head, surface_id);
-		if (surface_properties_elm == NULL) {
-			return -1;
+	for (i = 0; i < count; i++) {
+		total += jobs[i]->cmds[0].nrecords;
+	}
+	recs = malloc((total ? total : 1) * sizeof(*recs));
+	if (recs == NULL) {
+		for (i = 0; i < count; i++) {
+			results[i] = PARSER_RESULT_ERROR;
 		}
-
-		parse_surface_properties(surface_properties_elm->prop,
-					 surface_jobj, CMD_TYPE_MOD);
-
-		/*set ivi config */
-		wrap_ilm_set_surface(surface_properties_elm->prop, surface_id);
+		return PARSER_RESULT_ERROR;
 	}
 
-	return 0;
-}
-
-static int parse_init_screen_command(json_t *jobject)
-{
-	json_error_t jerror;
-	json_t *root_jobj;
+	/* a modify command never changes which objects exist */
+	for (i = 0; i < count; i++) {
+		const wm_command_t *cmd = &jobs[i]->cmds[0];
 
-	//0. version
-	if (parse_version(jobject) < 0) {
-		/*return -1;*/
+		results[i] = modify_applies(cmd) ? 0 : -1;
+		if (results[i] == 0) {
+			memcpy(&recs[n], cmd->records,
+			       cmd->nrecords * sizeof(*recs));
+			n += cmd->nrecords;
+		}
 	}
+	total = n;
+	n = shm_ring_coalesce(recs, n);
+	stats_add_merge(count, total, n);
 
-	remove_all();
+	ret = apply_records(recs, n);
+	free(recs);
 
-	if (parse_all_in_screen(jobject) < 0) {
-		return -1;
+	for (i = 0; i < count; i++) {
+		if (results[i] < 0) {
+			continue;
+		}
+		results[i] = ret;
+		if (ret == 0) {
+			comm_event_publish(
+				EVENT_COMMAND_APPLIED, 0,
+				comm_json_command_name(jobs[i]->cmds[0].type),
+				0);
+		}
 	}
 
-	wrap_ilm_set_notification_callback();
+	debug_print_all_list();
 
-	return 0;
+	return ret;
 }
 
-int parser_parse_recv_command(char *msg)
+void parser_free_job(parser_job_t *job)
 {
-	/* str to json */
-	json_t *jobject;
-	json_error_t jerror;
-	jobject = json_loads(msg, 0, &jerror);
-
-	if (parse_version(jobject) < 0) {
-		/*return -1;*/
+	if (job == NULL) {
+		return;
 	}
-
-	char cmd_name[16] = { 0 };
-	if (parse_command(jobject, cmd_name) < 0) {
-		fprintf(stderr, "%s(%d) ERROR: Not find command property\n",
-			__func__, __LINE__);
-	} else {
-		if (strcmp("add_surface", cmd_name) == 0) {
-			parse_add_surface_command(jobject);
-		} else if (strcmp("remove_surface", cmd_name) == 0) {
-			parse_remove_surface_command(jobject);
-		} else if (strcmp("modify_surface", cmd_name) == 0) {
-			parse_modify_surface_command(jobject);
-		} else if (strcmp("add_layer", cmd_name) == 0) {
-			parse_add_layer_command(jobject);
-		} else if (strcmp("remove_layer", cmd_name) == 0) {
-			parse_remove_layer_command(jobject);
-		} else if (strcmp("modify_layer", cmd_name) == 0) {
-			parse_modify_layer_command(jobject);
-		} else if (strcmp("initial_screen", cmd_name) == 0) {
-			parse_init_screen_command(jobject);
-		} else {
-			fprintf(stderr,
-				"%s(%d) ERROR: Illegal command name %s\n",
-				__func__, __LINE__, cmd_name);
-		}
+	if (job->cmds) {
+		free_commands(job->cmds, job->count);
 	}
-
-	json_decref(jobject);
-	debug_print_all_list();
-
-	return 0;
+	free(job->results);
+	free(job->records);
+	comm_event_free_filter(job->subscribe);
+	json_decref(job->pending);
+	free(job);
 }
@@ -18,7 +18,11 @@
 #ifndef __COMM_PARSER_H__
 #define __COMM_PARSER_H__
 
-#include <sys/queue.h>
+#include <stdint.h>
+#include <jansson.h>
+
+#include "comm_binary.h"
+#include "comm_event.h"
 
 typedef struct _common_properties {
 	t_ilm_uint src_x, src_y, src_w, src_h;
@@ -37,24 +41,116 @@ typedef struct _surface_properties {
 	layout_properties_t lp;
 } surface_properties_t;
 
-TAILQ_HEAD(list_head, _list_element);
-typedef struct _list_element {
-	unsigned int id;
+/* command results */
+#define PARSER_RESULT_OK 0
+#define PARSER_RESULT_ERROR -1
+#define PARSER_RESULT_NOT_APPLIED 1
+#define PARSER_RESULT_QUEUED 2
+#define PARSER_RESULT_DEFERRED 3 /* answered by the completion handler */
+#define PARSER_RESULT_BUSY 4 /* over the quota of the client, not applied */
+
+/* data sent back after the result, allocated by the parser */
+typedef struct _parser_reply {
+	char *data;
+	unsigned int size;
 
-	/* Each properties */
-	void *prop;
+	/*
+	 * set by the caller to answer a scheduled command once it is applied
+	 * instead of right away, 0 for PARSER_RESULT_QUEUED
+	 */
+	uint64_t tag;
 
-	/* Lower layer object list */
-	struct list_head list_head;
+	/* set by subscribe, the connection then only carries events */
+	event_filter_t *subscribe;
+} parser_reply_t;
 
-	/* Linked list entry */
-	TAILQ_ENTRY(_list_element) entry;
-} list_element_t;
+/* gets the result of a deferred command, with the tag it was sent with */
+typedef void (*parser_completion_t)(uint64_t tag, int result,
+				    const parser_reply_t *reply);
+void parser_set_completion_handler(parser_completion_t handler);
 
 int parser_init(char *json_cfg_path);
-int parser_parse_recv_command(char *msg);
+
+/*
+ * A message is handled in two steps: it is parsed into a job on the thread
+ * that received it, and the job is applied on the thread that owns the
+ * scene and the ilm connection, see pipeline.h. Parsing may run on any
+ * thread, but template commands are only encoded by parser_finish_job,
+ * which is called for every job in message order on one thread.
+ */
+typedef struct _parser_job {
+	/* result of parsing, the commands are applied only when it is 0 */
+	int result;
+
+	unsigned int count;
+	wm_command_t *cmds;
+	int *results;
+	int is_batch;
+
+	/* commands waiting in the schedule until the deadline */
+	int scheduled;
+	uint64_t deadline;
+
+	/* records of a ring */
+	wm_record_t *records;
+	unsigned int nrecords;
+
+	/* the sender asked for a report */
+	int report;
+
+	/* get_scene is answered in the binary encoding */
+	int binary_reply;
+
+	/* class of the message, or of the connection with set_priority */
+	int priority;
+	int set_priority;
+	uint64_t received_ns, parsed_ns;
+
+	event_filter_t *subscribe;
+
+	/* message waiting for parser_finish_job */
+	json_t *pending;
+} parser_job_t;
+
+/* NULL when out of memory, a message that does not parse is a failed job */
+parser_job_t *parser_parse_command(const char *msg, unsigned int size);
+parser_job_t *parser_parse_binary_command(const char *msg, unsigned int size);
+void parser_finish_job(parser_job_t *job);
+
+/*
+ * layer and surface records are applied as modify_layer and modify_surface,
+ * all in one commit; records of unknown objects are skipped
+ */
+parser_job_t *parser_parse_records(const wm_record_t *recs,
+				   unsigned int count);
+
+/* applies the job, reply->tag is set by the caller as for a command */
+int parser_apply_job(parser_job_t *job, parser_reply_t *reply);
+void parser_free_job(parser_job_t *job);
+
+/*
+ * Pending modify_layer and modify_surface commands are merged into one
+ * commit, the last value of every field winning. Each command gets the
+ * result it would have had on its own in results.
+ */
+int parser_job_is_modify(const parser_job_t *job);
+
+/*
+ * get_scene only reads the published snapshot, so it may be answered on
+ * any thread once the commands sent before it are applied
+ */
+int parser_job_is_query(const parser_job_t *job);
+int parser_run_query(const parser_job_t *job, parser_reply_t *reply);
+int parser_apply_merged(parser_job_t **jobs, unsigned int count, int *results);
+
+/* applies the scheduled commands that are due, see schedule.h */
+int parser_run_scheduled_commands(void);
 
 int parser_add_ivi_surface_by_event_notification(t_ilm_uint surface_id);
+
+/* the compositor created or destroyed a surface, see get_scene */
+void parser_surface_created(t_ilm_uint surface_id);
+void parser_surface_destroyed(t_ilm_uint surface_id);
 int parser_check_registered_surface_in_list_tree(t_ilm_uint surface_id);
 
 #endif //__COMM_PARSER_H__
@@ -0,0 +1,696 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "comm_query.h"
+
+/* reply text, after room for the u32 length */
+typedef struct _query_buf {
+	char *data;
+	size_t len;
+	size_t size;
+	int failed;
+} query_buf_t;
+
+static void buf_printf(query_buf_t *buf, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (buf->failed) {
+		return;
+	}
+	while (1) {
+		va_start(ap, fmt);
+		n = vsnprintf(&buf->data[buf->len], buf->size - buf->len, fmt,
+			      ap);
+		va_end(ap);
+		if ((n >= 0) && ((size_t)n < buf->size - buf->len)) {
+			buf->len += n;
+			return;
+		}
+
+		char *data = realloc(buf->data, buf->size * 2);
+		if ((n < 0) || (data == NULL)) {
+			buf->failed = 1;
+			return;
+		}
+		buf->data = data;
+		buf->size *= 2;
+	}
+}
+
+static int selected(const wm_command_t *filter, WM_RECORD_KIND kind,
+		    t_ilm_uint id)
+{
+	uint32_t i;
+	int filtered = 0;
+
+	for (i = 0; i < filter->nrecords; i++) {
+		if (filter->records[i].kind != kind) {
+			continue;
+		}
+		if (filter->records[i].id == id) {
+			return 1;
+		}
+		filtered = 1;
+	}
+
+	return !filtered;
+}
+
+static int has_filter(const wm_command_t *filter, WM_RECORD_KIND kind)
+{
+	uint32_t i;
+
+	for (i = 0; i < filter->nrecords; i++) {
+		if (filter->records[i].kind == kind) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static unsigned int selected_surfaces(const snapshot_t *snapshot,
+				      const snapshot_layer_t *layer,
+				      const wm_command_t *filter)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < layer->nsurfaces; i++) {
+		n += selected(filter, WM_RECORD_SURFACE,
+			      snapshot->surface_ids[layer->first_surface + i]);
+	}
+
+	return n;
+}
+
+/* a layer is left out when none of its surfaces passes the filter */
+static int layer_selected(const snapshot_t *snapshot,
+			  const snapshot_layer_t *layer,
+			  const wm_command_t *filter)
+{
+	return selected(filter, WM_RECORD_LAYER, layer->id) &&
+	       (!has_filter(filter, WM_RECORD_SURFACE) ||
+		(selected_surfaces(snapshot, layer, filter) > 0));
+}
+
+static int screen_selected(const snapshot_t *snapshot,
+			   const snapshot_screen_t *screen,
+			   const wm_command_t *filter)
+{
+	unsigned int i;
+
+	if (!selected(filter, WM_RECORD_SCREEN, screen->id)) {
+		return 0;
+	}
+	if (!has_filter(filter, WM_RECORD_LAYER) &&
+	    !has_filter(filter, WM_RECORD_SURFACE)) {
+		return 1;
+	}
+	for (i = 0; i < screen->nlayers; i++) {
+		if (layer_selected(snapshot,
+				   &snapshot->layers[screen->first_layer + i],
+				   filter)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* the fields that differ from old, all of them without old */
+static void json_layout_diff(query_buf_t *buf, const layout_properties_t *old,
+			     const layout_properties_t *lp)
+{
+	static const struct {
+		const char *key;
+		size_t offset;
+	} fields[] = {
+		{ "src_x", offsetof(layout_properties_t, src_x) },
+		{ "src_y", offsetof(layout_properties_t, src_y) },
+		{ "src_w", offsetof(layout_properties_t, src_w) },
+		{ "src_h", offsetof(layout_properties_t, src_h) },
+		{ "dst_x", offsetof(layout_properties_t, dst_x) },
+		{ "dst_y", offsetof(layout_properties_t, dst_y) },
+		{ "dst_w", offsetof(layout_properties_t, dst_w) },
+		{ "dst_h", offsetof(layout_properties_t, dst_h) },
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+		t_ilm_uint v = *(const t_ilm_uint *)((const char *)lp +
+						     fields[i].offset);
+		if (old && (*(const t_ilm_uint *)((const char *)old +
+						  fields[i].offset) == v)) {
+			continue;
+		}
+		buf_printf(buf, ",\"%s\":%u", fields[i].key, v);
+	}
+	if (!old || (old->opacity != lp->opacity)) {
+		buf_printf(buf, ",\"opacity\":%g", (double)lp->opacity);
+	}
+	if (!old || (!old->visibility != !lp->visibility)) {
+		buf_printf(buf, ",\"visibility\":%d", lp->visibility ? 1 : 0);
+	}
+}
+
+static void json_layout(query_buf_t *buf, const layout_properties_t *lp)
+{
+	json_layout_diff(buf, NULL, lp);
+}
+
+static void json_layer(query_buf_t *buf, const snapshot_t *snapshot,
+		       const snapshot_layer_t *layer,
+		       const wm_command_t *filter)
+{
+	unsigned int i;
+	const char *sep = "";
+
+	buf_printf(buf, "{\"id\":%u,\"width\":%u,\"height\":%u", layer->id,
+		   layer->prop.width, layer->prop.height);
+	json_layout(buf, &layer->prop.lp);
+	buf_printf(buf, ",\"surfaces\":[");
+	for (i = 0; i < layer->nsurfaces; i++) {
+		t_ilm_uint id = snapshot->surface_ids[layer->first_surface + i];
+		if (!selected(filter, WM_RECORD_SURFACE, id)) {
+			continue;
+		}
+
+		/* a surface of a layer may not have properties yet */
+		const snapshot_surface_t *surface =
+			snapshot_get_surface(snapshot, id);
+		buf_printf(buf, "%s{\"id\":%u,\"alive\":%s", sep, id,
+			   snapshot_surface_alive(snapshot, id) ? "true" :
+								  "false");
+		if (surface) {
+			json_layout(buf, &surface->prop.lp);
+		}
+		buf_printf(buf, "}");
+		sep = ",";
+	}
+	buf_printf(buf, "]}");
+}
+
+static void json_screens(query_buf_t *buf, const snapshot_t *snapshot,
+			 const wm_command_t *filter)
+{
+	unsigned int i, j;
+	const char *screen_sep = "";
+
+	buf_printf(buf, "\"screens\":[");
+	for (i = 0; i < snapshot->nscreens; i++) {
+		const snapshot_screen_t *screen = &snapshot->screens[i];
+		const char *layer_sep = "";
+
+		if (!screen_selected(snapshot, screen, filter)) {
+			continue;
+		}
+		buf_printf(buf, "%s{\"id\":%u,\"layers\":[", screen_sep,
+			   screen->id);
+		for (j = 0; j < screen->nlayers; j++) {
+			const snapshot_layer_t *layer =
+				&snapshot->layers[screen->first_layer + j];
+			if (!layer_selected(snapshot, layer, filter)) {
+				continue;
+			}
+			buf_printf(buf, "%s", layer_sep);
+			json_layer(buf, snapshot, layer, filter);
+			layer_sep = ",";
+		}
+		buf_printf(buf, "]}");
+		screen_sep = ",";
+	}
+	buf_printf(buf, "]");
+}
+
+static int query_json(const snapshot_t *snapshot, const wm_command_t *filter,
+		      parser_reply_t *reply)
+{
+	query_buf_t buf = { malloc(4096), sizeof(uint32_t), 4096, 0 };
+
+	if (buf.data == NULL) {
+		return -1;
+	}
+
+	buf_printf(&buf, "{\"version\":%lu,", snapshot->version);
+	json_screens(&buf, snapshot, filter);
+	buf_printf(&buf, "}");
+	if (buf.failed) {
+		free(buf.data);
+		return -1;
+	}
+
+	uint32_t len_n = htonl(buf.len - sizeof(len_n));
+	memcpy(buf.data, &len_n, sizeof(len_n));
+	reply->data = buf.data;
+	reply->size = buf.len;
+
+	return 0;
+}
+
+static void set_layout_fields(wm_record_t *rec, const layout_properties_t *lp)
+{
+	rec->src_x = lp->src_x;
+	rec->src_y = lp->src_y;
+	rec->src_w = lp->src_w;
+	rec->src_h = lp->src_h;
+	rec->dst_x = lp->dst_x;
+	rec->dst_y = lp->dst_y;
+	rec->dst_w = lp->dst_w;
+	rec->dst_h = lp->dst_h;
+	rec->opacity = lp->opacity;
+	rec->visibility = lp->visibility;
+	rec->fields |= WM_FIELD_LAYOUT_ALL;
+}
+
+/* the tree as records, in the nesting order of initial_screen */
+static int query_records(const snapshot_t *snapshot, const wm_command_t *filter,
+			 wm_command_t *cmd)
+{
+	unsigned int i, j, k;
+	wm_record_t *rec;
+
+	for (i = 0; i < snapshot->nscreens; i++) {
+		const snapshot_screen_t *screen = &snapshot->screens[i];
+		if (!screen_selected(snapshot, screen, filter)) {
+			continue;
+		}
+		if (comm_binary_add_record(cmd, WM_RECORD_SCREEN, screen->id) ==
+		    NULL) {
+			return -1;
+		}
+
+		for (j = 0; j < screen->nlayers; j++) {
+			const snapshot_layer_t *layer =
+				&snapshot->layers[screen->first_layer + j];
+			if (!layer_selected(snapshot, layer, filter)) {
+				continue;
+			}
+			rec = comm_binary_add_record(cmd, WM_RECORD_LAYER,
+						     layer->id);
+			if (rec == NULL) {
+				return -1;
+			}
+			rec->width = layer->prop.width;
+			rec->height = layer->prop.height;
+			rec->fields = WM_FIELD_WIDTH | WM_FIELD_HEIGHT;
+			set_layout_fields(rec, &layer->prop.lp);
+
+			for (k = 0; k < layer->nsurfaces; k++) {
+				t_ilm_uint id = snapshot->surface_ids
+							[layer->first_surface + k];
+				if (!selected(filter, WM_RECORD_SURFACE, id)) {
+					continue;
+				}
+				rec = comm_binary_add_record(
+					cmd, WM_RECORD_SURFACE, id);
+				if (rec == NULL) {
+					return -1;
+				}
+				const snapshot_surface_t *surface =
+					snapshot_get_surface(snapshot, id);
+				if (surface) {
+					set_layout_fields(rec,
+							  &surface->prop.lp);
+				}
+				if (snapshot_surface_alive(snapshot, id)) {
+					rec->fields |= WM_FIELD_ALIVE;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int query_binary(const snapshot_t *snapshot, const wm_command_t *filter,
+			parser_reply_t *reply)
+{
+	wm_command_t cmd = { WM_CMD_GET_SCENE, 0, 0, NULL };
+	uint32_t len_n;
+
+	if (query_records(snapshot, filter, &cmd) < 0) {
+		comm_binary_free_command(&cmd);
+		return -1;
+	}
+
+	size_t size = comm_binary_encoded_size(&cmd);
+	reply->data = malloc(sizeof(len_n) + size);
+	if (reply->data == NULL) {
+		comm_binary_free_command(&cmd);
+		return -1;
+	}
+	len_n = htonl(size);
+	memcpy(reply->data, &len_n, sizeof(len_n));
+	comm_binary_encode(&cmd, &reply->data[sizeof(len_n)]);
+	reply->size = sizeof(len_n) + size;
+	comm_binary_free_command(&cmd);
+
+	return 0;
+}
+
+int comm_query_scene(const snapshot_t *snapshot, const wm_command_t *filter,
+		     int binary, parser_reply_t *reply)
+{
+	int ret = binary ? query_binary(snapshot, filter, reply) :
+			   query_json(snapshot, filter, reply);
+	if (ret < 0) {
+		fprintf(stderr, "%s(%d) ERROR: Cannot encode scene %lu\n",
+			__func__, __LINE__, snapshot->version);
+	}
+
+	return ret;
+}
+
+int comm_query_sync(const snapshot_t *snapshot, char **text,
+		    unsigned int *len)
+{
+	static const wm_command_t all = { WM_CMD_GET_SCENE, 0, 0, NULL };
+	query_buf_t buf = { malloc(4096), 0, 4096, 0 };
+
+	if (buf.data == NULL) {
+		return -1;
+	}
+
+	buf_printf(&buf, "{\"event\":\"scene_sync\",\"seq\":%llu,",
+		   (unsigned long long)snapshot->seq);
+	json_screens(&buf, snapshot, &all);
+	buf_printf(&buf, "}");
+	if (buf.failed) {
+		free(buf.data);
+		return -1;
+	}
+
+	*text = buf.data;
+	*len = buf.len;
+	return 0;
+}
+
+/* layers of a snapshot by id */
+static int compare_layers(const void *a, const void *b)
+{
+	const snapshot_layer_t *la = *(const snapshot_layer_t *const *)a;
+	const snapshot_layer_t *lb = *(const snapshot_layer_t *const *)b;
+
+	return (la->id > lb->id) - (la->id < lb->id);
+}
+
+static const snapshot_layer_t **sorted_layers(const snapshot_t *snapshot)
+{
+	unsigned int i;
+	const snapshot_layer_t **layers =
+		malloc((snapshot->nlayers + 1) * sizeof(*layers));
+
+	if (layers == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < snapshot->nlayers; i++) {
+		layers[i] = &snapshot->layers[i];
+	}
+	qsort(layers, snapshot->nlayers, sizeof(*layers), compare_layers);
+
+	return layers;
+}
+
+static const snapshot_screen_t *find_screen(const snapshot_t *snapshot,
+					    t_ilm_uint id)
+{
+	unsigned int i;
+
+	for (i = 0; i < snapshot->nscreens; i++) {
+		if (snapshot->screens[i].id == id) {
+			return &snapshot->screens[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int same_ids(const t_ilm_uint *a, unsigned int na, const t_ilm_uint *b,
+		    unsigned int nb)
+{
+	return (na == nb) && (memcmp(a, b, na * sizeof(*a)) == 0);
+}
+
+static int same_layer_order(const snapshot_t *old,
+			    const snapshot_screen_t *old_screen,
+			    const snapshot_t *snapshot,
+			    const snapshot_screen_t *screen)
+{
+	unsigned int i;
+
+	if (old_screen->nlayers != screen->nlayers) {
+		return 0;
+	}
+	for (i = 0; i < screen->nlayers; i++) {
+		if (old->layers[old_screen->first_layer + i].id !=
+		    snapshot->layers[screen->first_layer + i].id) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* opens the list key on its first entry */
+static void json_entry(query_buf_t *buf, const char *key, int *count)
+{
+	buf_printf(buf, (*count)++ ? "," : ",\"%s\":[", key);
+}
+
+static void json_close(query_buf_t *buf, int count)
+{
+	if (count) {
+		buf_printf(buf, "]");
+	}
+}
+
+static void delta_screens(query_buf_t *buf, const snapshot_t *old,
+			  const snapshot_t *snapshot)
+{
+	unsigned int i, j;
+	int count = 0;
+
+	for (i = 0; i < snapshot->nscreens; i++) {
+		const snapshot_screen_t *screen = &snapshot->screens[i];
+		const snapshot_screen_t *old_screen =
+			find_screen(old, screen->id);
+		if (old_screen &&
+		    same_layer_order(old, old_screen, snapshot, screen)) {
+			continue;
+		}
+		json_entry(buf, "screens", &count);
+		buf_printf(buf, "{\"id\":%u,\"layers\":[", screen->id);
+		for (j = 0; j < screen->nlayers; j++) {
+			buf_printf(buf, j ? ",%u" : "%u",
+				   snapshot->layers[screen->first_layer + j].id);
+		}
+		buf_printf(buf, "]}");
+	}
+	json_close(buf, count);
+
+	count = 0;
+	for (i = 0; i < old->nscreens; i++) {
+		if (find_screen(snapshot, old->screens[i].id) == NULL) {
+			json_entry(buf, "removed_screens", &count);
+			buf_printf(buf, "%u", old->screens[i].id);
+		}
+	}
+	json_close(buf, count);
+}
+
+/* a changed or new layer, old is NULL for a new one */
+static void delta_layer(query_buf_t *buf, const snapshot_t *old_snapshot,
+			const snapshot_layer_t *old,
+			const snapshot_t *snapshot,
+			const snapshot_layer_t *layer, int *count)
+{
+	const t_ilm_uint *ids = &snapshot->surface_ids[layer->first_surface];
+	int order = !old ||
+		    !same_ids(&old_snapshot->surface_ids[old->first_surface],
+			      old->nsurfaces, ids, layer->nsurfaces);
+	unsigned int i;
+
+	if (old && !order && (old->prop.width == layer->prop.width) &&
+	    (old->prop.height == layer->prop.height) &&
+	    (memcmp(&old->prop.lp, &layer->prop.lp, sizeof(layer->prop.lp)) ==
+	     0)) {
+		return;
+	}
+
+	json_entry(buf, "layers", count);
+	buf_printf(buf, "{\"id\":%u", layer->id);
+	if (!old || (old->prop.width != layer->prop.width)) {
+		buf_printf(buf, ",\"width\":%u", layer->prop.width);
+	}
+	if (!old || (old->prop.height != layer->prop.height)) {
+		buf_printf(buf, ",\"height\":%u", layer->prop.height);
+	}
+	json_layout_diff(buf, old ? &old->prop.lp : NULL, &layer->prop.lp);
+	if (order) {
+		buf_printf(buf, ",\"surfaces\":[");
+		for (i = 0; i < layer->nsurfaces; i++) {
+			buf_printf(buf, i ? ",%u" : "%u", ids[i]);
+		}
+		buf_printf(buf, "]");
+	}
+	buf_printf(buf, "}");
+}
+
+static int delta_layers(query_buf_t *buf, const snapshot_t *old,
+			const snapshot_t *snapshot)
+{
+	const snapshot_layer_t **old_layers = sorted_layers(old);
+	const snapshot_layer_t **layers = sorted_layers(snapshot);
+	unsigned int i = 0, j = 0;
+	int count = 0, removed = 0;
+
+	if ((old_layers == NULL) || (layers == NULL)) {
+		free(old_layers);
+		free(layers);
+		return -1;
+	}
+
+	/* merge of the two id orders */
+	while (j < snapshot->nlayers) {
+		if ((i < old->nlayers) && (old_layers[i]->id < layers[j]->id)) {
+			i++;
+		} else if ((i < old->nlayers) &&
+			   (old_layers[i]->id == layers[j]->id)) {
+			delta_layer(buf, old, old_layers[i++], snapshot,
+				    layers[j++], &count);
+		} else {
+			delta_layer(buf, old, NULL, snapshot, layers[j++],
+				    &count);
+		}
+	}
+	json_close(buf, count);
+
+	for (i = 0, j = 0; i < old->nlayers; i++) {
+		while ((j < snapshot->nlayers) &&
+		       (layers[j]->id < old_layers[i]->id)) {
+			j++;
+		}
+		if ((j == snapshot->nlayers) ||
+		    (layers[j]->id != old_layers[i]->id)) {
+			json_entry(buf, "removed_layers", &removed);
+			buf_printf(buf, "%u", old_layers[i]->id);
+		}
+	}
+	json_close(buf, removed);
+
+	free(old_layers);
+	free(layers);
+	return 0;
+}
+
+/* a changed or new surface, old is NULL for a new one */
+static void delta_surface(query_buf_t *buf, const snapshot_t *old_snapshot,
+			  const snapshot_surface_t *old,
+			  const snapshot_t *snapshot,
+			  const snapshot_surface_t *surface, int *count)
+{
+	int alive = snapshot_surface_alive(snapshot, surface->id);
+	int alive_changed =
+		!old || (alive != snapshot_surface_alive(old_snapshot, old->id));
+
+	if (!alive_changed && (memcmp(&old->prop.lp, &surface->prop.lp,
+				      sizeof(surface->prop.lp)) == 0)) {
+		return;
+	}
+
+	json_entry(buf, "surfaces", count);
+	buf_printf(buf, "{\"id\":%u", surface->id);
+	if (alive_changed) {
+		buf_printf(buf, ",\"alive\":%s", alive ? "true" : "false");
+	}
+	json_layout_diff(buf, old ? &old->prop.lp : NULL, &surface->prop.lp);
+	buf_printf(buf, "}");
+}
+
+/* both surface tables are sorted by id */
+static void delta_surfaces(query_buf_t *buf, const snapshot_t *old,
+			   const snapshot_t *snapshot)
+{
+	unsigned int i = 0, j;
+	int count = 0;
+
+	for (j = 0; j < snapshot->nsurfaces; j++) {
+		const snapshot_surface_t *surface = &snapshot->surfaces[j];
+		while ((i < old->nsurfaces) &&
+		       (old->surfaces[i].id < surface->id)) {
+			i++;
+		}
+		delta_surface(buf, old,
+			      ((i < old->nsurfaces) &&
+			       (old->surfaces[i].id == surface->id)) ?
+				      &old->surfaces[i] :
+				      NULL,
+			      snapshot, surface, &count);
+	}
+	json_close(buf, count);
+
+	count = 0;
+	for (i = 0, j = 0; i < old->nsurfaces; i++) {
+		while ((j < snapshot->nsurfaces) &&
+		       (snapshot->surfaces[j].id < old->surfaces[i].id)) {
+			j++;
+		}
+		if ((j == snapshot->nsurfaces) ||
+		    (snapshot->surfaces[j].id != old->surfaces[i].id)) {
+			json_entry(buf, "removed_surfaces", &count);
+			buf_printf(buf, "%u", old->surfaces[i].id);
+		}
+	}
+	json_close(buf, count);
+}
+
+int comm_query_delta(const snapshot_t *old, const snapshot_t *snapshot,
+		     char **text, unsigned int *len)
+{
+	query_buf_t buf = { malloc(4096), 0, 4096, 0 };
+
+	if (buf.data == NULL) {
+		return -1;
+	}
+
+	buf_printf(&buf, "{\"event\":\"scene_delta\",\"seq\":%llu,\"base\":%llu",
+		   (unsigned long long)snapshot->seq,
+		   (unsigned long long)old->seq);
+	delta_screens(&buf, old, snapshot);
+	if (delta_layers(&buf, old, snapshot) < 0) {
+		buf.failed = 1;
+	}
+	delta_surfaces(&buf, old, snapshot);
+	buf_printf(&buf, "}");
+	if (buf.failed) {
+		free(buf.data);
+		return -1;
+	}
+
+	*text = buf.data;
+	*len = buf.len;
+	return 0;
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __COMM_QUERY_H__
+#define __COMM_QUERY_H__
+
+#include "snapshot.h"
+#include "comm_parser.h"
+
+/*
+ * get_scene: the screens, layers and surfaces of a snapshot with all their
+ * properties, and whether each surface exists in the compositor.
+ *
+ * The records of filter select screens, layers and surfaces by id, a kind
+ * without records is not filtered. The reply is a u32 length followed by a
+ * json text or, when binary is set, by a binary body of the get_scene
+ * command carrying the tree in record order (see comm_binary.h), where
+ * WM_FIELD_ALIVE marks the live surfaces. Runs on any thread.
+ */
+int comm_query_scene(const snapshot_t *snapshot, const wm_command_t *filter,
+		     int binary, parser_reply_t *reply);
+
+/*
+ * scene_delta event text: what changed from old to snapshot, seq is the
+ * sequence number of snapshot and base the one of old.
+ *
+ * "screens" holds the added screens and those whose layers were
+ * reordered, with their layer ids in render order. "layers" holds the
+ * added layers with all fields and the changed ones with the changed
+ * fields, plus their surface ids when the surfaces were reordered.
+ * "surfaces" holds the surfaces with changed properties or existence.
+ * "removed_screens", "removed_layers" and "removed_surfaces" list ids.
+ * Lists without entries are left out. The caller frees text.
+ */
+int comm_query_delta(const snapshot_t *old, const snapshot_t *snapshot,
+		     char **text, unsigned int *len);
+
+/*
+ * scene_sync event text: the whole tree of snapshot as get_scene answers
+ * it, sent instead of the deltas a subscriber could not take.
+ */
+int comm_query_sync(const snapshot_t *snapshot, char **text,
+		    unsigned int *len);
+
+#endif //__COMM_QUERY_H__
@@ -15,32 +15,61 @@
  * limitations under the License.                                                                                                                                                                                         
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <errno.h>
 
+#include "comm_receiver.h"
+
 #define UHMI_IVI_WM_SOCK "/tmp/uhmi-ivi-wm_sock"
+#define UHMI_IVI_WM_SEQPACKET_SOCK "/tmp/uhmi-ivi-wm_seqpacket"
 const char MAGIC_CODE[4] = { 0x55, 0x4C, 0x41, 0x30 };
-
-int create_server_socket(void)
+const char MAGIC_CODE_BINARY[4] = { 0x55, 0x4C, 0x42, 0x30 };
+const char MAGIC_CODE_V1[4] = { 0x55, 0x4C, 0x41, 0x31 };
+const char MAGIC_CODE_BINARY_V1[4] = { 0x55, 0x4C, 0x42, 0x31 };
+const char MAGIC_CODE_V2[4] = { 0x55, 0x4C, 0x41, 0x32 };
+const char MAGIC_CODE_BINARY_V2[4] = { 0x55, 0x4C, 0x42, 0x32 };
+const char MAGIC_CODE_RING[4] = { 0x55, 0x4C, 0x52, 0x31 };
+
+/* encoding and protocol version of each magic code */
+static const struct {
+	const char *magic;
+	int encoding;
+	int protocol;
+} magic_table[] = {
+	{ MAGIC_CODE, COMM_ENCODING_JSON, COMM_PROTOCOL_V0 },
+	{ MAGIC_CODE_BINARY, COMM_ENCODING_BINARY, COMM_PROTOCOL_V0 },
+	{ MAGIC_CODE_V1, COMM_ENCODING_JSON, COMM_PROTOCOL_V1 },
+	{ MAGIC_CODE_BINARY_V1, COMM_ENCODING_BINARY, COMM_PROTOCOL_V1 },
+	{ MAGIC_CODE_V2, COMM_ENCODING_JSON, COMM_PROTOCOL_V2 },
+	{ MAGIC_CODE_BINARY_V2, COMM_ENCODING_BINARY, COMM_PROTOCOL_V2 },
+	{ MAGIC_CODE_RING, COMM_ENCODING_RING, COMM_PROTOCOL_V1 },
+};
+
+static int create_listen_socket(int type, const char *path)
 {
 	struct sockaddr_un un;
 	int sock_fd, ret;
 
-	sock_fd = socket(PF_UNIX, SOCK_STREAM, 0);
+	sock_fd = socket(PF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
 	if (sock_fd < 0) {
 		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
 		return -1;
 	}
 
-	unlink(UHMI_IVI_WM_SOCK);
+	unlink(path);
 
 	memset(&un, 0, sizeof(un));
 	un.sun_family = AF_UNIX;
-	strcpy(un.sun_path, UHMI_IVI_WM_SOCK);
+	strcpy(un.sun_path, path);
 
 	ret = bind(sock_fd, (struct sockaddr *)&un, sizeof(un));
 	if (ret < 0) {
@@ -49,7 +78,7 @@ int create_server_socket(void)
 		return -1;
 	}
 
-	ret = listen(sock_fd, 3);
+	ret = listen(sock_fd, SOMAXCONN);
 	if (ret < 0) {
 		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
 		close(sock_fd);
@@ -59,13 +88,24 @@ int create_server_socket(void)
 	return sock_fd;
 }
 
+int create_server_socket(void)
+{
+	return create_listen_socket(SOCK_STREAM, UHMI_IVI_WM_SOCK);
+}
+
+int create_server_seqpacket_socket(void)
+{
+	return create_listen_socket(SOCK_SEQPACKET, UHMI_IVI_WM_SEQPACKET_SOCK);
+}
+
 int connect_to_client(int socket)
 {
 	struct sockaddr_un conn_addr = { 0 };
 	socklen_t conn_addr_len = sizeof(conn_addr);
 	int fd;
 
-	fd = accept(socket, (struct sockaddr *)&conn_addr, &conn_addr_len);
+	fd = accept4(socket, (struct sockaddr *)&conn_addr, &conn_addr_len,
+		     SOCK_NONBLOCK | SOCK_CLOEXEC);
 	if (fd < 0) {
 		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
 		return -1;
@@ -74,127 +114,262 @@ int connect_to_client(int socket)
 	return fd;
 }
 
-int acquire_body_size_from_client(int fd)
+int comm_lookup_magiccode(const char *magic, int *encoding, int *protocol)
 {
-	char size_str[4];
-	unsigned int size = 0;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(magic_table) / sizeof(magic_table[0]); i++) {
+		if (memcmp(magic, magic_table[i].magic, 4) == 0) {
+			*encoding = magic_table[i].encoding;
+			*protocol = magic_table[i].protocol;
+			return 0;
+		}
+	}
 
-	/* rcv header */
-	if (recv(fd, size_str, sizeof(size_str), 0) < 0) {
+	fprintf(stderr, "magic code error :%.4s \n", magic);
+	return -1;
+}
+
+static int connect_socket(int type, const char *path)
+{
+	struct sockaddr_un un;
+	int sock_fd, ret;
+
+	sock_fd = socket(PF_UNIX, type, 0);
+	if (sock_fd < 0) {
+		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+		return -1;
+	}
+
+	memset(&un, 0, sizeof(un));
+	un.sun_family = AF_UNIX;
+	strcpy(un.sun_path, path);
+
+	ret = connect(sock_fd, (struct sockaddr *)&un, sizeof(un));
+	if (ret < 0) {
 		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+		close(sock_fd);
 		return -1;
 	}
-	size = *(unsigned int *)&size_str;
-	size = ntohl(size);
 
-	return size;
+	return sock_fd;
 }
 
-int acquire_body_from_client(int fd, char **msg, unsigned int size)
+int connect_to_server(void)
 {
-	char *data = *msg;
-	/* rcv body */
-	unsigned int bytes_read = 0;
-	unsigned int len = 0;
-	while (bytes_read < size) {
-		len = recv(fd, &data[bytes_read], size - bytes_read, 0);
-		if (len < 0) {
-			fprintf(stderr, "ERR: %s(%d) : %s\n", __FILE__,
-				__LINE__, strerror(errno));
-			return -1;
-		}
-		bytes_read += len;
+	return connect_socket(SOCK_STREAM, UHMI_IVI_WM_SOCK);
+}
+
+int connect_to_server_seqpacket(void)
+{
+	return connect_socket(SOCK_SEQPACKET, UHMI_IVI_WM_SEQPACKET_SOCK);
+}
+
+int send_body_size_to_server(int fd, unsigned int size)
+{
+	unsigned int size_n = htonl(size);
+
+	if (send(fd, &size_n, sizeof(size_n), 0) == -1) {
+		perror("send");
+		return -1;
 	}
 
 	return 0;
 }
 
-int send_str_response_to_client(int fd, char *res, int size)
+int send_data_to_server(int fd, void *buf, int size)
 {
-	/* send response */
-	if (send(fd, res, size, 0) < 0) {
-		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+	if (send(fd, buf, size, 0) <= 0) {
+		fprintf(stderr, "ERR: %s(%d) : %s\n", __FILE__, __LINE__,
+			strerror(errno));
 		return -1;
 	}
 
 	return 0;
 }
 
-int exchange_magiccode_with_client(int fd)
+/* v1 request: u32 length, body */
+int send_frame_to_server(int fd, const void *body, unsigned int size)
 {
-	char magic_str[4];
+	uint32_t size_n = htonl(size);
+	struct iovec iov[2];
+	struct msghdr msg;
 
-	/* rcv magiccode */
-	if (recv(fd, magic_str, sizeof(magic_str), 0) < 0) {
-		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+	iov[0].iov_base = &size_n;
+	iov[0].iov_len = sizeof(size_n);
+	iov[1].iov_base = (void *)body;
+	iov[1].iov_len = size;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+		fprintf(stderr, "ERR: %s(%d) : %s\n", __FILE__, __LINE__,
+			strerror(errno));
 		return -1;
 	}
-	if (strncmp(magic_str, MAGIC_CODE, sizeof(magic_str)) != 0) {
-		fprintf(stderr, "magic code error :%s \n", magic_str);
+
+	return 0;
+}
+
+/* sends data with file descriptors attached to its first byte */
+int send_fds_to_server(int fd, const void *buf, int size, const int *fds,
+		       int nfds)
+{
+	char control[CMSG_SPACE(sizeof(int) * COMM_MAX_FDS)];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	if (nfds > COMM_MAX_FDS) {
+		return -1;
+	}
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = size;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+		fprintf(stderr, "ERR: %s(%d) : %s\n", __FILE__, __LINE__,
+			strerror(errno));
 		return -1;
 	}
 
-	/* return magic code*/
-	send_str_response_to_client(fd, magic_str, sizeof(magic_str));
 	return 0;
 }
 
-int send_response_to_client(int fd, int res)
+/* v2 request: u32 length, u32 request id, body */
+int send_request_to_server(int fd, uint32_t request_id, const void *body,
+			   unsigned int size)
 {
-	/* send response */
-	res = htonl(res);
-	if (send(fd, &res, sizeof(res), 0) < 0) {
-		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+	uint32_t header[2] = { htonl(sizeof(header[1]) + size),
+			       htonl(request_id) };
+	struct iovec iov[2];
+	struct msghdr msg;
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = (void *)body;
+	iov[1].iov_len = size;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+		fprintf(stderr, "ERR: %s(%d) : %s\n", __FILE__, __LINE__,
+			strerror(errno));
 		return -1;
 	}
 
 	return 0;
 }
 
-int connect_to_server(void)
+/* reads a v2 response up to its payload, which the caller reads next */
+int recv_reply_from_server(int fd, uint32_t *request_id, int *res,
+			   unsigned int *payload_size)
 {
-	struct sockaddr_un un;
-	int sock_fd, ret;
+	uint32_t header[3];
 
-	sock_fd = socket(PF_UNIX, SOCK_STREAM, 0);
-	if (sock_fd < 0) {
-		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+	if (recv_data_from_server(fd, header, sizeof(header)) < 0) {
 		return -1;
 	}
 
-	memset(&un, 0, sizeof(un));
-	un.sun_family = AF_UNIX;
-	strcpy(un.sun_path, UHMI_IVI_WM_SOCK);
-
-	ret = connect(sock_fd, (struct sockaddr *)&un, sizeof(un));
-	if (ret < 0) {
+	uint32_t len = ntohl(header[0]);
+	if (len < sizeof(header[1]) + sizeof(header[2])) {
 		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
-		close(sock_fd);
 		return -1;
 	}
+	*request_id = ntohl(header[1]);
+	*res = (int32_t)ntohl(header[2]);
+	*payload_size = len - sizeof(header[1]) - sizeof(header[2]);
 
-	return sock_fd;
+	return 0;
 }
 
-int send_body_size_to_server(int fd, unsigned int size)
+/* seqpacket request: magic code and body in one datagram */
+int send_packet_to_server(int fd, const char *magic, const void *body,
+			  unsigned int size)
 {
-	unsigned int size_n = htonl(size);
+	struct iovec iov[2];
+	struct msghdr msg;
 
-	if (send(fd, &size_n, sizeof(size_n), 0) == -1) {
-		perror("send");
+	iov[0].iov_base = (void *)magic;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = (void *)body;
+	iov[1].iov_len = size;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0) {
+		fprintf(stderr, "ERR: %s(%d) : %s\n", __FILE__, __LINE__,
+			strerror(errno));
 		return -1;
 	}
 
 	return 0;
 }
 
-int send_data_to_server(int fd, void *buf, int size)
+/*
+ * seqpacket response: s32 result and data in one datagram, the data is
+ * copied to buf and its size returned
+ */
+int recv_packet_from_server(int fd, int *res, void *buf, unsigned int size)
 {
-	if (send(fd, buf, size, 0) <= 0) {
-		fprintf(stderr, "ERR: %s(%d) : %s\n", __FILE__, __LINE__,
-			strerror(errno));
+	int32_t res_n;
+	struct iovec iov[2];
+	struct msghdr msg;
+
+	iov[0].iov_base = &res_n;
+	iov[0].iov_len = sizeof(res_n);
+	iov[1].iov_base = buf;
+	iov[1].iov_len = size;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	ssize_t len = recvmsg(fd, &msg, 0);
+	if ((len < (ssize_t)sizeof(res_n)) || (msg.msg_flags & MSG_TRUNC)) {
+		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+		return -1;
+	}
+	*res = (int32_t)ntohl(res_n);
+
+	return len - sizeof(res_n);
+}
+
+/* reads a v1 response up to its payload, which the caller reads next */
+int recv_frame_from_server(int fd, int *res, unsigned int *payload_size)
+{
+	uint32_t header[2];
+
+	if (recv_data_from_server(fd, header, sizeof(header)) < 0) {
+		return -1;
+	}
+
+	uint32_t len = ntohl(header[0]);
+	if (len < sizeof(header[1])) {
+		fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
 		return -1;
 	}
+	*res = (int32_t)ntohl(header[1]);
+	*payload_size = len - sizeof(header[1]);
 
 	return 0;
 }
@@ -209,7 +384,23 @@ int recv_response_from_server(int fd)
 		return -1;
 	}
 
-	return res;
+	return ntohl(res);
+}
+
+int recv_data_from_server(int fd, void *buf, unsigned int size)
+{
+	unsigned int bytes_read = 0;
+	while (bytes_read < size) {
+		ssize_t len = recv(fd, (char *)buf + bytes_read,
+				   size - bytes_read, 0);
+		if (len <= 0) {
+			fprintf(stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+			return -1;
+		}
+		bytes_read += len;
+	}
+
+	return 0;
 }
 
 void recv_str_response_from_server(int fd, char *res)
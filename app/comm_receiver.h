@@ -18,20 +18,58 @@
 #ifndef __COMM_RECEIVER_H__
 #define __COMM_RECEIVER_H__
 
+#include <stdint.h>
+
+/* body encoding selected by the magic code */
+#define COMM_ENCODING_JSON 0
+#define COMM_ENCODING_BINARY 1
+#define COMM_ENCODING_RING 2 /* memfd and eventfd of a shm_ring follow */
+
+/*
+ * protocol selected by the magic code: v0 carries one command after each
+ * magic code, v1 keeps the connection and carries length-prefixed frames,
+ * v2 frames start with a request id that the response echoes
+ */
+#define COMM_PROTOCOL_V0 0
+#define COMM_PROTOCOL_V1 1
+#define COMM_PROTOCOL_V2 2
+
+extern const char MAGIC_CODE[4];
+extern const char MAGIC_CODE_BINARY[4];
+extern const char MAGIC_CODE_V1[4];
+extern const char MAGIC_CODE_BINARY_V1[4];
+extern const char MAGIC_CODE_V2[4];
+extern const char MAGIC_CODE_BINARY_V2[4];
+extern const char MAGIC_CODE_RING[4];
+
+/* file descriptors passed along a message */
+#define COMM_MAX_FDS 2
+
 int create_server_socket();
+int create_server_seqpacket_socket(void);
 int connect_to_client(int socket);
 
-int exchange_magiccode_with_client(int fd);
-int acquire_body_size_from_client(int fd);
-int acquire_body_from_client(int fd, char **msg, unsigned int size);
-
-int send_response_to_client(int fd, int res);
+/* encoding and protocol of a 4-byte magic code */
+int comm_lookup_magiccode(const char *magic, int *encoding, int *protocol);
 
 int connect_to_server(void);
+int connect_to_server_seqpacket(void);
 int send_data_to_server(int fd, void *buf, int size);
 int send_body_size_to_server(int fd, unsigned int size);
+int send_frame_to_server(int fd, const void *body, unsigned int size);
+int send_packet_to_server(int fd, const char *magic, const void *body,
+			  unsigned int size);
+int send_request_to_server(int fd, uint32_t request_id, const void *body,
+			   unsigned int size);
+int send_fds_to_server(int fd, const void *buf, int size, const int *fds,
+		       int nfds);
 
 int recv_response_from_server(int fd);
+int recv_frame_from_server(int fd, int *res, unsigned int *payload_size);
+int recv_reply_from_server(int fd, uint32_t *request_id, int *res,
+			   unsigned int *payload_size);
+int recv_packet_from_server(int fd, int *res, void *buf, unsigned int size);
+int recv_data_from_server(int fd, void *buf, unsigned int size);
 void recv_str_response_from_server(int fd, char *res);
 
 #endif //__COMM_RECEIVER_H__
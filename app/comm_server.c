@@ -0,0 +1,1742 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/queue.h>
+#include <sys/timerfd.h>
+#include <ilm/ilm_control.h>
+
+#include "comm_server.h"
+#include "comm_decoder.h"
+#include "comm_event.h"
+#include "comm_receiver.h"
+#include "comm_parser.h"
+#include "comm_query.h"
+#include "event_loop.h"
+#include "ilm_control_wrapper.h"
+#include "parse_pool.h"
+#include "pipeline.h"
+#include "schedule.h"
+#include "shm_ring.h"
+#include "snapshot.h"
+#include "stats.h"
+
+/*
+ * Every client connection has its own state and is served by the event
+ * loop of the I/O thread. Sockets are non-blocking: one read per readiness
+ * event is fed to the connection's decoder, so clients with pending data
+ * take turns and a partial message never blocks the loop. Each complete
+ * message is parsed into a job by the parse pool, and the jobs, back in the
+ * order of their messages, are handed to the apply thread, the one running
+ * the main loop, through the pipeline. Neither thread waits for the other:
+ * the I/O thread reads and parses the next messages while the apply
+ * thread talks to the compositor.
+ *
+ * Every message has a priority class, its own "priority" or the one of
+ * its connection, set with set_priority (interactive by default). The
+ * apply thread serves the classes from separate queues, most urgent first,
+ * see pipeline.h, and merges the modify commands queued in a class into
+ * one commit. Within a class, jobs are applied in the order the loop reads
+ * them. Only v2 responses may overtake each other: on other connections a
+ * message waits behind the ones in flight, so the responses keep the
+ * order of the messages.
+ *
+ * A v1 connection does the magic code handshake once and then carries any
+ * number of frames, which may be pipelined. v2 frames also carry a request
+ * id echoed in their response, so a scheduled command is answered once it
+ * is applied, after the commands that follow it.
+ *
+ * A seqpacket connection carries one message per datagram, a magic code
+ * followed by the body, and gets one datagram with the result back. The
+ * kernel keeps the boundaries, so a message is a single receive into one
+ * buffer shared by these connections and needs no decoder.
+ *
+ * A ring connection hands over the memfd of a shm_ring and an eventfd with
+ * its magic code. Its records are then read from the ring each time the
+ * eventfd is written, and the connection only keeps the ring alive. The
+ * records count against the limits of the connection like its messages;
+ * while it is held back the eventfd is not read, and the records that
+ * pile up meanwhile are coalesced once it is resumed.
+ *
+ * A subscribe command turns a connection into an event stream: after its
+ * response, the client gets one frame (u32 length and json text) or one
+ * datagram per event that passes its filter, and sends nothing more.
+ * Events are queued without waiting for the socket; once a subscriber
+ * has COMM_MAX_EVENT_OUTPUT bytes queued, further events are dropped and
+ * counted in an events_dropped event sent when there is room again.
+ *
+ * A subscriber of scene_delta gets a scene_sync with the whole scene
+ * first and then deltas, each based on the one before. The apply thread
+ * only tells the sequence number it published; the I/O thread holds the
+ * snapshot the feed is at and makes one delta from it to the current one,
+ * covering the snapshots published meanwhile.
+ * It never gets a backlog of deltas: when a delta finds no room or does
+ * not follow the last one sent, the feed goes stale and the deltas are
+ * skipped until the queued output is written, when a new scene_sync
+ * takes their place.
+ *
+ * No connection can keep the apply thread to itself: one with
+ * COMM_MAX_QUEUED_MESSAGES unanswered messages, or COMM_MAX_QUEUED_INPUT
+ * bytes of them, is no longer read until they are answered. One over its
+ * quotas (see comm_quota_t), each kept in a token bucket, is not read
+ * either and the kernel buffers its messages meanwhile, or they are
+ * rejected.
+ */
+struct _client;
+
+/* token bucket, filled at the rate of its quota up to one second's worth */
+typedef struct _bucket {
+	int64_t tokens;
+	uint64_t refilled_ns;
+} bucket_t;
+
+typedef struct _ring {
+	/* eventfd of the client, first member */
+	event_source_t source;
+	shm_ring_t *shm;
+	struct _client *client;
+	uint32_t events;
+} ring_t;
+
+typedef struct _client {
+	/* first member, handed back by the event loop */
+	event_source_t source;
+
+	unsigned int id;
+	comm_decoder_t decoder;
+
+	/* responses the socket did not take yet */
+	char *out;
+	unsigned int out_len;
+	unsigned int out_size;
+
+	/* events registered to the loop */
+	uint32_t events;
+
+	/* responses are datagrams, each queued after its size */
+	int seqpacket;
+
+	/* descriptors received from the client, until a ring takes them */
+	int fds[COMM_MAX_FDS];
+	unsigned int nfds;
+	ring_t *ring;
+
+	/* responses queued since the last flush */
+	int answered;
+
+	/* class of the connection, and of the messages in flight (not v2) */
+	int priority;
+	unsigned int inflight;
+	int inflight_priority;
+
+	/* messages on the apply thread, of any protocol */
+	unsigned int applying;
+
+	/* messages not answered yet and their bytes, and the quotas */
+	unsigned int queued;
+	unsigned int queued_input;
+	bucket_t commands;
+	bucket_t ilm_calls;
+	int throttled;
+
+	/* printed by comm_server_print_clients */
+	uint64_t messages;
+	uint64_t ilm_total;
+	unsigned int deferrals;
+	unsigned int rejected;
+	unsigned int stalls;
+
+	/*
+	 * subscribing is set once subscribe is parsed, filter once it is
+	 * answered, with the events dropped since the last one
+	 */
+	int subscribing;
+	event_filter_t *filter;
+	unsigned int dropped;
+
+	/* scene_delta feed, the seq of the last delta or sync queued */
+	int scene_feed;
+	int scene_stale;
+	uint64_t scene_seq;
+
+	TAILQ_ENTRY(_client) entry;
+} client_t;
+
+TAILQ_HEAD(client_head, _client);
+static struct client_head clients = TAILQ_HEAD_INITIALIZER(clients);
+static unsigned int nclients;
+static unsigned int max_clients;
+/* from 1, the client id is part of the tag of deferred commands */
+static unsigned int next_client_id = 1;
+
+static event_source_t listen_source = { -1, NULL };
+static event_source_t seqpacket_listen_source = { -1, NULL };
+static int listening;
+
+/* receive buffer of the seqpacket connections */
+#define COMM_PACKET_SIZE (4 + COMM_MAX_FRAME_SIZE)
+static char *packet_buf;
+static unsigned int max_message = COMM_MAX_FRAME_SIZE;
+
+/* pipeline items of the I/O thread, see get_item */
+static TAILQ_HEAD(, _pipeline_item) spare_items =
+	TAILQ_HEAD_INITIALIZER(spare_items);
+static unsigned int nspare_items;
+
+/* most modify commands applied in one commit */
+#define COMM_MAX_MERGE 64
+
+/* checks for timed out partial messages while clients are connected */
+static event_source_t sweep_source = { -1, NULL };
+
+/* quotas, and the timer resuming the clients over them */
+static comm_quota_t quota;
+static event_source_t throttle_source = { -1, NULL };
+static uint64_t throttle_deadline;
+
+#define NS_PER_SEC 1000000000ULL
+
+/* parsed jobs, results for the I/O thread, and jobs for the apply thread */
+static event_source_t parse_source = { -1, NULL };
+static event_source_t io_source = { -1, NULL };
+static event_source_t apply_source = { -1, NULL };
+
+/* read by the apply thread, which only posts events when there are any */
+static int nsubscribers;
+static int nscene_subscribers;
+
+/* on the I/O thread, the snapshot the scene_delta feed is at, held */
+static const snapshot_t *scene_base;
+
+/* over the limit, new connections wait in the listen backlog */
+static void set_listening(int on)
+{
+	if (on == listening) {
+		return;
+	}
+
+	if (on) {
+		if ((event_loop_add(&listen_source, EPOLLIN) < 0) ||
+		    (event_loop_add(&seqpacket_listen_source, EPOLLIN) < 0)) {
+			event_loop_remove(&listen_source);
+			return;
+		}
+	} else {
+		event_loop_remove(&listen_source);
+		event_loop_remove(&seqpacket_listen_source);
+	}
+	listening = on;
+}
+
+static void set_sweep(int on)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (on) {
+		its.it_value.tv_sec = 1;
+		its.it_interval.tv_sec = 1;
+	}
+	timerfd_settime(sweep_source.fd, 0, &its, NULL);
+}
+
+static void close_fds(client_t *client)
+{
+	unsigned int i;
+
+	for (i = 0; i < client->nfds; i++) {
+		close(client->fds[i]);
+	}
+	client->nfds = 0;
+}
+
+static void release_ring(ring_t *ring)
+{
+	event_loop_remove(&ring->source);
+	close(ring->source.fd);
+	shm_ring_unmap(ring->shm);
+	free(ring);
+}
+
+static void close_client(client_t *client)
+{
+	event_loop_remove(&client->source);
+	close(client->source.fd);
+
+	TAILQ_REMOVE(&clients, client, entry);
+	nclients--;
+	comm_decoder_release(&client->decoder);
+	close_fds(client);
+	if (client->ring) {
+		release_ring(client->ring);
+	}
+	if (client->subscribing) {
+		__atomic_fetch_sub(&nsubscribers, 1, __ATOMIC_RELAXED);
+	}
+	if (client->scene_feed) {
+		__atomic_fetch_sub(&nscene_subscribers, 1, __ATOMIC_RELAXED);
+	}
+	comm_event_free_filter(client->filter);
+	free(client->out);
+	free(client);
+
+	set_listening(1);
+	if (nclients == 0) {
+		set_sweep(0);
+	}
+}
+
+static int input_full(const client_t *client)
+{
+	return (client->queued >= COMM_MAX_QUEUED_MESSAGES) ||
+	       (client->queued_input >= COMM_MAX_QUEUED_INPUT);
+}
+
+static void update_events(client_t *client)
+{
+	uint32_t events = 0;
+
+	/* a client that does not read its responses is not read either */
+	if ((client->out_len < COMM_MAX_PENDING_OUTPUT) && !input_full(client) &&
+	    !client->throttled) {
+		events |= EPOLLIN;
+	}
+	if (client->out_len > 0) {
+		events |= EPOLLOUT;
+	}
+
+	if ((events != client->events) &&
+	    (event_loop_modify(&client->source, events) == 0)) {
+		if ((client->events & EPOLLIN) && !(events & EPOLLIN) &&
+		    input_full(client)) {
+			client->stalls++;
+		}
+		client->events = events;
+	}
+
+	/* a held back ring is left unread, its records wait in the ring */
+	ring_t *ring = client->ring;
+	if (ring == NULL) {
+		return;
+	}
+	events = (!input_full(client) && !client->throttled) ? EPOLLIN : 0;
+	if ((events != ring->events) &&
+	    (event_loop_modify(&ring->source, events) == 0)) {
+		ring->events = events;
+	}
+}
+
+/* tokens left once the bucket is refilled at rate per second */
+static int64_t bucket_refill(bucket_t *bucket, unsigned int rate,
+			     uint64_t now)
+{
+	uint64_t elapsed = now - bucket->refilled_ns;
+	uint64_t full_ns =
+		(uint64_t)(rate - bucket->tokens) * NS_PER_SEC / rate;
+
+	if (elapsed >= full_ns) {
+		bucket->tokens = rate;
+		bucket->refilled_ns = now;
+		return bucket->tokens;
+	}
+
+	/* the time of a partial token is kept for the next refill */
+	uint64_t added = elapsed * rate / NS_PER_SEC;
+	bucket->tokens += added;
+	bucket->refilled_ns += added * NS_PER_SEC / rate;
+	return bucket->tokens;
+}
+
+/*
+ * time the empty bucket has 10 ms worth of tokens again, so that the
+ * commands a throttled client sent meanwhile are read, and merged, at once
+ */
+static uint64_t bucket_ready(const bucket_t *bucket, unsigned int rate)
+{
+	uint64_t need = 1 + rate / 100 - bucket->tokens;
+
+	return bucket->refilled_ns + (need * NS_PER_SEC + rate - 1) / rate;
+}
+
+/* 0 under the quotas, else the time the client is back under them */
+static uint64_t quota_exceeded(client_t *client, uint64_t now)
+{
+	uint64_t ready = 0;
+
+	if (quota.commands &&
+	    (bucket_refill(&client->commands, quota.commands, now) <= 0)) {
+		ready = bucket_ready(&client->commands, quota.commands);
+	}
+	if (quota.ilm_calls &&
+	    (bucket_refill(&client->ilm_calls, quota.ilm_calls, now) <= 0)) {
+		uint64_t t = bucket_ready(&client->ilm_calls, quota.ilm_calls);
+		if (t > ready) {
+			ready = t;
+		}
+	}
+
+	return ready;
+}
+
+static void arm_throttle(uint64_t deadline)
+{
+	struct itimerspec its;
+
+	if (throttle_deadline && (throttle_deadline <= deadline)) {
+		return;
+	}
+	throttle_deadline = deadline;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / NS_PER_SEC;
+	its.it_value.tv_nsec = deadline % NS_PER_SEC;
+	timerfd_settime(throttle_source.fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* over its quotas, the client is not read until the timer resumes it */
+static int hold_client(client_t *client, uint64_t now)
+{
+	uint64_t ready = quota_exceeded(client, now);
+	if (ready == 0) {
+		return 0;
+	}
+	if (!client->throttled) {
+		client->throttled = 1;
+		client->deferrals++;
+		update_events(client);
+	}
+	arm_throttle(ready);
+	return 1;
+}
+
+/* held back only when its messages cannot be rejected instead */
+static int throttle_client(client_t *client, uint64_t now)
+{
+	if (quota.reject) {
+		return 0;
+	}
+	return hold_client(client, now);
+}
+
+static int queue_output(client_t *client, const void *data, unsigned int len)
+{
+	if (client->out_len + len > client->out_size) {
+		unsigned int size = client->out_size ? client->out_size : 256;
+		while (size < client->out_len + len) {
+			size *= 2;
+		}
+		char *out = realloc(client->out, size);
+		if (out == NULL) {
+			return -1;
+		}
+		stats_count_buffer_alloc();
+		client->out = out;
+		client->out_size = size;
+	}
+
+	memcpy(&client->out[client->out_len], data, len);
+	client->out_len += len;
+	return 0;
+}
+
+static int flush_packets(client_t *client)
+{
+	unsigned int offset = 0;
+	uint32_t size;
+	int ret = 0;
+
+	while (offset < client->out_len) {
+		memcpy(&size, &client->out[offset], sizeof(size));
+		ssize_t len = send(client->source.fd,
+				   &client->out[offset + sizeof(size)], size,
+				   MSG_NOSIGNAL);
+		stats_count_socket_call();
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				ret = -1;
+			}
+			break;
+		}
+		offset += sizeof(size) + size;
+	}
+
+	memmove(client->out, &client->out[offset], client->out_len - offset);
+	client->out_len -= offset;
+
+	update_events(client);
+	return ret;
+}
+
+static int send_output(client_t *client)
+{
+	if (client->seqpacket) {
+		return flush_packets(client);
+	}
+
+	while (client->out_len > 0) {
+		ssize_t len = send(client->source.fd, client->out,
+				   client->out_len, MSG_NOSIGNAL);
+		stats_count_socket_call();
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				break;
+			}
+			return -1;
+		}
+		memmove(client->out, &client->out[len], client->out_len - len);
+		client->out_len -= len;
+	}
+
+	update_events(client);
+	return 0;
+}
+
+/* a frame (u32 length) or a datagram (size in host order) of text */
+static int queue_frame(client_t *client, const char *text, unsigned int len)
+{
+	uint32_t size = client->seqpacket ? len : htonl(len);
+
+	if ((queue_output(client, &size, sizeof(size)) < 0) ||
+	    (queue_output(client, text, len) < 0)) {
+		return -1;
+	}
+	return 0;
+}
+
+/* an event stream has no room for more than the pending bytes */
+static int queue_event(client_t *client, const char *text, unsigned int len)
+{
+	if (client->out_len + sizeof(uint32_t) + len > COMM_MAX_EVENT_OUTPUT) {
+		return -1;
+	}
+	return queue_frame(client, text, len);
+}
+
+/* a delta only follows the one before, anything else waits for a sync */
+static void publish_delta(client_t *client, const comm_event_t *event)
+{
+	if (client->scene_stale || (event->seq <= client->scene_seq)) {
+		return;
+	}
+	if ((event->base != client->scene_seq) ||
+	    (queue_event(client, event->text, event->len) < 0)) {
+		client->scene_stale = 1;
+		return;
+	}
+	client->scene_seq = event->seq;
+}
+
+/* queued only, the loop writes them when the sockets take them */
+static void publish_event(const comm_event_t *event)
+{
+	char text[256];
+	client_t *client;
+	int len = 0;
+
+	if (event->type != EVENT_SCENE_DELTA) {
+		len = comm_event_format(event, text, sizeof(text));
+		if (len < 0) {
+			return;
+		}
+	}
+
+	TAILQ_FOREACH(client, &clients, entry)
+	{
+		if ((client->filter == NULL) ||
+		    !comm_event_match(client->filter, event)) {
+			continue;
+		}
+		if (event->type == EVENT_SCENE_DELTA) {
+			publish_delta(client, event);
+			update_events(client);
+			continue;
+		}
+		if (client->dropped > 0) {
+			char notice[64];
+			int n = comm_event_format_dropped(
+				client->dropped, notice, sizeof(notice));
+			if ((n < 0) || (queue_event(client, notice, n) < 0)) {
+				client->dropped++;
+				continue;
+			}
+			client->dropped = 0;
+		}
+		if (queue_event(client, text, len) < 0) {
+			client->dropped++;
+		}
+		update_events(client);
+	}
+}
+
+/*
+ * Brings the feed from the snapshot it holds to the current one, with a
+ * delta for the subscribers it is based on.
+ */
+static void advance_scene_feed(void)
+{
+	comm_event_t event = { 0 };
+
+	const snapshot_t *snapshot = snapshot_read_lock();
+	if ((snapshot == NULL) ||
+	    (scene_base && (snapshot->seq <= scene_base->seq))) {
+		snapshot_read_unlock();
+		return;
+	}
+	snapshot_hold(snapshot);
+	snapshot_read_unlock();
+
+	const snapshot_t *old = scene_base;
+	scene_base = snapshot;
+	if (old == NULL) {
+		return;
+	}
+
+	event.type = EVENT_SCENE_DELTA;
+	event.time_ns = schedule_now();
+	event.seq = snapshot->seq;
+	event.base = old->seq;
+	/* the subscribers resync at the next delta */
+	if (comm_query_delta(old, snapshot, &event.text, &event.len) == 0) {
+		publish_event(&event);
+		free(event.text);
+	}
+	snapshot_release(old);
+}
+
+/*
+ * The whole scene, which may be larger than COMM_MAX_EVENT_OUTPUT, as of
+ * the snapshot the feed is brought to first.
+ */
+static int queue_scene_sync(client_t *client)
+{
+	char *text;
+	unsigned int len;
+	int ret = -1;
+
+	advance_scene_feed();
+	if (scene_base && (comm_query_sync(scene_base, &text, &len) == 0)) {
+		ret = queue_frame(client, text, len);
+		if (ret == 0) {
+			client->scene_seq = scene_base->seq;
+			client->scene_stale = 0;
+		}
+		free(text);
+	}
+
+	return ret;
+}
+
+static int flush_output(client_t *client)
+{
+	int ret = send_output(client);
+
+	/* a stale scene feed starts over once its backlog is written */
+	if ((ret == 0) && client->scene_stale && (client->out_len == 0) &&
+	    (queue_scene_sync(client) == 0)) {
+		ret = send_output(client);
+	}
+	return ret;
+}
+
+/*
+ * v0: s32 result and data, v1: u32 length, s32 result and data,
+ * v2: u32 length, u32 request id, s32 result and data
+ */
+static int queue_response(client_t *client, uint32_t request_id, int resp,
+			  const parser_reply_t *reply)
+{
+	int protocol = client->decoder.protocol;
+	uint32_t header[3];
+	unsigned int n = 0;
+
+	if (client->seqpacket) {
+		/* size of the datagram, not sent */
+		header[n++] = sizeof(header[0]) + reply->size;
+	} else if (protocol == COMM_PROTOCOL_V1) {
+		header[n++] = htonl(sizeof(header[0]) + reply->size);
+	} else if (protocol == COMM_PROTOCOL_V2) {
+		header[n++] = htonl(2 * sizeof(header[0]) + reply->size);
+		header[n++] = htonl(request_id);
+	}
+	header[n++] = htonl(resp);
+
+	if (queue_output(client, header, n * sizeof(header[0])) < 0) {
+		return -1;
+	}
+	if ((reply->size > 0) &&
+	    (queue_output(client, reply->data, reply->size) < 0)) {
+		return -1;
+	}
+	return 0;
+}
+
+static client_t *find_client(unsigned int id)
+{
+	client_t *client;
+
+	TAILQ_FOREACH(client, &clients, entry)
+	{
+		if (client->id == id) {
+			return client;
+		}
+	}
+	return NULL;
+}
+
+static int message_priority(client_t *client, const pipeline_item_t *item,
+			    const parser_job_t *job)
+{
+	int priority = client->priority;
+
+	if (job && job->set_priority) {
+		client->priority = job->priority;
+	}
+	if (job && (job->priority != COMM_PRIORITY_NONE)) {
+		priority = job->priority;
+	}
+	if (item->deferrable) {
+		return priority;
+	}
+
+	/* behind the messages in flight, to keep the order of the responses */
+	if (client->inflight > 0) {
+		priority = client->inflight_priority;
+	}
+	client->inflight++;
+	client->inflight_priority = priority;
+	return priority;
+}
+
+/*
+ * Items handed back to the I/O thread are kept for the messages it reads
+ * next, the ones of the apply thread are still allocated there.
+ */
+static pipeline_item_t *get_item(void)
+{
+	pipeline_item_t *item = TAILQ_FIRST(&spare_items);
+	if (item == NULL) {
+		item = malloc(sizeof(*item));
+		if (item == NULL) {
+			return NULL;
+		}
+		stats_count_message_alloc();
+	} else {
+		TAILQ_REMOVE(&spare_items, item, entry);
+		nspare_items--;
+	}
+	memset(item, 0, sizeof(*item));
+	return item;
+}
+
+static void put_item(pipeline_item_t *item)
+{
+	if (nspare_items >= PIPELINE_QUEUE_SIZE) {
+		free(item);
+		return;
+	}
+	TAILQ_INSERT_HEAD(&spare_items, item, entry);
+	nspare_items++;
+}
+
+static void answer_query(client_t *client, pipeline_item_t *item,
+			 parser_job_t *job)
+{
+	item->result = parser_run_query(job, &item->reply);
+	parser_free_job(job);
+	client->queued--;
+	client->queued_input -= item->size;
+	/* may run while the client is read, the loop closes it later */
+	if (queue_response(client, (uint32_t)item->tag, item->result,
+			   &item->reply) < 0) {
+		shutdown(client->source.fd, SHUT_RDWR);
+	} else {
+		client->answered = 1;
+	}
+	free(item->reply.data);
+	put_item(item);
+}
+
+/*
+ * A parsed message goes to the apply thread, in the order the messages
+ * were read; a job of a client that is gone is still applied.
+ */
+static void job_parsed(void *data, parser_job_t *job)
+{
+	pipeline_item_t *item = data;
+	client_t *client = NULL;
+
+	if (item->kind == PIPELINE_COMMAND) {
+		client = find_client((unsigned int)(item->tag >> 32));
+	}
+	if (client && client->subscribing) {
+		/* pipelined after subscribe */
+		parser_free_job(job);
+		put_item(item);
+		close_client(client);
+		return;
+	}
+
+	if (job) {
+		stats_add_stage(STATS_STAGE_PARSE,
+				job->parsed_ns - job->received_ns);
+	}
+
+	/* events may be posted from now on, they are matched once answered */
+	if (client && job && job->subscribe) {
+		client->subscribing = 1;
+		__atomic_fetch_add(&nsubscribers, 1, __ATOMIC_RELAXED);
+		if (job->subscribe->types & EVENT_SCENE_DELTA) {
+			client->scene_feed = 1;
+			__atomic_fetch_add(&nscene_subscribers, 1,
+					   __ATOMIC_RELAXED);
+		}
+	}
+
+	/* nothing of the client waits to be applied, the snapshot is current */
+	if (client && job && parser_job_is_query(job) &&
+	    (client->applying == 0)) {
+		answer_query(client, item, job);
+		return;
+	}
+
+	if (client) {
+		item->priority = message_priority(client, item, job);
+		client->applying++;
+	}
+	item->job = job;
+	pipeline_send(PIPELINE_IO, item);
+}
+
+/* the result stays when there is no job to apply */
+static pipeline_item_t *message_item(client_t *client, uint32_t request_id,
+				     int result)
+{
+	pipeline_item_t *item = get_item();
+	if (item == NULL) {
+		return NULL;
+	}
+	item->kind = PIPELINE_COMMAND;
+	item->tag = ((uint64_t)client->id << 32) | request_id;
+	item->deferrable = (client->decoder.protocol == COMM_PROTOCOL_V2);
+	item->priority = client->priority;
+	item->result = result;
+
+	return item;
+}
+
+/* a message for the parse pool, NULL is answered with -1 */
+static int submit_message(client_t *client, uint32_t request_id,
+			  const char *body, unsigned int size)
+{
+	pipeline_item_t *item =
+		message_item(client, request_id, PARSER_RESULT_ERROR);
+	if (item == NULL) {
+		return -1;
+	}
+	item->size = size;
+	client->queued++;
+	client->queued_input += size;
+
+	parse_pool_submit(item, body, size,
+			  client->decoder.encoding == COMM_ENCODING_BINARY,
+			  NULL);
+	return 0;
+}
+
+/* answered busy in its turn, behind the messages before it */
+static int reject_message(client_t *client, uint32_t request_id)
+{
+	pipeline_item_t *item =
+		message_item(client, request_id, PARSER_RESULT_BUSY);
+	if (item == NULL) {
+		return -1;
+	}
+
+	client->rejected++;
+	client->queued++;
+	parse_pool_submit(item, NULL, 0, 0, NULL);
+	return 0;
+}
+
+/*
+ * All records of the ring are applied at once, one per object, and each
+ * counts as a command. Records have no response to reject, so a ring is
+ * held back over its quotas whatever the quota mode.
+ */
+static void ring_handler(event_source_t *source, uint32_t events)
+{
+	static wm_record_t recs[SHM_RING_SLOTS];
+	ring_t *ring = (ring_t *)source;
+	client_t *client = ring->client;
+	uint64_t count;
+
+	(void)events;
+	if (input_full(client) || hold_client(client, schedule_now())) {
+		update_events(client);
+		return;
+	}
+	if (read(source->fd, &count, sizeof(count)) < 0) {
+		return;
+	}
+
+	int n = shm_ring_pop(ring->shm, recs, SHM_RING_SLOTS);
+	if (n < 0) {
+		fprintf(stderr, "%s(%d) ERROR: Client %u corrupted its ring\n",
+			__func__, __LINE__, client->id);
+		close_client(client);
+		return;
+	}
+
+	n = shm_ring_coalesce(recs, n);
+	if (n == 0) {
+		return;
+	}
+
+	pipeline_item_t *item = get_item();
+	if (item == NULL) {
+		return;
+	}
+	item->kind = PIPELINE_RECORDS;
+	item->tag = (uint64_t)client->id << 32;
+	item->priority = client->priority;
+	item->size = n * sizeof(wm_record_t);
+	parser_job_t *job = parser_parse_records(recs, n);
+	if (job == NULL) {
+		put_item(item);
+		return;
+	}
+	client->messages += n;
+	client->queued++;
+	client->queued_input += item->size;
+	if (quota.commands) {
+		client->commands.tokens -= n;
+	}
+	parse_pool_submit(item, NULL, 0, 0, job);
+}
+
+/* the memfd and the eventfd came with the magic code */
+static int attach_ring(client_t *client)
+{
+	if ((client->ring != NULL) || (client->nfds != 2)) {
+		fprintf(stderr, "%s(%d) ERROR: Ring descriptors missing\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	ring_t *ring = calloc(1, sizeof(*ring));
+	if (ring == NULL) {
+		return -1;
+	}
+	ring->shm = shm_ring_map(client->fds[0]);
+	if (ring->shm == NULL) {
+		free(ring);
+		return -1;
+	}
+	ring->source.fd = client->fds[1];
+	ring->source.handler = ring_handler;
+	ring->client = client;
+	ring->events = EPOLLIN;
+
+	if (event_loop_add(&ring->source, EPOLLIN) < 0) {
+		shm_ring_unmap(ring->shm);
+		free(ring);
+		return -1;
+	}
+
+	/* the mapping stays valid without the memfd */
+	close(client->fds[0]);
+	client->nfds = 0;
+	client->ring = ring;
+
+	return 0;
+}
+
+/*
+ * Failed messages are answered through the apply thread as well, behind
+ * the messages before them.
+ */
+static int handle_message(client_t *client, const char *body,
+			  unsigned int size)
+{
+	comm_decoder_t *decoder = &client->decoder;
+	uint32_t request_id = 0;
+
+	stats_count_message();
+	client->messages++;
+	if (client->subscribing) {
+		/* pipelined after subscribe */
+		return -1;
+	}
+	if (decoder->protocol == COMM_PROTOCOL_V2) {
+		if (size < sizeof(request_id)) {
+			return submit_message(client, 0, NULL, 0);
+		}
+		memcpy(&request_id, body, sizeof(request_id));
+		request_id = ntohl(request_id);
+		body += sizeof(request_id);
+		size -= sizeof(request_id);
+	}
+
+	if (quota.reject && quota_exceeded(client, schedule_now())) {
+		return reject_message(client, request_id);
+	}
+	if (quota.commands) {
+		client->commands.tokens--;
+	}
+
+	return submit_message(client, request_id, (size > 0) ? body : NULL,
+			      size);
+}
+
+/* returns -1 when the connection cannot go on */
+static int decode_client(client_t *client, uint64_t now)
+{
+	comm_decoder_t *decoder = &client->decoder;
+	parser_reply_t no_reply = { 0 };
+	const char *body;
+	unsigned int size;
+	int ret;
+
+	/*
+	 * every message that arrived complete is handled in place, those
+	 * over the limits wait in the decoder
+	 */
+	while (!input_full(client) && !throttle_client(client, now) &&
+	       ((ret = comm_decoder_next(decoder, &body, &size, now)) !=
+		DECODER_NEED_MORE)) {
+		switch (ret) {
+		case DECODER_HANDSHAKE:
+			if ((decoder->encoding == COMM_ENCODING_RING) &&
+			    (attach_ring(client) < 0)) {
+				/* answered in place of the magic code */
+				decoder->protocol = COMM_PROTOCOL_V0;
+				queue_response(client, 0, -1, &no_reply);
+				flush_output(client);
+				return -1;
+			}
+			if (queue_output(client, decoder->magic,
+					 sizeof(decoder->magic)) < 0) {
+				return -1;
+			}
+			break;
+		case DECODER_MESSAGE:
+			if (handle_message(client, body, size) < 0) {
+				return -1;
+			}
+			break;
+		default:
+			/* the stream cannot be resynchronized */
+			queue_response(client, 0, -1, &no_reply);
+			flush_output(client);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* a subscriber only reads, anything it sends ends the connection */
+static int read_subscriber(client_t *client)
+{
+	char buf[64];
+
+	ssize_t len = recv(client->source.fd, buf, sizeof(buf), 0);
+	stats_count_socket_call();
+	if (len < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+			(errno == EINTR)) ?
+			       0 :
+			       -1;
+	}
+	if (len > 0) {
+		fprintf(stderr,
+			"%s(%d) ERROR: Client %u sent data after subscribing\n",
+			__func__, __LINE__, client->id);
+	}
+	return -1;
+}
+
+/* the client of a result may be gone by now */
+static void answer(const pipeline_item_t *item, parser_reply_t *reply)
+{
+	client_t *client = find_client((unsigned int)(item->tag >> 32));
+	uint64_t tag = item->tag;
+	int result = item->result;
+
+	if (client == NULL) {
+		return;
+	}
+	if (item->kind == PIPELINE_COMMAND) {
+		client->applying--;
+		if (!item->deferrable) {
+			client->inflight--;
+		}
+	}
+	if (item->kind != PIPELINE_COMPLETION) {
+		client->queued--;
+		client->queued_input -= item->size;
+	}
+	client->ilm_total += item->ilm_calls;
+	if (quota.ilm_calls) {
+		client->ilm_calls.tokens -= item->ilm_calls;
+	}
+	/* records have no response, their ring may be read again */
+	if (item->kind == PIPELINE_RECORDS) {
+		update_events(client);
+		return;
+	}
+
+	/* the messages left in the decoder while the client was full */
+	if (!client->throttled && !input_full(client) &&
+	    (client->decoder.start < client->decoder.len) &&
+	    (decode_client(client, schedule_now()) < 0)) {
+		flush_output(client);
+		close_client(client);
+		return;
+	}
+	/* queued in the schedule, the completion answers it */
+	if (result == PARSER_RESULT_DEFERRED) {
+		return;
+	}
+	if (queue_response(client, (uint32_t)tag, result, reply) < 0) {
+		close_client(client);
+		return;
+	}
+	client->answered = 1;
+
+	/* events follow the response of subscribe */
+	if (reply->subscribe) {
+		client->filter = reply->subscribe;
+		reply->subscribe = NULL;
+		/* and a scene_sync the deltas are based on */
+		client->scene_stale = client->scene_feed;
+	}
+}
+
+/* the responses of a batch go out with one send per client */
+static void flush_answered(void)
+{
+	client_t *client, *next;
+
+	for (client = TAILQ_FIRST(&clients); client; client = next) {
+		next = TAILQ_NEXT(client, entry);
+		if (client->answered) {
+			client->answered = 0;
+			if (flush_output(client) < 0) {
+				close_client(client);
+			}
+		}
+	}
+}
+
+static void parse_handler(event_source_t *source, uint32_t events)
+{
+	(void)source;
+	(void)events;
+	parse_pool_dispatch();
+	flush_answered();
+}
+
+static void print_clients(void)
+{
+	client_t *client;
+
+	TAILQ_FOREACH(client, &clients, entry)
+	{
+		fprintf(stderr,
+			"client %u: %llu messages, %llu ilm calls, deferred %u times%s, %u rejected, %u input stalls\n",
+			client->id, (unsigned long long)client->messages,
+			(unsigned long long)client->ilm_total,
+			client->deferrals,
+			client->throttled ? " (now)" : "", client->rejected,
+			client->stalls);
+	}
+}
+
+/* on the I/O thread */
+static void answer_item(pipeline_item_t *item)
+{
+	switch (item->kind) {
+	case PIPELINE_COMMAND:
+		stats_add_stage(STATS_STAGE_RETURN,
+				schedule_now() - item->applied_ns);
+		answer(item, &item->reply);
+		break;
+	case PIPELINE_COMPLETION:
+	case PIPELINE_RECORDS:
+		answer(item, &item->reply);
+		break;
+	case PIPELINE_EVENT:
+		if (item->event.type == EVENT_SCENE_DELTA) {
+			advance_scene_feed();
+			break;
+		}
+		publish_event(&item->event);
+		free(item->event.text);
+		break;
+	case PIPELINE_CLIENTS:
+		print_clients();
+		break;
+	default:
+		break;
+	}
+
+	free(item->reply.data);
+	comm_event_free_filter(item->reply.subscribe);
+	put_item(item);
+}
+
+static void io_handler(event_source_t *source, uint32_t events)
+{
+	(void)source;
+	(void)events;
+	pipeline_dispatch(PIPELINE_IO, answer_item);
+	flush_answered();
+}
+
+/* on the apply thread, the result goes back unless nobody waits for it */
+static int mergeable(const pipeline_item_t *item)
+{
+	return (item->kind == PIPELINE_COMMAND) && item->job &&
+	       parser_job_is_modify(item->job);
+}
+
+/* the job of the item is applied, its response goes to the I/O thread */
+static void item_applied(pipeline_item_t *item, uint64_t start,
+			 uint64_t received_ns)
+{
+	item->applied_ns = schedule_now();
+	stats_add_stage(STATS_STAGE_APPLY, item->applied_ns - start);
+	if (received_ns) {
+		stats_add_priority_latency(item->priority,
+					   item->applied_ns - received_ns);
+	}
+
+	/* deferred commands and records come back, their client counts them */
+	pipeline_send(PIPELINE_APPLY, item);
+}
+
+static void apply_merged(pipeline_item_t **items, unsigned int count,
+			 uint64_t start)
+{
+	parser_job_t *jobs[COMM_MAX_MERGE];
+	int results[COMM_MAX_MERGE];
+	unsigned int i, calls, done, commits;
+
+	for (i = 0; i < count; i++) {
+		jobs[i] = items[i]->job;
+		stats_add_stage(STATS_STAGE_WAIT, start - jobs[i]->parsed_ns);
+	}
+	wrap_ilm_get_counters(&calls, &commits);
+	parser_apply_merged(jobs, count, results);
+	wrap_ilm_get_counters(&done, &commits);
+	calls = done - calls;
+
+	for (i = 0; i < count; i++) {
+		uint64_t received_ns = jobs[i]->received_ns;
+
+		/* the commit is shared, the first one takes the rest */
+		items[i]->ilm_calls = calls / count + (i ? 0 : calls % count);
+		items[i]->result = results[i];
+		parser_free_job(jobs[i]);
+		items[i]->job = NULL;
+		item_applied(items[i], start, received_ns);
+	}
+}
+
+static void apply_item(pipeline_item_t *item)
+{
+	pipeline_item_t *items[COMM_MAX_MERGE];
+	uint64_t start = schedule_now();
+	uint64_t received_ns = 0;
+	unsigned int n = 1;
+
+	/* the modify commands queued behind this one are merged with it */
+	items[0] = item;
+	while (mergeable(item) && (n < COMM_MAX_MERGE) &&
+	       (items[n] = pipeline_take_next(PIPELINE_APPLY, item,
+					      mergeable))) {
+		n++;
+	}
+	if (n > 1) {
+		apply_merged(items, n, start);
+		return;
+	}
+
+	if (item->job) {
+		unsigned int calls, done, commits;
+
+		received_ns = item->job->received_ns;
+		stats_add_stage(STATS_STAGE_WAIT,
+				start - item->job->parsed_ns);
+		item->reply.tag = item->deferrable ? item->tag : 0;
+		wrap_ilm_get_counters(&calls, &commits);
+		item->result = parser_apply_job(item->job, &item->reply);
+		wrap_ilm_get_counters(&done, &commits);
+		item->ilm_calls = done - calls;
+		parser_free_job(item->job);
+		item->job = NULL;
+	}
+	item_applied(item, start, received_ns);
+}
+
+static void apply_handler(event_source_t *source, uint32_t events)
+{
+	(void)source;
+	(void)events;
+	pipeline_dispatch(PIPELINE_APPLY, apply_item);
+}
+
+/* a deferred command was applied, on the apply thread */
+static void complete_request(uint64_t tag, int result,
+			     const parser_reply_t *reply)
+{
+	pipeline_item_t *item = calloc(1, sizeof(*item));
+	if (item == NULL) {
+		return;
+	}
+	item->kind = PIPELINE_COMPLETION;
+	item->tag = tag;
+	item->result = result;
+	if (reply->size > 0) {
+		item->reply.data = malloc(reply->size);
+		if (item->reply.data == NULL) {
+			free(item);
+			return;
+		}
+		memcpy(item->reply.data, reply->data, reply->size);
+		item->reply.size = reply->size;
+	}
+	pipeline_send(PIPELINE_APPLY, item);
+}
+
+/*
+ * On the apply thread, only when someone takes the delta; the I/O thread
+ * makes it from the snapshots.
+ */
+static void scene_published(const snapshot_t *old, const snapshot_t *snapshot)
+{
+	if ((old == NULL) ||
+	    (__atomic_load_n(&nscene_subscribers, __ATOMIC_RELAXED) == 0)) {
+		return;
+	}
+
+	pipeline_item_t *item = calloc(1, sizeof(*item));
+	if (item == NULL) {
+		/* the delta comes with the next publish */
+		return;
+	}
+	item->kind = PIPELINE_EVENT;
+	item->event.type = EVENT_SCENE_DELTA;
+	item->event.seq = snapshot->seq;
+	item->event.base = old->seq;
+	pipeline_send(PIPELINE_APPLY, item);
+}
+
+/* events happen on the apply thread and are sent by the I/O thread */
+static void post_event(const comm_event_t *event)
+{
+	if (__atomic_load_n(&nsubscribers, __ATOMIC_RELAXED) == 0) {
+		return;
+	}
+
+	pipeline_item_t *item = calloc(1, sizeof(*item));
+	if (item == NULL) {
+		return;
+	}
+	item->kind = PIPELINE_EVENT;
+	item->event = *event;
+	pipeline_send(PIPELINE_APPLY, item);
+}
+
+/* receives data and the descriptors that may come along */
+static ssize_t recv_client(client_t *client, char *buf, unsigned int size,
+			   int *flags)
+{
+	char control[CMSG_SPACE(sizeof(int) * COMM_MAX_FDS)];
+	struct iovec iov = { buf, size };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t len = recvmsg(client->source.fd, &msg, MSG_CMSG_CLOEXEC);
+	stats_count_socket_call();
+	if (len <= 0) {
+		return len;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level != SOL_SOCKET) ||
+		    (cmsg->cmsg_type != SCM_RIGHTS)) {
+			continue;
+		}
+		/* only the latest descriptors are kept */
+		close_fds(client);
+		client->nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(client->fds, CMSG_DATA(cmsg),
+		       client->nfds * sizeof(int));
+	}
+	if (msg.msg_flags & MSG_CTRUNC) {
+		fprintf(stderr, "%s(%d) ERROR: Client %u sent too many fds\n",
+			__func__, __LINE__, client->id);
+		errno = EPROTO;
+		return -1;
+	}
+
+	*flags = msg.msg_flags;
+	return len;
+}
+
+static int read_client(client_t *client)
+{
+	comm_decoder_t *decoder = &client->decoder;
+	unsigned int space;
+	int flags;
+
+	char *buf = comm_decoder_space(decoder, &space);
+	if (buf == NULL) {
+		return -1;
+	}
+
+	ssize_t len = recv_client(client, buf, space, &flags);
+	if (len == 0) {
+		return -1;
+	}
+	if (len < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+			(errno == EINTR)) ?
+			       0 :
+			       -1;
+	}
+
+	uint64_t now = schedule_now();
+	comm_decoder_received(decoder, len, now);
+	return decode_client(client, now);
+}
+
+/* one datagram is one message */
+static int read_packet(client_t *client)
+{
+	int encoding, protocol, flags;
+
+	if (throttle_client(client, schedule_now())) {
+		return 0;
+	}
+
+	ssize_t len = recv_client(client, packet_buf, COMM_PACKET_SIZE, &flags);
+	if (len == 0) {
+		return -1;
+	}
+	if (len < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+			(errno == EINTR)) ?
+			       0 :
+			       -1;
+	}
+
+	/* a bad datagram is refused, the ones after it are not affected */
+	close_fds(client);
+	if ((flags & MSG_TRUNC) || (len < 4) || (len - 4 > max_message) ||
+	    (comm_lookup_magiccode(packet_buf, &encoding, &protocol) < 0) ||
+	    (encoding == COMM_ENCODING_RING)) {
+		return submit_message(client, 0, NULL, 0);
+	}
+	/* datagrams keep their boundaries, frames and request ids are v1/v2 */
+	if (protocol != COMM_PROTOCOL_V0) {
+		fprintf(stderr,
+			"%s(%d) ERROR: Seqpacket takes v0 magic codes only\n",
+			__func__, __LINE__);
+		return submit_message(client, 0, NULL, 0);
+	}
+
+	client->decoder.encoding = encoding;
+	return handle_message(client, &packet_buf[4], len - 4);
+}
+
+static void client_handler(event_source_t *source, uint32_t events)
+{
+	client_t *client = (client_t *)source;
+
+	if (events & EPOLLIN) {
+		int ret = client->subscribing ? read_subscriber(client) :
+			  client->seqpacket   ? read_packet(client) :
+						read_client(client);
+		if (ret < 0) {
+			flush_output(client);
+			close_client(client);
+			return;
+		}
+	} else if (events & (EPOLLERR | EPOLLHUP)) {
+		close_client(client);
+		return;
+	}
+
+	if (flush_output(client) < 0) {
+		close_client(client);
+	}
+}
+
+static void sweep_handler(event_source_t *source, uint32_t events)
+{
+	uint64_t expirations;
+	client_t *client, *next;
+
+	(void)events;
+	if (read(source->fd, &expirations, sizeof(expirations)) < 0) {
+		return;
+	}
+
+	uint64_t now = schedule_now();
+	for (client = TAILQ_FIRST(&clients); client; client = next) {
+		next = TAILQ_NEXT(client, entry);
+		/* a held back client is not the one holding its messages */
+		if (!client->throttled && !input_full(client) &&
+		    client->decoder.started &&
+		    (now - client->decoder.started >
+		     COMM_READ_TIMEOUT_MS * 1000000ULL)) {
+			fprintf(stderr,
+				"%s(%d) ERROR: Client %u timed out in a message\n",
+				__func__, __LINE__, client->id);
+			close_client(client);
+		}
+	}
+}
+
+/* resumes the clients back under their quotas */
+static void throttle_handler(event_source_t *source, uint32_t events)
+{
+	uint64_t expirations;
+	client_t *client, *next;
+
+	(void)events;
+	if (read(source->fd, &expirations, sizeof(expirations)) < 0) {
+		return;
+	}
+	throttle_deadline = 0;
+
+	uint64_t now = schedule_now();
+	for (client = TAILQ_FIRST(&clients); client; client = next) {
+		next = TAILQ_NEXT(client, entry);
+		if (!client->throttled) {
+			continue;
+		}
+		uint64_t ready = quota_exceeded(client, now);
+		if (ready) {
+			arm_throttle(ready);
+			continue;
+		}
+
+		client->throttled = 0;
+		if (client->decoder.started) {
+			client->decoder.started = now;
+		}
+		if (!client->seqpacket && (decode_client(client, now) < 0)) {
+			flush_output(client);
+			close_client(client);
+			continue;
+		}
+		if (flush_output(client) < 0) {
+			close_client(client);
+		}
+	}
+}
+
+static void listen_handler(event_source_t *source, uint32_t events)
+{
+	(void)events;
+
+	int fd = connect_to_client(source->fd);
+	if (fd < 0) {
+		return;
+	}
+
+	client_t *client = calloc(1, sizeof(*client));
+	if (client == NULL) {
+		close(fd);
+		return;
+	}
+	client->source.fd = fd;
+	client->source.handler = client_handler;
+	client->id = next_client_id++;
+	client->events = EPOLLIN;
+	client->seqpacket = (source == &seqpacket_listen_source);
+	client->decoder.max_size = max_message;
+	client->priority = COMM_PRIORITY_INTERACTIVE;
+	client->commands.tokens = quota.commands;
+	client->commands.refilled_ns = schedule_now();
+	client->ilm_calls.tokens = quota.ilm_calls;
+	client->ilm_calls.refilled_ns = client->commands.refilled_ns;
+
+	if (event_loop_add(&client->source, client->events) < 0) {
+		close(fd);
+		free(client);
+		return;
+	}
+
+	TAILQ_INSERT_TAIL(&clients, client, entry);
+	nclients++;
+
+	if (nclients == 1) {
+		set_sweep(1);
+	}
+	if ((max_clients > 0) && (nclients >= max_clients)) {
+		set_listening(0);
+	}
+}
+
+/* the I/O thread serves the sockets and runs until the process exits */
+static sem_t io_ready;
+static int io_status;
+
+static void *io_thread(void *data)
+{
+	(void)data;
+
+	io_status = -1;
+	if ((event_loop_init() == 0) &&
+	    (event_loop_add(&io_source, EPOLLIN) == 0) &&
+	    (event_loop_add(&sweep_source, EPOLLIN) == 0) &&
+	    (event_loop_add(&throttle_source, EPOLLIN) == 0) &&
+	    ((parse_source.fd < 0) ||
+	     (event_loop_add(&parse_source, EPOLLIN) == 0))) {
+		set_listening(1);
+		io_status = listening ? 0 : -1;
+	}
+	sem_post(&io_ready);
+	if (io_status < 0) {
+		return NULL;
+	}
+
+	event_loop_run();
+	fprintf(stderr, "%s(%d) ERROR: I/O thread stopped\n", __func__,
+		__LINE__);
+	exit(EXIT_FAILURE);
+	return NULL;
+}
+
+int comm_server_init(unsigned int max, unsigned int workers)
+{
+	pthread_t thread;
+
+	max_clients = max;
+	parser_set_completion_handler(complete_request);
+	comm_event_set_handler(post_event);
+	snapshot_set_publish_handler(scene_published);
+
+	if ((pipeline_init() < 0) || (parse_pool_init(workers, job_parsed) < 0)) {
+		return -1;
+	}
+	parse_source.fd = parse_pool_get_fd();
+	parse_source.handler = parse_handler;
+	io_source.fd = pipeline_get_fd(PIPELINE_IO);
+	io_source.handler = io_handler;
+	apply_source.fd = pipeline_get_fd(PIPELINE_APPLY);
+	apply_source.handler = apply_handler;
+
+	/* the caller's loop is the apply thread */
+	if (event_loop_add(&apply_source, EPOLLIN) < 0) {
+		return -1;
+	}
+
+	sweep_source.fd = timerfd_create(CLOCK_MONOTONIC,
+					 TFD_NONBLOCK | TFD_CLOEXEC);
+	if (sweep_source.fd < 0) {
+		fprintf(stderr, "%s(%d) ERROR: timerfd_create\n", __func__,
+			__LINE__);
+		return -1;
+	}
+	sweep_source.handler = sweep_handler;
+
+	throttle_source.fd = timerfd_create(CLOCK_MONOTONIC,
+					    TFD_NONBLOCK | TFD_CLOEXEC);
+	if (throttle_source.fd < 0) {
+		fprintf(stderr, "%s(%d) ERROR: timerfd_create\n", __func__,
+			__LINE__);
+		return -1;
+	}
+	throttle_source.handler = throttle_handler;
+
+	listen_source.fd = create_server_socket();
+	if (listen_source.fd < 0) {
+		return -1;
+	}
+	listen_source.handler = listen_handler;
+
+	seqpacket_listen_source.fd = create_server_seqpacket_socket();
+	packet_buf = malloc(COMM_PACKET_SIZE);
+	if ((seqpacket_listen_source.fd < 0) || (packet_buf == NULL)) {
+		return -1;
+	}
+	seqpacket_listen_source.handler = listen_handler;
+
+	sem_init(&io_ready, 0, 0);
+	if (pthread_create(&thread, NULL, io_thread, NULL) != 0) {
+		fprintf(stderr, "%s(%d) ERROR: pthread_create\n", __func__,
+			__LINE__);
+		return -1;
+	}
+	pthread_detach(thread);
+
+	while ((sem_wait(&io_ready) < 0) && (errno == EINTR)) {
+	}
+	sem_destroy(&io_ready);
+
+	return io_status;
+}
+
+void comm_server_set_quota(const comm_quota_t *q)
+{
+	quota = *q;
+}
+
+void comm_server_set_max_message(unsigned int size)
+{
+	max_message = ((size > 0) && (size < COMM_MAX_FRAME_SIZE)) ?
+			      size :
+			      COMM_MAX_FRAME_SIZE;
+}
+
+/* the clients belong to the I/O thread, which prints them */
+void comm_server_print_clients(void)
+{
+	pipeline_item_t *item = calloc(1, sizeof(*item));
+	if (item == NULL) {
+		return;
+	}
+	item->kind = PIPELINE_CLIENTS;
+	pipeline_send(PIPELINE_APPLY, item);
+}
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __COMM_SERVER_H__
+#define __COMM_SERVER_H__
+
+/* a client stuck in the middle of a message this long is dropped */
+#define COMM_READ_TIMEOUT_MS 5000
+
+/* responses queued for a client before it is no longer read */
+#define COMM_MAX_PENDING_OUTPUT (256 * 1024)
+
+/* events queued for a subscriber before new ones are dropped */
+#define COMM_MAX_EVENT_OUTPUT (64 * 1024)
+
+/* unanswered messages of a client, and bytes, before it is no longer read */
+#define COMM_MAX_QUEUED_MESSAGES 64
+#define COMM_MAX_QUEUED_INPUT (256 * 1024)
+
+/*
+ * Quotas of every connection, 0 for no limit: commands and ilm calls per
+ * second, with a burst of one second's worth. The ilm calls a command
+ * made are counted once it is applied. A connection over its quota is no
+ * longer read until the quota refilled, and the modify commands it sent
+ * in the meantime are merged once it is; with reject set, it is still
+ * read and its messages are answered with PARSER_RESULT_BUSY instead.
+ */
+typedef struct _comm_quota {
+	unsigned int commands;
+	unsigned int ilm_calls;
+	int reject;
+} comm_quota_t;
+
+/* before comm_server_init */
+void comm_server_set_quota(const comm_quota_t *quota);
+
+/*
+ * before comm_server_init: bodies larger than size close a stream
+ * connection and are answered with an error on a seqpacket one; 0 or more
+ * than COMM_MAX_FRAME_SIZE for COMM_MAX_FRAME_SIZE
+ */
+void comm_server_set_max_message(unsigned int size);
+
+/* prints the quota counters of every client, from the apply thread */
+void comm_server_print_clients(void);
+
+/*
+ * max_clients 0 accepts any number of concurrent clients, messages are
+ * parsed on the I/O thread without workers, see parse_pool.h
+ */
+int comm_server_init(unsigned int max_clients, unsigned int workers);
+
+#endif //__COMM_SERVER_H__
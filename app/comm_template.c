@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <jansson.h>
+
+#include "comm_template.h"
+
+#define JSON_KEY_COMMAND "command"
+#define JSON_KEY_NAME "name"
+#define JSON_KEY_TEMPLATE "template"
+#define JSON_KEY_PARAMS "params"
+
+#define TEMPLATE_NAME_MAX 32
+
+typedef struct _template_slot {
+	/* Object or array holding the placeholder */
+	json_t *parent;
+	/* Object key, NULL when parent is an array */
+	char *key;
+	size_t index;
+
+	/* Index into the parameter name table */
+	unsigned int param;
+} template_slot_t;
+
+TAILQ_HEAD(template_head, _template);
+typedef struct _template {
+	char name[TEMPLATE_NAME_MAX];
+
+	/* Pre-parsed command, placeholders are overwritten on invocation */
+	json_t *skeleton;
+
+	unsigned int nparams;
+	char **params;
+
+	unsigned int nslots;
+	template_slot_t *slots;
+
+	TAILQ_ENTRY(_template) entry;
+} template_t;
+
+static struct template_head template_head =
+	TAILQ_HEAD_INITIALIZER(template_head);
+
+static template_t *get_template(const char *name)
+{
+	template_t *tmpl;
+	TAILQ_FOREACH(tmpl, &template_head, entry)
+	{
+		if (strcmp(tmpl->name, name) == 0) {
+			return tmpl;
+		}
+	}
+	return NULL;
+}
+
+static void free_template(template_t *tmpl)
+{
+	unsigned int i;
+
+	for (i = 0; i < tmpl->nslots; i++) {
+		free(tmpl->slots[i].key);
+	}
+	for (i = 0; i < tmpl->nparams; i++) {
+		free(tmpl->params[i]);
+	}
+	free(tmpl->slots);
+	free(tmpl->params);
+	json_decref(tmpl->skeleton);
+	free(tmpl);
+}
+
+/* returns the parameter name of a "${name}" string, or NULL */
+static const char *placeholder_name(json_t *value, size_t *len)
+{
+	const char *str;
+	size_t size;
+
+	if (!json_is_string(value)) {
+		return NULL;
+	}
+
+	str = json_string_value(value);
+	size = strlen(str);
+	if ((size < 4) || (strncmp(str, "${", 2) != 0) ||
+	    (str[size - 1] != '}')) {
+		return NULL;
+	}
+
+	*len = size - 3;
+	return str + 2;
+}
+
+static int add_param(template_t *tmpl, const char *name, size_t len)
+{
+	unsigned int i;
+	for (i = 0; i < tmpl->nparams; i++) {
+		if ((strlen(tmpl->params[i]) == len) &&
+		    (strncmp(tmpl->params[i], name, len) == 0)) {
+			return i;
+		}
+	}
+
+	char **params =
+		realloc(tmpl->params, (tmpl->nparams + 1) * sizeof(*params));
+	if (params == NULL) {
+		return -1;
+	}
+	tmpl->params = params;
+	tmpl->params[tmpl->nparams] = strndup(name, len);
+
+	return tmpl->nparams++;
+}
+
+static int add_slot(template_t *tmpl, json_t *parent, const char *key,
+		    size_t index, json_t *value)
+{
+	size_t len = 0;
+	const char *name = placeholder_name(value, &len);
+	if (name == NULL) {
+		return 0;
+	}
+
+	int param = add_param(tmpl, name, len);
+	if (param < 0) {
+		return -1;
+	}
+
+	template_slot_t *slots =
+		realloc(tmpl->slots, (tmpl->nslots + 1) * sizeof(*slots));
+	if (slots == NULL) {
+		return -1;
+	}
+	tmpl->slots = slots;
+
+	template_slot_t *slot = &tmpl->slots[tmpl->nslots++];
+	slot->parent = parent;
+	slot->key = key ? strdup(key) : NULL;
+	slot->index = index;
+	slot->param = param;
+
+	return 0;
+}
+
+static int compile_children(template_t *tmpl, json_t *jobject)
+{
+	const char *key;
+	size_t index;
+	json_t *value;
+
+	if (json_is_object(jobject)) {
+		json_object_foreach(jobject, key, value)
+		{
+			if (add_slot(tmpl, jobject, key, 0, value) < 0) {
+				return -1;
+			}
+			if (compile_children(tmpl, value) < 0) {
+				return -1;
+			}
+		}
+	} else if (json_is_array(jobject)) {
+		json_array_foreach(jobject, index, value)
+		{
+			if (add_slot(tmpl, jobject, NULL, index, value) < 0) {
+				return -1;
+			}
+			if (compile_children(tmpl, value) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int comm_template_define(json_t *jobject)
+{
+	json_t *name_jobj = json_object_get(jobject, JSON_KEY_NAME);
+	if (!json_is_string(name_jobj) ||
+	    (strlen(json_string_value(name_jobj)) >= TEMPLATE_NAME_MAX)) {
+		fprintf(stderr, "%s(%d) ERROR: Illegal template name\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	json_t *skeleton_jobj = json_object_get(jobject, JSON_KEY_TEMPLATE);
+	if (!json_is_object(skeleton_jobj)) {
+		fprintf(stderr,
+			"%s(%d) ERROR: json type other than object, or for NULL. [%s]\n",
+			__func__, __LINE__, JSON_KEY_TEMPLATE);
+		return -1;
+	}
+
+	/* templates must not expand into other template commands */
+	json_t *cmd_jobj = json_object_get(skeleton_jobj, JSON_KEY_COMMAND);
+	if (!json_is_string(cmd_jobj) ||
+	    (strstr(json_string_value(cmd_jobj), "_template") != NULL)) {
+		fprintf(stderr, "%s(%d) ERROR: Illegal template command\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	template_t *tmpl = calloc(1, sizeof(*tmpl));
+	if (tmpl == NULL) {
+		return -1;
+	}
+	snprintf(tmpl->name, sizeof(tmpl->name), "%s",
+		 json_string_value(name_jobj));
+	tmpl->skeleton = json_deep_copy(skeleton_jobj);
+
+	if ((tmpl->skeleton == NULL) ||
+	    (compile_children(tmpl, tmpl->skeleton) < 0)) {
+		fprintf(stderr, "%s(%d) ERROR: Failed to compile template %s\n",
+			__func__, __LINE__, tmpl->name);
+		free_template(tmpl);
+		return -1;
+	}
+
+	template_t *old = get_template(tmpl->name);
+	if (old) {
+		TAILQ_REMOVE(&template_head, old, entry);
+		free_template(old);
+	}
+	TAILQ_INSERT_TAIL(&template_head, tmpl, entry);
+
+	return 0;
+}
+
+json_t *comm_template_instantiate(json_t *jobject)
+{
+	unsigned int i;
+
+	json_t *name_jobj = json_object_get(jobject, JSON_KEY_NAME);
+	if (!json_is_string(name_jobj)) {
+		fprintf(stderr, "%s(%d) ERROR: Illegal template name\n",
+			__func__, __LINE__);
+		return NULL;
+	}
+
+	template_t *tmpl = get_template(json_string_value(name_jobj));
+	if (tmpl == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Template %s not defined\n",
+			__func__, __LINE__, json_string_value(name_jobj));
+		return NULL;
+	}
+
+	/* check all parameters before touching the skeleton */
+	json_t *params_jobj = json_object_get(jobject, JSON_KEY_PARAMS);
+	for (i = 0; i < tmpl->nparams; i++) {
+		if (json_object_get(params_jobj, tmpl->params[i]) == NULL) {
+			fprintf(stderr,
+				"%s(%d) ERROR: Template %s parameter %s missing\n",
+				__func__, __LINE__, tmpl->name,
+				tmpl->params[i]);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < tmpl->nslots; i++) {
+		template_slot_t *slot = &tmpl->slots[i];
+		json_t *value = json_object_get(params_jobj,
+						tmpl->params[slot->param]);
+		if (slot->key) {
+			json_object_set(slot->parent, slot->key, value);
+		} else {
+			json_array_set(slot->parent, slot->index, value);
+		}
+	}
+
+	return tmpl->skeleton;
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __COMM_TEMPLATE_H__
+#define __COMM_TEMPLATE_H__
+
+#include <jansson.h>
+
+/*
+ * Command templates.
+ *
+ * A template is a command skeleton stored by "define_template". String values
+ * of the form "${name}" are placeholders. The skeleton is parsed once and the
+ * placeholder locations are recorded, so "invoke_template" only has to store
+ * the supplied parameter values into those locations.
+ */
+int comm_template_define(json_t *jobject);
+json_t *comm_template_instantiate(json_t *jobject);
+
+#endif //__COMM_TEMPLATE_H__
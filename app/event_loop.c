@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "event_loop.h"
+
+#define EVENT_LOOP_MAX_EVENTS 64
+
+/* every thread runs a loop of its own */
+static __thread int epoll_fd = -1;
+
+/* events being dispatched */
+static __thread struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+static __thread int nevents;
+static __thread int current;
+
+int event_loop_init(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		fprintf(stderr, "%s(%d) ERROR: epoll_create1: %s\n", __func__,
+			__LINE__, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int control(int op, event_source_t *source, uint32_t flags)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = flags;
+	ev.data.ptr = source;
+	if (epoll_ctl(epoll_fd, op, source->fd, &ev) < 0) {
+		fprintf(stderr, "%s(%d) ERROR: epoll_ctl fd %d: %s\n",
+			__func__, __LINE__, source->fd, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int event_loop_add(event_source_t *source, uint32_t flags)
+{
+	return control(EPOLL_CTL_ADD, source, flags);
+}
+
+int event_loop_modify(event_source_t *source, uint32_t flags)
+{
+	return control(EPOLL_CTL_MOD, source, flags);
+}
+
+void event_loop_remove(event_source_t *source)
+{
+	int i;
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+
+	/* the source may be freed, drop its events still to be dispatched */
+	for (i = current + 1; i < nevents; i++) {
+		if (events[i].data.ptr == source) {
+			events[i].data.ptr = NULL;
+		}
+	}
+}
+
+void event_loop_run(void)
+{
+	while (1) {
+		nevents = epoll_wait(epoll_fd, events, EVENT_LOOP_MAX_EVENTS,
+				     -1);
+		if (nevents < 0) {
+			nevents = 0;
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "%s(%d) ERROR: epoll_wait: %s\n",
+				__func__, __LINE__, strerror(errno));
+			return;
+		}
+
+		for (current = 0; current < nevents; current++) {
+			event_source_t *source = events[current].data.ptr;
+			if (source) {
+				source->handler(source,
+						events[current].events);
+			}
+		}
+		nevents = 0;
+	}
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __EVENT_LOOP_H__
+#define __EVENT_LOOP_H__
+
+#include <stdint.h>
+
+/*
+ * epoll based dispatcher. A source is registered with its fd and handler,
+ * and the loop hands the source back to the handler with the epoll events.
+ * Structures owning a source keep it as their first member.
+ * The loop belongs to the thread that called event_loop_init, and its
+ * sources are added and removed from that thread only.
+ */
+typedef struct _event_source event_source_t;
+typedef void (*event_handler_t)(event_source_t *source, uint32_t events);
+
+struct _event_source {
+	int fd;
+	event_handler_t handler;
+};
+
+int event_loop_init(void);
+int event_loop_add(event_source_t *source, uint32_t events);
+int event_loop_modify(event_source_t *source, uint32_t events);
+void event_loop_remove(event_source_t *source);
+void event_loop_run(void);
+
+#endif //__EVENT_LOOP_H__
@@ -23,6 +23,46 @@
 
 static int pipe_writefd = -1;
 
+/* nesting depth of transactions, changes are committed when it drops to 0 */
+static int transaction_depth = 0;
+static int commit_pending = 0;
+
+/* calls into ilm and commits, for the reports of commands */
+static unsigned int ilm_calls;
+static unsigned int ilm_commits;
+#define ILM_CALL(call) (ilm_calls++, (call))
+
+void wrap_ilm_get_counters(unsigned int *calls, unsigned int *commits)
+{
+	*calls = ilm_calls;
+	*commits = ilm_commits;
+}
+
+static void wrap_ilm_commit_changes(void)
+{
+	if (transaction_depth > 0) {
+		commit_pending = 1;
+		return;
+	}
+	ILM_CALL(ilm_commitChanges());
+	ilm_commits++;
+}
+
+void wrap_ilm_begin_transaction(void)
+{
+	transaction_depth++;
+}
+
+void wrap_ilm_end_transaction(void)
+{
+	if ((transaction_depth > 0) && (--transaction_depth == 0) &&
+	    commit_pending) {
+		commit_pending = 0;
+		ILM_CALL(ilm_commitChanges());
+		ilm_commits++;
+	}
+}
+
 void wrap_ilm_init(int pipefd)
 {
 	pipe_writefd = pipefd;
@@ -52,10 +92,10 @@ static int wrap_ilm_module_exists(ilmObjectType type, int id)
 
 	switch (type) {
 	case ILM_SURFACE:
-		ilm_getSurfaceIDs(&length, &IDs);
+		ILM_CALL(ilm_getSurfaceIDs(&length, &IDs));
 		break;
 	case ILM_LAYER:
-		ilm_getLayerIDs(&length, &IDs);
+		ILM_CALL(ilm_getLayerIDs(&length, &IDs));
 		break;
 	default:
 		break;
@@ -88,7 +128,7 @@ int wrap_ilm_screen_exists(int id)
 	ilmErrorTypes callResult;
 	struct ilmScreenProperties screenProperties;
 
-	callResult = ilm_getPropertiesOfScreen(id, &screenProperties);
+	callResult = ILM_CALL(ilm_getPropertiesOfScreen(id, &screenProperties));
 	if (ILM_SUCCESS == callResult) {
 		exists = 1;
 	}
@@ -103,7 +143,7 @@ void wrap_ilm_get_screen_ids(t_ilm_uint *count, t_ilm_uint **screen_array_n)
 	t_ilm_uint cnt = 0;
 	t_ilm_uint *screen_ary_n = NULL;
 
-	callResult = ilm_getScreenIDs(&cnt, &screen_ary_n);
+	callResult = ILM_CALL(ilm_getScreenIDs(&cnt, &screen_ary_n));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
@@ -112,16 +152,27 @@ void wrap_ilm_get_screen_ids(t_ilm_uint *count, t_ilm_uint **screen_array_n)
 	*screen_array_n = screen_ary_n;
 }
 
+void wrap_ilm_get_surface_ids(t_ilm_int *count, t_ilm_uint **surface_array_n)
+{
+	*count = 0;
+	*surface_array_n = NULL;
+	if (ILM_CALL(ilm_getSurfaceIDs(count, surface_array_n)) !=
+	    ILM_SUCCESS) {
+		*count = 0;
+	}
+}
+
 static void wrap_ilm_create_layer(layer_properties_t *prop, int id)
 {
 	ilmErrorTypes callResult;
 
 	callResult =
-		ilm_layerCreateWithDimension(&id, prop->width, prop->height);
+		ILM_CALL(ilm_layerCreateWithDimension(&id, prop->width,
+						      prop->height));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
-	ilm_commitChanges();
+	wrap_ilm_commit_changes();
 }
 
 void wrap_ilm_set_layer(layer_properties_t *layer_prop, int id)
@@ -133,30 +184,30 @@ void wrap_ilm_set_layer(layer_properties_t *layer_prop, int id)
 	layout_properties_t prop = layer_prop->lp;
 
 	ilmErrorTypes callResult;
-	callResult = ilm_layerSetDestinationRectangle(
-		id, prop.dst_x, prop.dst_y, prop.dst_w, prop.dst_h);
+	callResult = ILM_CALL(ilm_layerSetDestinationRectangle(
+		id, prop.dst_x, prop.dst_y, prop.dst_w, prop.dst_h));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
 
-	callResult = ilm_layerSetSourceRectangle(id, prop.src_x, prop.src_y,
-						 prop.src_w, prop.src_h);
+	callResult = ILM_CALL(ilm_layerSetSourceRectangle(
+		id, prop.src_x, prop.src_y, prop.src_w, prop.src_h));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
 
-	callResult = ilm_layerSetOpacity(id, prop.opacity);
+	callResult = ILM_CALL(ilm_layerSetOpacity(id, prop.opacity));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
 
-	callResult = ilm_layerSetVisibility(id, prop.visibility);
+	callResult = ILM_CALL(ilm_layerSetVisibility(id, prop.visibility));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
 
-	callResult = ilm_layerRemoveNotification(id);
-	ilm_commitChanges();
+	callResult = ILM_CALL(ilm_layerRemoveNotification(id));
+	wrap_ilm_commit_changes();
 }
 
 void wrap_ilm_add_layer_to_screen(int id, t_ilm_layer *layer_array_n,
@@ -164,11 +215,12 @@ void wrap_ilm_add_layer_to_screen(int id, t_ilm_layer *layer_array_n,
 {
 	ilmErrorTypes callResult;
 
-	callResult = ilm_displaySetRenderOrder(id, layer_array_n, layers);
+	callResult =
+		ILM_CALL(ilm_displaySetRenderOrder(id, layer_array_n, layers));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
-	ilm_commitChanges();
+	wrap_ilm_commit_changes();
 }
 
 void wrap_ilm_remove_layer(int layer_id)
@@ -178,13 +230,13 @@ void wrap_ilm_remove_layer(int layer_id)
 	}
 
 	ilmErrorTypes callResult;
-	callResult = ilm_layerRemove(layer_id);
+	callResult = ILM_CALL(ilm_layerRemove(layer_id));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
 
-	callResult = ilm_layerRemoveNotification(layer_id);
-	ilm_commitChanges();
+	callResult = ILM_CALL(ilm_layerRemoveNotification(layer_id));
+	wrap_ilm_commit_changes();
 }
 
 void wrap_ilm_set_surface(surface_properties_t *surface_prop, int id)
@@ -196,27 +248,27 @@ void wrap_ilm_set_surface(surface_properties_t *surface_prop, int id)
 	layout_properties_t prop = surface_prop->lp;
 
 	ilmErrorTypes callResult;
-	callResult = ilm_surfaceSetDestinationRectangle(
-		id, prop.dst_x, prop.dst_y, prop.dst_w, prop.dst_h);
+	callResult = ILM_CALL(ilm_surfaceSetDestinationRectangle(
+		id, prop.dst_x, prop.dst_y, prop.dst_w, prop.dst_h));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
 
-	callResult = ilm_surfaceSetSourceRectangle(id, prop.src_x, prop.src_y,
-						   prop.src_w, prop.src_h);
+	callResult = ILM_CALL(ilm_surfaceSetSourceRectangle(
+		id, prop.src_x, prop.src_y, prop.src_w, prop.src_h));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
-	callResult = ilm_surfaceSetOpacity(id, prop.opacity);
+	callResult = ILM_CALL(ilm_surfaceSetOpacity(id, prop.opacity));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
-	callResult = ilm_surfaceSetVisibility(id, prop.visibility);
+	callResult = ILM_CALL(ilm_surfaceSetVisibility(id, prop.visibility));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
-	callResult = ilm_surfaceRemoveNotification(id);
-	ilm_commitChanges();
+	callResult = ILM_CALL(ilm_surfaceRemoveNotification(id));
+	wrap_ilm_commit_changes();
 }
 
 void wrap_ilm_add_surface_to_layer(int id, t_ilm_surface *surface_array_n,
@@ -224,11 +276,12 @@ void wrap_ilm_add_surface_to_layer(int id, t_ilm_surface *surface_array_n,
 {
 	ilmErrorTypes callResult;
 
-	callResult = ilm_layerSetRenderOrder(id, surface_array_n, surfaces);
+	callResult = ILM_CALL(
+		ilm_layerSetRenderOrder(id, surface_array_n, surfaces));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
-	ilm_commitChanges();
+	wrap_ilm_commit_changes();
 }
 
 void wrap_ilm_remove_surface(int layer_id, int surface_id)
@@ -238,13 +291,13 @@ void wrap_ilm_remove_surface(int layer_id, int surface_id)
 	}
 
 	ilmErrorTypes callResult;
-	callResult = ilm_layerRemoveSurface(layer_id, surface_id);
+	callResult = ILM_CALL(ilm_layerRemoveSurface(layer_id, surface_id));
 	if (ILM_SUCCESS != callResult) {
 		wrap_ilm_exit(callResult);
 	}
 
-	callResult = ilm_surfaceRemoveNotification(surface_id);
-	ilm_commitChanges();
+	callResult = ILM_CALL(ilm_surfaceRemoveNotification(surface_id));
+	wrap_ilm_commit_changes();
 }
 
 static void print_nofification_mask(t_ilm_notification_mask m)
@@ -310,9 +363,10 @@ void wrap_ilm_set_surfaceAddNotification(t_ilm_uint id)
 	if (!parser_check_registered_surface_in_list_tree(id)) {
 		return;
 	}
-	ilm_surfaceAddNotification(id, &surface_notification_callback);
+	ILM_CALL(ilm_surfaceAddNotification(id,
+					    &surface_notification_callback));
 	ilm_commitChanges();
-	ilm_getPropertiesOfSurface(id, &sp);
+	ILM_CALL(ilm_getPropertiesOfSurface(id, &sp));
 }
 
 static void notification_callback(ilmObjectType object, t_ilm_uint id,
@@ -321,16 +375,15 @@ static void notification_callback(ilmObjectType object, t_ilm_uint id,
 	(void)user_data;
 
 	if (object == ILM_SURFACE) {
-		if (created) {
-			cbdata data;
-			data.type = NTF_TYPE_CREATION_DELECTION;
-			data.id = id;
-			write(pipe_writefd, &data, sizeof(cbdata));
-		}
+		cbdata data;
+		data.type = created ? NTF_TYPE_CREATION_DELECTION :
+				      NTF_TYPE_SURFACE_REMOVAL;
+		data.id = id;
+		write(pipe_writefd, &data, sizeof(cbdata));
 	}
 }
 
 void wrap_ilm_set_notification_callback()
 {
-	ilm_registerNotification(notification_callback, NULL);
+	ILM_CALL(ilm_registerNotification(notification_callback, NULL));
 }
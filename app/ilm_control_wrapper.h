@@ -24,6 +24,7 @@
 typedef enum _ntf_type {
 	NTF_TYPE_CREATION_DELECTION = 1,
 	NTF_TYPE_SURFACE_PROP_CHANGE,
+	NTF_TYPE_SURFACE_REMOVAL,
 } ntf_type;
 
 typedef struct _cbdata {
@@ -33,6 +34,13 @@ typedef struct _cbdata {
 
 void wrap_ilm_init(int pipefd);
 
+/* changes made between begin and end are committed once, at the end */
+void wrap_ilm_begin_transaction(void);
+void wrap_ilm_end_transaction(void);
+
+/* running totals of ilm calls and commits */
+void wrap_ilm_get_counters(unsigned int *calls, unsigned int *commits);
+
 int wrap_ilm_layer_exists(int id);
 int wrap_ilm_surface_exists(int id);
 int wrap_ilm_screen_exists(int id);
@@ -40,6 +48,9 @@ int wrap_ilm_screen_exists(int id);
 /* screen control */
 void wrap_ilm_get_screen_ids(t_ilm_uint *count, t_ilm_uint **screen_array_n);
 
+/* surface control */
+void wrap_ilm_get_surface_ids(t_ilm_int *count, t_ilm_uint **surface_array_n);
+
 /* layer control*/
 void wrap_ilm_set_layer(layer_properties_t *prop, int id);
 void wrap_ilm_add_layer_to_screen(int id, t_ilm_layer *layer_array_n,
@@ -22,8 +22,13 @@
 #include <sys/stat.h>
 #include <getopt.h>
 #include <stdint.h>
+#include <limits.h>
 #include <errno.h>
 #include <err.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
 
 #define DEBUG 0
 #if DEBUG
@@ -41,90 +46,109 @@ pid_t gettid(void)
 #include "comm_parser.h"
 static char *json_cfg_path = NULL;
 
-#include <poll.h>
-#include "comm_receiver.h"
-static int socket_fd = -1;
-static int accept_fd = -1;
+#include "capacity.h"
+#include "comm_event.h"
+#include "comm_server.h"
+#include "event_loop.h"
+#include "realtime.h"
+#include "schedule.h"
+#include "stats.h"
+/* -1 unless given, then the capacity init config sets it */
+static long max_clients = -1;
+/* parse workers, one per core unless given */
+static long parse_workers = -1;
+/* per client, none by default */
+static comm_quota_t quota;
+/* real-time mode, the options override the init config */
+static realtime_t realtime;
+static int rt_option;
+static uint64_t rt_cpus, rt_ilm_cpus;
+static long rt_priority = -1;
+/* bounded-memory mode, from the init config */
+static capacity_t capacity;
 static int pipe_readfd = -1;
 
-void wait_event_loop(void)
+static void callback_pipe_handler(event_source_t *source, uint32_t events)
 {
-	struct pollfd fds[3];
+	cbdata data;
+	int size = read(source->fd, &data, sizeof(data));
+	if (size == -1) {
+		fprintf(stderr, "%s(%d) ERROR: pipe read\n", __func__, __LINE__);
+		return;
+	}
+	switch (data.type) {
+	case NTF_TYPE_CREATION_DELECTION:
+		comm_event_publish(EVENT_SURFACE_CREATED, data.id, NULL, 0);
+		parser_surface_created(data.id);
+		wrap_ilm_set_surfaceAddNotification(data.id);
+		break;
+	case NTF_TYPE_SURFACE_PROP_CHANGE:
+		comm_event_publish(EVENT_SURFACE_CONFIGURED, data.id, NULL, 0);
+		parser_add_ivi_surface_by_event_notification(data.id);
+		break;
+	case NTF_TYPE_SURFACE_REMOVAL:
+		comm_event_publish(EVENT_SURFACE_DESTROYED, data.id, NULL, 0);
+		parser_surface_destroyed(data.id);
+		break;
+	default:
+		break;
+	}
+}
 
-	memset(&fds, 0, sizeof(fds));
+static void schedule_handler(event_source_t *source, uint32_t events)
+{
+	parser_run_scheduled_commands();
+}
 
-	fds[0].fd = pipe_readfd;
-	fds[0].events = POLLIN;
+static void signal_handler(event_source_t *source, uint32_t events)
+{
+	struct signalfd_siginfo info;
+	if (read(source->fd, &info, sizeof(info)) > 0) {
+		stats_print();
+		comm_server_print_clients();
+	}
+}
 
-	socket_fd = create_server_socket();
-	fds[1].fd = socket_fd;
-	fds[1].events = POLLIN;
+/* -1 when the loop or the server cannot be set up */
+int wait_event_loop(void)
+{
+	static event_source_t pipe_source, schedule_source, signal_source;
 
-	fds[2].fd = accept_fd;
-	fds[2].events = POLLIN;
+	if (event_loop_init() < 0) {
+		return -1;
+	}
 
-	while (1) {
-		poll(fds, 3, -1);
-
-		/* callback pipe */
-		if (fds[0].revents & POLLIN) {
-			cbdata data;
-			int size = read(pipe_readfd, &data, sizeof(data));
-			if (size == -1) {
-				fprintf(stderr, "%s(%d) ERROR: pipe read\n",
-					__func__, __LINE__);
-			}
-			switch (data.type) {
-			case NTF_TYPE_CREATION_DELECTION:
-				wrap_ilm_set_surfaceAddNotification(data.id);
-				break;
-			case NTF_TYPE_SURFACE_PROP_CHANGE:
-				parser_add_ivi_surface_by_event_notification(
-					data.id);
-				break;
-			default:
-				break;
-			}
-		}
+	/* callback pipe */
+	pipe_source.fd = pipe_readfd;
+	pipe_source.handler = callback_pipe_handler;
+	event_loop_add(&pipe_source, EPOLLIN);
 
-		/* socket */
-		if (fds[1].revents & POLLIN) {
-			if (accept_fd < 0) {
-				accept_fd = connect_to_client(socket_fd);
-				fds[2].fd = accept_fd;
-				fds[2].events = POLLIN;
-			}
-		}
+	/* scheduled commands */
+	schedule_source.fd = schedule_init();
+	schedule_source.handler = schedule_handler;
+	event_loop_add(&schedule_source, EPOLLIN);
 
-		/* accept */
-		if (fds[2].revents & (POLLERR | POLLHUP | POLLNVAL)) {
-			close(accept_fd);
-			accept_fd = -1;
-			fds[2].fd = accept_fd;
-			fds[2].revents &= ~POLLIN;
-			continue;
-		}
+	/* SIGUSR1 prints the statistics */
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	signal_source.fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	signal_source.handler = signal_handler;
+	event_loop_add(&signal_source, EPOLLIN);
 
-		/* receive command */
-		if (fds[2].revents & POLLIN) {
-			int resp = -1;
-			if (exchange_magiccode_with_client(accept_fd) == 0) {
-				int size = acquire_body_size_from_client(
-					accept_fd);
-				if (size > 0) {
-					char *msg = (char *)calloc(size + 1, 1);
-					acquire_body_from_client(accept_fd,
-								 &msg, size);
-					//fprintf (stderr, "%s\n", json_dumps (jobj, sizeof (jobj)));
-					resp = parser_parse_recv_command(msg);
-					if (msg) {
-						free(msg);
-					}
-				}
-			}
-			send_response_to_client(accept_fd, resp);
-		}
+	/* clients */
+	if (parse_workers < 0) {
+		parse_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	comm_server_set_quota(&quota);
+	comm_server_set_max_message(capacity.message_size);
+	if (comm_server_init((max_clients > 0) ? max_clients : 0,
+			     (parse_workers > 0) ? parse_workers : 0) < 0) {
+		return -1;
 	}
+
+	event_loop_run();
+	return 0;
 }
 
 static int usage(int ret)
@@ -132,21 +156,56 @@ static int usage(int ret)
 	fprintf(stderr,
 		" usage \n"
 		"    -h,  --help                  display this help and exit \n"
-		"    -c,  --path                  Init config file path \n");
+		"    -c,  --path                  Init config file path \n"
+		"    -n,  --max-clients           Max concurrent clients, 0 for no limit, overrides the capacity init config \n"
+		"    -j,  --parse-workers         Parse threads, 0 parses on the I/O thread (one per core) \n"
+		"    -r,  --client-rate           Commands per second of each client, 0 for no limit \n"
+		"    -i,  --client-ilm-rate       ilm calls per second of each client, 0 for no limit \n"
+		"    -R,  --reject                Answer commands over the quotas with busy instead of deferring them \n"
+		"    -t,  --realtime              Lock the memory and fault it in, see the realtime init config \n"
+		"    -a,  --cpus                  CPUs of the main loop and I/O threads, e.g. 2,3 (real-time mode) \n"
+		"    -A,  --ilm-cpus              CPUs of the ilm threads, those of -a by default (real-time mode) \n"
+		"    -f,  --fifo                  SCHED_FIFO priority of all threads (real-time mode) \n");
 	exit(ret);
 }
 
+/* a number of at least 0, anything else is a usage error */
+static long parse_count(const char *arg)
+{
+	char *end;
+
+	errno = 0;
+	long value = strtol(arg, &end, 10);
+	if ((end == arg) || (*end != '\0') || (errno != 0) || (value < 0) ||
+	    (value > UINT_MAX)) {
+		fprintf(stderr, "error: invalid number %s\n", arg);
+		usage(EXIT_FAILURE);
+	}
+	return value;
+}
+
 static void parse_option(int argc, char *argv[])
 {
 	int opt;
+	uint64_t *cpus;
+	char *end;
 	static const struct option options[] = {
 		{ "help", no_argument, NULL, 'h' },
 		{ "path", optional_argument, NULL, 'c' },
+		{ "max-clients", required_argument, NULL, 'n' },
+		{ "parse-workers", required_argument, NULL, 'j' },
+		{ "client-rate", required_argument, NULL, 'r' },
+		{ "client-ilm-rate", required_argument, NULL, 'i' },
+		{ "reject", no_argument, NULL, 'R' },
+		{ "realtime", no_argument, NULL, 't' },
+		{ "cpus", required_argument, NULL, 'a' },
+		{ "ilm-cpus", required_argument, NULL, 'A' },
+		{ "fifo", required_argument, NULL, 'f' },
 		{ 0, 0, NULL, 0 }
 	};
 
 	while (1) {
-		opt = getopt_long(argc, argv, "hc:", options, NULL);
+		opt = getopt_long(argc, argv, "hc:n:j:r:i:Rta:A:f:", options, NULL);
 
 		if (opt == -1)
 			break;
@@ -158,6 +217,45 @@ static void parse_option(int argc, char *argv[])
 		case 'c':
 			json_cfg_path = optarg;
 			break;
+		case 'n':
+			max_clients = parse_count(optarg);
+			break;
+		case 'j':
+			parse_workers = parse_count(optarg);
+			break;
+		case 'r':
+			quota.commands = parse_count(optarg);
+			break;
+		case 'i':
+			quota.ilm_calls = parse_count(optarg);
+			break;
+		case 'R':
+			quota.reject = 1;
+			break;
+		case 't':
+			rt_option = 1;
+			break;
+		case 'a':
+		case 'A':
+			cpus = (opt == 'a') ? &rt_cpus : &rt_ilm_cpus;
+			if (realtime_parse_cpus(optarg, cpus) < 0) {
+				fprintf(stderr, "error: invalid CPU list %s\n",
+					optarg);
+				usage(EXIT_FAILURE);
+			}
+			rt_option = 1;
+			break;
+		case 'f':
+			rt_priority = strtol(optarg, &end, 10);
+			if ((end == optarg) || (*end != '\0') ||
+			    (rt_priority < sched_get_priority_min(SCHED_FIFO)) ||
+			    (rt_priority > sched_get_priority_max(SCHED_FIFO))) {
+				fprintf(stderr, "error: invalid priority %s\n",
+					optarg);
+				usage(EXIT_FAILURE);
+			}
+			rt_option = 1;
+			break;
 		default:
 			usage(EXIT_FAILURE);
 			break;
@@ -178,13 +276,61 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 	pipe_readfd = pipefd[0];
+
+	/* blocked before ilm starts its threads, received by signalfd */
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	/* the scene storage is preallocated before the memory is locked */
+	capacity_init(&capacity);
+	if (json_cfg_path &&
+	    (capacity_parse_config(json_cfg_path, &capacity) < 0)) {
+		return EXIT_FAILURE;
+	}
+	if (capacity.enabled) {
+		if (scene_set_limits(&capacity.scene) < 0) {
+			fprintf(stderr,
+				"error: bounded-memory mode cannot be set up\n");
+			return EXIT_FAILURE;
+		}
+		max_clients = (max_clients >= 0) ? max_clients : capacity.clients;
+	}
+
+	/* before ilm, whose threads inherit the settings */
+	realtime_init(&realtime);
+	if (json_cfg_path &&
+	    (realtime_parse_config(json_cfg_path, &realtime) < 0)) {
+		return EXIT_FAILURE;
+	}
+	realtime.enabled |= rt_option;
+	realtime.cpus = rt_cpus ? rt_cpus : realtime.cpus;
+	realtime.ilm_cpus = rt_ilm_cpus ? rt_ilm_cpus : realtime.ilm_cpus;
+	realtime.priority = (rt_priority >= 0) ? rt_priority :
+						 realtime.priority;
+	if (realtime_start(&realtime) < 0) {
+		fprintf(stderr, "error: real-time mode cannot be set up\n");
+		return EXIT_FAILURE;
+	}
+
 	wrap_ilm_init(pipefd[1]);
-	parser_init(json_cfg_path);
+	if (realtime_pin_loop(&realtime) < 0) {
+		fprintf(stderr, "error: real-time mode cannot be set up\n");
+		return EXIT_FAILURE;
+	}
+	if (parser_init(json_cfg_path) < 0) {
+		fprintf(stderr, "error: the scene cannot be set up\n");
+		return EXIT_FAILURE;
+	}
 
-	wait_event_loop();
+	int ret = wait_event_loop();
+	if (ret < 0) {
+		fprintf(stderr, "error: the event loop cannot be set up\n");
+	}
 
 	close(pipefd[0]);
 	close(pipefd[1]);
 
-	return EXIT_SUCCESS;
+	return (ret < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
 }
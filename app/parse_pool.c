@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/queue.h>
+
+#include "parse_pool.h"
+#include "stats.h"
+
+/* spare tasks kept for the next messages, and the largest copy they keep */
+#define SPARE_TASKS 256
+#define SPARE_MSG_SIZE 65536
+
+typedef struct _parse_task {
+	void *data;
+	char *msg;
+	unsigned int size;
+	unsigned int capacity;
+	int binary;
+
+	/* set by the worker */
+	parser_job_t *job;
+	int done;
+
+	/* all tasks in submission order, and the ones left to parse */
+	TAILQ_ENTRY(_parse_task) order;
+	TAILQ_ENTRY(_parse_task) todo;
+} parse_task_t;
+
+TAILQ_HEAD(task_head, _parse_task);
+
+/*
+ * The lists and the results of the tasks are shared with the workers
+ * under the lock. Only the submitting thread adds and removes tasks of the
+ * order list, so it may look at the list without the lock.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work = PTHREAD_COND_INITIALIZER;
+static struct task_head order = TAILQ_HEAD_INITIALIZER(order);
+static struct task_head todo = TAILQ_HEAD_INITIALIZER(todo);
+
+/* tasks handed back, reused by the submitting thread with their buffers */
+static struct task_head spare = TAILQ_HEAD_INITIALIZER(spare);
+static unsigned int nspare;
+
+static unsigned int nworkers;
+static parse_pool_done_t done_handler;
+static int ready_fd = -1;
+
+static parser_job_t *parse(const char *msg, unsigned int size, int binary)
+{
+	return binary ? parser_parse_binary_command(msg, size) :
+			parser_parse_command(msg, size);
+}
+
+/* on the submitting thread, in order */
+static void finish(void *data, parser_job_t *job)
+{
+	if (job) {
+		parser_finish_job(job);
+	}
+	done_handler(data, job);
+}
+
+static void *worker(void *arg)
+{
+	uint64_t one = 1;
+
+	(void)arg;
+	pthread_mutex_lock(&lock);
+	while (1) {
+		parse_task_t *task = TAILQ_FIRST(&todo);
+		if (task == NULL) {
+			pthread_cond_wait(&work, &lock);
+			continue;
+		}
+		TAILQ_REMOVE(&todo, task, todo);
+		pthread_mutex_unlock(&lock);
+
+		parser_job_t *job = parse(task->msg, task->size, task->binary);
+
+		pthread_mutex_lock(&lock);
+		task->job = job;
+		task->done = 1;
+
+		/* the jobs done behind the first one are handed back with it */
+		if ((task == TAILQ_FIRST(&order)) &&
+		    (write(ready_fd, &one, sizeof(one)) < 0)) {
+			fprintf(stderr, "%s(%d) ERROR: eventfd write: %s\n",
+				__func__, __LINE__, strerror(errno));
+		}
+	}
+
+	return NULL;
+}
+
+/* a spare task, cleared except for its buffer */
+static parse_task_t *get_task(void)
+{
+	parse_task_t *task = TAILQ_FIRST(&spare);
+	if (task == NULL) {
+		task = calloc(1, sizeof(*task));
+		if (task) {
+			stats_count_message_alloc();
+		}
+		return task;
+	}
+	TAILQ_REMOVE(&spare, task, order);
+	nspare--;
+
+	char *msg = task->msg;
+	unsigned int capacity = task->capacity;
+	memset(task, 0, sizeof(*task));
+	task->msg = msg;
+	task->capacity = capacity;
+	return task;
+}
+
+static void put_task(parse_task_t *task)
+{
+	if (nspare >= SPARE_TASKS) {
+		free(task->msg);
+		free(task);
+		return;
+	}
+	if (task->capacity > SPARE_MSG_SIZE) {
+		free(task->msg);
+		task->msg = NULL;
+		task->capacity = 0;
+	}
+	TAILQ_INSERT_HEAD(&spare, task, order);
+	nspare++;
+}
+
+/* the copy of the message, in the buffer of the task when it fits */
+static int copy_message(parse_task_t *task, const char *msg,
+			unsigned int size)
+{
+	if (size > task->capacity) {
+		free(task->msg);
+		task->capacity = 0;
+		task->msg = malloc(size);
+		if (task->msg == NULL) {
+			return -1;
+		}
+		stats_count_message_alloc();
+		task->capacity = size;
+	}
+	memcpy(task->msg, msg, size);
+	task->size = size;
+	return 0;
+}
+
+int parse_pool_init(unsigned int workers, parse_pool_done_t done)
+{
+	pthread_t thread;
+
+	done_handler = done;
+	if (workers > PARSE_POOL_MAX_WORKERS) {
+		workers = PARSE_POOL_MAX_WORKERS;
+	}
+	if (workers == 0) {
+		return 0;
+	}
+
+	ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ready_fd < 0) {
+		fprintf(stderr, "%s(%d) ERROR: eventfd: %s\n", __func__,
+			__LINE__, strerror(errno));
+		return -1;
+	}
+
+	while (nworkers < workers) {
+		if (pthread_create(&thread, NULL, worker, NULL) != 0) {
+			fprintf(stderr,
+				"%s(%d) ERROR: Only %u parse workers started\n",
+				__func__, __LINE__, nworkers);
+			break;
+		}
+		pthread_detach(thread);
+		nworkers++;
+	}
+
+	return 0;
+}
+
+int parse_pool_get_fd(void)
+{
+	return (nworkers > 0) ? ready_fd : -1;
+}
+
+void parse_pool_submit(void *data, const char *msg, unsigned int size,
+		       int binary, parser_job_t *job)
+{
+	/* nothing to wait for */
+	if (TAILQ_EMPTY(&order) &&
+	    ((msg == NULL) || (nworkers == 0) ||
+	     (size < PARSE_POOL_INLINE_SIZE))) {
+		finish(data, msg ? parse(msg, size, binary) : job);
+		return;
+	}
+
+	parse_task_t *task = get_task();
+	if (task == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Out of memory\n", __func__,
+			__LINE__);
+		parser_free_job(job);
+		done_handler(data, NULL);
+		return;
+	}
+	task->data = data;
+	task->job = job;
+	task->done = 1;
+	/* a message that cannot be copied fails in its turn */
+	if (msg && (copy_message(task, msg, size) == 0)) {
+		task->binary = binary;
+		task->done = 0;
+	}
+
+	pthread_mutex_lock(&lock);
+	TAILQ_INSERT_TAIL(&order, task, order);
+	if (!task->done) {
+		TAILQ_INSERT_TAIL(&todo, task, todo);
+		pthread_cond_signal(&work);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void parse_pool_dispatch(void)
+{
+	struct task_head ready = TAILQ_HEAD_INITIALIZER(ready);
+	parse_task_t *task;
+	uint64_t count;
+
+	if (read(ready_fd, &count, sizeof(count)) < 0) {
+		/* nothing new */
+	}
+
+	/* the leading tasks that are done, the others wait for their turn */
+	pthread_mutex_lock(&lock);
+	while (((task = TAILQ_FIRST(&order)) != NULL) && task->done) {
+		TAILQ_REMOVE(&order, task, order);
+		TAILQ_INSERT_TAIL(&ready, task, order);
+	}
+	pthread_mutex_unlock(&lock);
+
+	while ((task = TAILQ_FIRST(&ready)) != NULL) {
+		TAILQ_REMOVE(&ready, task, order);
+		finish(task->data, task->job);
+		put_task(task);
+	}
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __PARSE_POOL_H__
+#define __PARSE_POOL_H__
+
+#include <ilm/ilm_control.h>
+
+#include "comm_parser.h"
+
+/*
+ * Worker threads parsing messages into jobs for the thread that reads
+ * them. Parsing does not depend on the scene, so messages of different
+ * clients are parsed at the same time, and the jobs are handed back in the
+ * order the messages were submitted, after parser_finish_job. Small
+ * messages are parsed in place while nothing waits in the pool, where
+ * handing them over would cost more than parsing them.
+ */
+#define PARSE_POOL_MAX_WORKERS 16
+#define PARSE_POOL_INLINE_SIZE 512
+
+/* gets a job, or NULL when its message could not be parsed */
+typedef void (*parse_pool_done_t)(void *data, parser_job_t *job);
+
+/* without workers, every message is parsed in place */
+int parse_pool_init(unsigned int workers, parse_pool_done_t done);
+
+/* eventfd, readable when parsed jobs are ready */
+int parse_pool_get_fd(void);
+
+/*
+ * the message is copied, and passed to done with data once parsed; with
+ * msg NULL, job is passed as it is, behind the messages before it
+ */
+void parse_pool_submit(void *data, const char *msg, unsigned int size,
+		       int binary, parser_job_t *job);
+
+/* hands the jobs that are ready, in order, to done */
+void parse_pool_dispatch(void);
+
+#endif //__PARSE_POOL_H__
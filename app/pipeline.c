@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <ilm/ilm_control.h>
+
+#include "pipeline.h"
+#include "spsc_queue.h"
+#include "stats.h"
+
+/* items handled in a row before the thread's other sources get a turn */
+#define PIPELINE_BATCH 64
+
+TAILQ_HEAD(item_head, _pipeline_item);
+
+/* state of one thread */
+typedef struct _pipeline_thread {
+	/* items for this thread by class, and its eventfd */
+	spsc_queue_t inbox[COMM_PRIORITIES];
+	int fd;
+
+	/* items this thread could not send yet, only seen by this thread */
+	struct item_head backlog[COMM_PRIORITIES];
+	unsigned int nbacklog[COMM_PRIORITIES];
+
+	/* set by this thread when it has a backlog, cleared by the other */
+	int blocked;
+} pipeline_thread_t;
+
+static pipeline_thread_t threads[2];
+
+int pipeline_init(void)
+{
+	int i, class;
+
+	for (i = 0; i < 2; i++) {
+		for (class = 0; class < COMM_PRIORITIES; class++) {
+			if (spsc_queue_init(&threads[i].inbox[class],
+					    PIPELINE_QUEUE_SIZE) < 0) {
+				return -1;
+			}
+			TAILQ_INIT(&threads[i].backlog[class]);
+		}
+		threads[i].fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (threads[i].fd < 0) {
+			fprintf(stderr, "%s(%d) ERROR: eventfd: %s\n", __func__,
+				__LINE__, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int pipeline_get_fd(int thread)
+{
+	return threads[thread].fd;
+}
+
+static void wake(int thread)
+{
+	uint64_t one = 1;
+
+	if (write(threads[thread].fd, &one, sizeof(one)) < 0) {
+		fprintf(stderr, "%s(%d) ERROR: eventfd write: %s\n", __func__,
+			__LINE__, strerror(errno));
+	}
+}
+
+/* the I/O thread gets everything in one queue */
+static int item_class(int thread, const pipeline_item_t *item)
+{
+	return (thread == PIPELINE_IO) ? item->priority : 0;
+}
+
+static int push_item(int thread, pipeline_item_t *item)
+{
+	int other = !thread;
+
+	int depth = spsc_queue_push(
+		&threads[other].inbox[item_class(thread, item)], item);
+	if (depth < 0) {
+		return -1;
+	}
+	stats_add_queue_depth(other, depth);
+
+	/* only the first item of a queue may find the other thread asleep */
+	if (depth == 1) {
+		wake(other);
+	}
+	return 0;
+}
+
+/*
+ * The flag is set before trying again: either the try finds the room the
+ * other thread made, or the other thread sees the flag once it makes room
+ * and wakes this one up.
+ */
+static void flush_class(int thread, int class)
+{
+	pipeline_thread_t *self = &threads[thread];
+	pipeline_item_t *item;
+
+	while ((item = TAILQ_FIRST(&self->backlog[class])) != NULL) {
+		if (push_item(thread, item) < 0) {
+			if (__atomic_load_n(&self->blocked, __ATOMIC_SEQ_CST)) {
+				return;
+			}
+			__atomic_store_n(&self->blocked, 1, __ATOMIC_SEQ_CST);
+			continue;
+		}
+		TAILQ_REMOVE(&self->backlog[class], item, entry);
+		self->nbacklog[class]--;
+	}
+}
+
+static void flush_backlog(int thread)
+{
+	int class;
+
+	for (class = 0; class < COMM_PRIORITIES; class++) {
+		flush_class(thread, class);
+	}
+}
+
+void pipeline_send(int thread, pipeline_item_t *item)
+{
+	pipeline_thread_t *self = &threads[thread];
+	int class = item_class(thread, item);
+
+	/* items behind a backlog wait there, to keep their order */
+	if ((self->nbacklog[class] == 0) && (push_item(thread, item) == 0)) {
+		return;
+	}
+
+	TAILQ_INSERT_TAIL(&self->backlog[class], item, entry);
+	self->nbacklog[class]++;
+	stats_add_backlog(thread, self->nbacklog[class]);
+	flush_class(thread, class);
+}
+
+/* the next item of the most urgent class */
+static pipeline_item_t *pop_item(pipeline_thread_t *self)
+{
+	pipeline_item_t *item;
+	int class;
+
+	for (class = 0; class < COMM_PRIORITIES; class++) {
+		item = spsc_queue_pop(&self->inbox[class]);
+		if (item) {
+			return item;
+		}
+	}
+	return NULL;
+}
+
+pipeline_item_t *pipeline_take_next(int thread, const pipeline_item_t *item,
+				    pipeline_match_t match)
+{
+	spsc_queue_t *inbox = &threads[thread].inbox[item_class(!thread, item)];
+	pipeline_item_t *next = spsc_queue_peek(inbox);
+
+	if ((next == NULL) || !match(next)) {
+		return NULL;
+	}
+	return spsc_queue_pop(inbox);
+}
+
+void pipeline_dispatch(int thread, pipeline_handler_t handler)
+{
+	pipeline_thread_t *self = &threads[thread];
+	pipeline_item_t *item = NULL;
+	uint64_t count;
+	int n;
+
+	if (read(self->fd, &count, sizeof(count)) < 0) {
+		/* woken up for items left over by the previous batch */
+	}
+
+	/* the other thread may have made room for the backlog */
+	flush_backlog(thread);
+
+	for (n = 0; n < PIPELINE_BATCH; n++) {
+		item = pop_item(self);
+		if (item == NULL) {
+			break;
+		}
+		handler(item);
+	}
+
+	if (__atomic_load_n(&threads[!thread].blocked, __ATOMIC_SEQ_CST) &&
+	    __atomic_exchange_n(&threads[!thread].blocked, 0,
+				__ATOMIC_SEQ_CST)) {
+		wake(!thread);
+	}
+
+	/* more to do, after the other sources of the loop */
+	if (item != NULL) {
+		wake(thread);
+	}
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+#include "comm_event.h"
+#include "comm_json.h"
+#include "comm_parser.h"
+
+/*
+ * Items passed between the I/O thread, which serves the clients and parses
+ * their messages into jobs, and the apply thread, which owns the scene and
+ * the ilm connection and applies the jobs. Each direction is a lock-free
+ * single producer, single consumer queue, and each thread has an eventfd
+ * that is written when items arrive for it. A thread never waits for the
+ * other one: when the queue is full, its items are kept in order in a
+ * backlog, and the other thread wakes it up once it made room.
+ *
+ * Items for the apply thread go to one queue per priority class, and the
+ * apply thread always takes the next item from the most urgent class that
+ * has one: a critical command waits for the one being applied, not for
+ * the background commands queued before it. Items of one class keep their
+ * order. Items for the I/O thread all share one queue.
+ */
+#define PIPELINE_IO 0
+#define PIPELINE_APPLY 1
+
+/* room for the items in each direction */
+#define PIPELINE_QUEUE_SIZE 1024
+
+/* item kinds */
+#define PIPELINE_COMMAND 0 /* message of a client, answered with the result */
+#define PIPELINE_RECORDS 1 /* ring records, not answered */
+#define PIPELINE_COMPLETION 2 /* deferred command applied */
+#define PIPELINE_EVENT 3 /* event for the subscribers */
+#define PIPELINE_CLIENTS 4 /* prints the counters of the clients */
+
+typedef struct _pipeline_item {
+	int kind;
+
+	/* client id << 32 | request id, and if the result may be deferred */
+	uint64_t tag;
+	int deferrable;
+
+	/* COMM_PRIORITY_* class, of items for the apply thread */
+	int priority;
+
+	/* in: the parsed job, out: its result and reply */
+	parser_job_t *job;
+	int result;
+	parser_reply_t reply;
+
+	/* bytes of the message, and the ilm calls its job made */
+	unsigned int size;
+	unsigned int ilm_calls;
+
+	comm_event_t event;
+
+	/* time the job was applied, see stats_add_stage */
+	uint64_t applied_ns;
+
+	TAILQ_ENTRY(_pipeline_item) entry;
+} pipeline_item_t;
+
+typedef void (*pipeline_handler_t)(pipeline_item_t *item);
+
+int pipeline_init(void);
+
+/* eventfd of a thread, readable when items wait for it */
+int pipeline_get_fd(int thread);
+
+/* sends an item from thread to the other one */
+void pipeline_send(int thread, pipeline_item_t *item);
+
+/* hands the items waiting for thread to handler, which owns them */
+void pipeline_dispatch(int thread, pipeline_handler_t handler);
+
+/*
+ * from a handler: takes the item queued right behind item, in its class,
+ * when match accepts it
+ */
+typedef int (*pipeline_match_t)(const pipeline_item_t *item);
+pipeline_item_t *pipeline_take_next(int thread, const pipeline_item_t *item,
+				    pipeline_match_t match);
+
+#endif //__PIPELINE_H__
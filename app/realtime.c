@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <jansson.h>
+
+#include "realtime.h"
+
+#define JSON_KEY_REALTIME "realtime"
+
+void realtime_init(realtime_t *rt)
+{
+	memset(rt, 0, sizeof(*rt));
+	rt->heap = REALTIME_DEFAULT_HEAP;
+	rt->stack = REALTIME_DEFAULT_STACK;
+}
+
+static int parse_cpu_array(json_t *array, uint64_t *cpus)
+{
+	json_t *value;
+	size_t idx;
+
+	if (!json_is_array(array)) {
+		return -1;
+	}
+	*cpus = 0;
+	json_array_foreach(array, idx, value)
+	{
+		if (!json_is_integer(value) || (json_integer_value(value) < 0) ||
+		    (json_integer_value(value) >= REALTIME_MAX_CPUS)) {
+			return -1;
+		}
+		*cpus |= 1ULL << json_integer_value(value);
+	}
+	return 0;
+}
+
+static int parse_size(json_t *value, size_t *size)
+{
+	if (!json_is_integer(value) || (json_integer_value(value) < 0)) {
+		return -1;
+	}
+	*size = json_integer_value(value);
+	return 0;
+}
+
+int realtime_parse_config(const char *path, realtime_t *rt)
+{
+	json_error_t jerror;
+	json_t *value;
+	int ret = 0;
+
+	json_t *root = json_load_file(path, 0, &jerror);
+	if (root == NULL) {
+		/* reported when the layout is read */
+		return 0;
+	}
+
+	json_t *config = json_object_get(root, JSON_KEY_REALTIME);
+	if ((config == NULL) || json_is_false(config)) {
+		json_decref(root);
+		return 0;
+	}
+	rt->enabled = 1;
+	if (json_is_true(config)) {
+		json_decref(root);
+		return 0;
+	}
+	if (!json_is_object(config)) {
+		ret = -1;
+	}
+
+	if ((ret == 0) && (value = json_object_get(config, "cpus"))) {
+		ret = parse_cpu_array(value, &rt->cpus);
+	}
+	if ((ret == 0) && (value = json_object_get(config, "ilm_cpus"))) {
+		ret = parse_cpu_array(value, &rt->ilm_cpus);
+	}
+	if ((ret == 0) && (value = json_object_get(config, "priority"))) {
+		ret = json_is_integer(value) ? 0 : -1;
+		rt->priority = json_integer_value(value);
+	}
+	if ((ret == 0) && (value = json_object_get(config, "heap"))) {
+		ret = parse_size(value, &rt->heap);
+	}
+	if ((ret == 0) && (value = json_object_get(config, "stack"))) {
+		ret = parse_size(value, &rt->stack);
+	}
+	if (ret < 0) {
+		fprintf(stderr, "%s(%d) ERROR: Invalid %s in %s\n", __func__,
+			__LINE__, JSON_KEY_REALTIME, path);
+	}
+
+	json_decref(root);
+	return ret;
+}
+
+int realtime_parse_cpus(const char *list, uint64_t *cpus)
+{
+	const char *p = list;
+	char *end;
+
+	*cpus = 0;
+	while (*p) {
+		unsigned long first = strtoul(p, &end, 10);
+		unsigned long last = first;
+		if (end == p) {
+			return -1;
+		}
+		p = end;
+		if (*p == '-') {
+			last = strtoul(++p, &end, 10);
+			if (end == p) {
+				return -1;
+			}
+			p = end;
+		}
+		if ((first > last) || (last >= REALTIME_MAX_CPUS)) {
+			return -1;
+		}
+		for (; first <= last; first++) {
+			*cpus |= 1ULL << first;
+		}
+		if (*p == ',') {
+			p++;
+		} else if (*p) {
+			return -1;
+		}
+	}
+
+	return (*cpus != 0) ? 0 : -1;
+}
+
+/* the pages stay with the process: the heap is never trimmed */
+static int prefault_heap(size_t size)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	char *heap = malloc(size);
+	if (heap == NULL) {
+		return -1;
+	}
+	for (i = 0; i < size; i += page) {
+		heap[i] = 0;
+	}
+	free(heap);
+
+	return 0;
+}
+
+/* left below the stack limit for what is already on the stack */
+#define STACK_HEADROOM (256 * 1024)
+
+static int check_stack(size_t size)
+{
+	struct rlimit limit;
+
+	if ((getrlimit(RLIMIT_STACK, &limit) == 0) &&
+	    (limit.rlim_cur != RLIM_INFINITY) &&
+	    ((limit.rlim_cur < STACK_HEADROOM) ||
+	     (size > limit.rlim_cur - STACK_HEADROOM))) {
+		fprintf(stderr,
+			"%s(%d) ERROR: %zu bytes of stack do not fit the limit of %llu\n",
+			__func__, __LINE__, size,
+			(unsigned long long)limit.rlim_cur);
+		return -1;
+	}
+	return 0;
+}
+
+static __attribute__((noinline)) void prefault_stack(size_t size)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	volatile char *stack = alloca(size);
+	size_t i;
+
+	for (i = 0; i < size; i += page) {
+		stack[i] = 0;
+	}
+}
+
+/* of the calling thread, and of the threads it starts from now on */
+static int set_cpus(uint64_t cpus)
+{
+	cpu_set_t allowed, set;
+	unsigned int i;
+
+	if (pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) !=
+	    0) {
+		CPU_ZERO(&allowed);
+	}
+
+	CPU_ZERO(&set);
+	for (i = 0; i < REALTIME_MAX_CPUS; i++) {
+		if ((cpus & (1ULL << i)) == 0) {
+			continue;
+		}
+		if (!CPU_ISSET(i, &allowed)) {
+			fprintf(stderr, "%s(%d) ERROR: CPU %u is not available\n",
+				__func__, __LINE__, i);
+			return -1;
+		}
+		CPU_SET(i, &set);
+	}
+
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err != 0) {
+		fprintf(stderr, "%s(%d) ERROR: Cannot set the CPUs: %s\n",
+			__func__, __LINE__, strerror(err));
+		return -1;
+	}
+	return 0;
+}
+
+int realtime_start(const realtime_t *rt)
+{
+	if (!rt->enabled) {
+		return 0;
+	}
+
+	/*
+	 * every thread allocates from the main arena, which keeps its
+	 * pages, large blocks included
+	 */
+	mallopt(M_ARENA_MAX, 1);
+	mallopt(M_MMAP_MAX, 0);
+	mallopt(M_TRIM_THRESHOLD, -1);
+
+	if (check_stack(rt->stack) < 0) {
+		return -1;
+	}
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		fprintf(stderr, "%s(%d) ERROR: Cannot lock the memory: %s\n",
+			__func__, __LINE__, strerror(errno));
+		return -1;
+	}
+	if (prefault_heap(rt->heap) < 0) {
+		fprintf(stderr, "%s(%d) ERROR: Cannot fault in %zu bytes of heap\n",
+			__func__, __LINE__, rt->heap);
+		return -1;
+	}
+	prefault_stack(rt->stack);
+
+	if (rt->priority != 0) {
+		struct sched_param param = { 0 };
+		param.sched_priority = rt->priority;
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO,
+						&param);
+		if (err != 0) {
+			fprintf(stderr,
+				"%s(%d) ERROR: Cannot run under SCHED_FIFO at %d: %s\n",
+				__func__, __LINE__, rt->priority, strerror(err));
+			return -1;
+		}
+	}
+
+	/* the threads ilm starts next take them over */
+	uint64_t cpus = rt->ilm_cpus ? rt->ilm_cpus : rt->cpus;
+	return cpus ? set_cpus(cpus) : 0;
+}
+
+int realtime_pin_loop(const realtime_t *rt)
+{
+	if (!rt->enabled || (rt->cpus == 0)) {
+		return 0;
+	}
+	return set_cpus(rt->cpus);
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Real-time mode, off unless asked for on the command line or by a
+ * "realtime" object in the init config, e.g.
+ *   "realtime": { "cpus": [2], "ilm_cpus": [3], "priority": 50,
+ *                 "heap": 8388608, "stack": 524288 }
+ *
+ * All memory is locked and the heap and stack given are faulted in up
+ * front, so no page fault happens on the command path. The threads run
+ * under SCHED_FIFO at priority when it is not 0. The threads ilm starts
+ * are pinned to ilm_cpus (cpus when empty), the main loop, I/O and parse
+ * threads to cpus; an empty set leaves the threads where they are.
+ */
+typedef struct _realtime {
+	int enabled;
+	int priority;
+	/* bit n for CPU n */
+	uint64_t cpus;
+	uint64_t ilm_cpus;
+	size_t heap;
+	size_t stack;
+} realtime_t;
+
+#define REALTIME_MAX_CPUS 64
+
+#define REALTIME_DEFAULT_HEAP (8 * 1024 * 1024)
+#define REALTIME_DEFAULT_STACK (512 * 1024)
+
+void realtime_init(realtime_t *rt);
+
+/* the "realtime" object of the init config, if any; -1 on a bad setting */
+int realtime_parse_config(const char *path, realtime_t *rt);
+
+/* a list of CPUs such as "2,3" or "0-3" */
+int realtime_parse_cpus(const char *list, uint64_t *cpus);
+
+/*
+ * Before ilm is initialized: locks the memory, sets the scheduling and
+ * the CPUs of the threads ilm is about to start. -1 with a message when a
+ * setting cannot be applied.
+ */
+int realtime_start(const realtime_t *rt);
+
+/* after ilm is initialized, before the other threads are started */
+int realtime_pin_loop(const realtime_t *rt);
+
+#endif //__REALTIME_H__
@@ -0,0 +1,772 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scene.h"
+
+/*
+ * Bounded storage. A pool is one block of elements, each a node followed
+ * by its table, handed out through a free list. Without limits the pools
+ * stay empty and nodes and tables are allocated one by one.
+ */
+typedef struct _pool {
+	const char *name;
+	char *mem;
+	size_t node_size; /* where the table starts */
+	size_t size;
+	void *free;
+} pool_t;
+
+#define POOL_ALIGN 16
+
+/* the committed version and the draft made from it */
+#define SCENE_VERSIONS 2
+
+static scene_limits_t limits;
+static pool_t scene_pool, screen_pool, layer_pool, surface_pool;
+
+static size_t pool_round(size_t size)
+{
+	return (size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+}
+
+static int pool_init(pool_t *pool, const char *name, size_t node,
+		     size_t table, unsigned int count)
+{
+	unsigned int i;
+
+	pool->name = name;
+	pool->node_size = pool_round(node);
+	pool->size = pool_round(pool->node_size + table);
+	pool->mem = calloc(count, pool->size);
+	if (pool->mem == NULL) {
+		return -1;
+	}
+	for (i = count; i > 0; i--) {
+		void **elm = (void **)&pool->mem[(i - 1) * pool->size];
+		*elm = pool->free;
+		pool->free = elm;
+	}
+	return 0;
+}
+
+static int bounded(void)
+{
+	return scene_pool.mem != NULL;
+}
+
+/* a zeroed node, NULL once the pool is used up */
+static void *node_alloc(pool_t *pool, size_t size)
+{
+	void *node;
+
+	if (pool->mem == NULL) {
+		return calloc(1, size);
+	}
+	node = pool->free;
+	if (node == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: No %s left\n", __func__,
+			__LINE__, pool->name);
+		return NULL;
+	}
+	pool->free = *(void **)node;
+	memset(node, 0, size);
+	return node;
+}
+
+/* the table preallocated with a node, NULL when unbounded */
+static void *node_table(const pool_t *pool, void *node)
+{
+	return pool->mem ? (char *)node + pool->node_size : NULL;
+}
+
+static void node_free(pool_t *pool, void *node, void *table)
+{
+	if (pool->mem == NULL) {
+		free(table);
+		free(node);
+		return;
+	}
+	*(void **)node = pool->free;
+	pool->free = node;
+}
+
+/* a draft going over the limits fails, and with it the command */
+static int capacity_reached(unsigned int count, unsigned int capacity,
+			    const char *what)
+{
+	if (bounded() && (count >= capacity)) {
+		fprintf(stderr, "%s(%d) ERROR: Capacity of %u %s reached\n",
+			__func__, __LINE__, capacity, what);
+		return 1;
+	}
+	return 0;
+}
+
+/* bounded tables have room for their capacity, checked beforehand */
+static int array_insert(void **array, unsigned int *count, size_t size,
+			unsigned int pos, const void *elm)
+{
+	char *p = bounded() ? *array : realloc(*array, (*count + 1) * size);
+	if (p == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Out of memory\n", __func__,
+			__LINE__);
+		return -1;
+	}
+	memmove(p + (pos + 1) * size, p + pos * size, (*count - pos) * size);
+	memcpy(p + pos * size, elm, size);
+	*array = p;
+	(*count)++;
+	return 0;
+}
+
+static void array_remove(void *array, unsigned int *count, size_t size,
+			 unsigned int pos)
+{
+	char *p = array;
+	memmove(p + pos * size, p + (pos + 1) * size,
+		(*count - pos - 1) * size);
+	(*count)--;
+}
+
+static void *array_dup(const void *array, unsigned int count, size_t size)
+{
+	void *p;
+
+	if (count == 0) {
+		return NULL;
+	}
+	p = malloc(count * size);
+	if (p) {
+		memcpy(p, array, count * size);
+	}
+	return p;
+}
+
+/* the table of a copied node, in its own preallocated table when bounded */
+static void *table_dup(const pool_t *pool, void *node, const void *array,
+		       unsigned int count, size_t size)
+{
+	void *table = node_table(pool, node);
+	if (table == NULL) {
+		return array_dup(array, count, size);
+	}
+	memcpy(table, array, count * size);
+	return table;
+}
+
+/* position for insert_info among count ids, the reference id is at ref */
+static unsigned int insert_position(insert_info_t insert_info,
+				    unsigned int count, int ref)
+{
+	switch (insert_info.order) {
+	case INSERT_ORDER_PREPEND:
+		return 0;
+	case INSERT_ORDER_BEFORE:
+		return (ref < 0) ? count : ref;
+	case INSERT_ORDER_AFTER:
+		return (ref < 0) ? count : ref + 1;
+	default:
+		return count;
+	}
+}
+
+static void layer_release(scene_layer_t *layer)
+{
+	if (--layer->refcnt == 0) {
+		node_free(&layer_pool, layer, layer->surfaces);
+	}
+}
+
+static void screen_release(scene_screen_t *screen)
+{
+	unsigned int i;
+
+	if (--screen->refcnt == 0) {
+		for (i = 0; i < screen->nlayers; i++) {
+			layer_release(screen->layers[i]);
+		}
+		node_free(&screen_pool, screen, screen->layers);
+	}
+}
+
+static void surface_release(scene_surface_t *surface)
+{
+	if (--surface->refcnt == 0) {
+		node_free(&surface_pool, surface, NULL);
+	}
+}
+
+static int screen_index(const scene_t *scene, t_ilm_uint id)
+{
+	unsigned int i;
+
+	for (i = 0; i < scene->nscreens; i++) {
+		if (scene->screens[i]->id == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int layer_index(const scene_screen_t *screen, t_ilm_uint id)
+{
+	unsigned int i;
+
+	for (i = 0; i < screen->nlayers; i++) {
+		if (screen->layers[i]->id == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int surface_index(const scene_layer_t *layer, t_ilm_uint id)
+{
+	unsigned int i;
+
+	for (i = 0; i < layer->nsurfaces; i++) {
+		if (layer->surfaces[i] == id) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* index of id in the surface table, or where it would be inserted */
+static unsigned int surface_table_search(const scene_t *scene, t_ilm_uint id,
+					 int *found)
+{
+	unsigned int lo = 0, hi = scene->nsurfaces;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+		if (scene->surfaces[mid]->id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*found = (lo < scene->nsurfaces) && (scene->surfaces[lo]->id == id);
+	return lo;
+}
+
+static int find_layer(const scene_t *scene, t_ilm_uint id, int *layer_idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < scene->nscreens; i++) {
+		*layer_idx = layer_index(scene->screens[i], id);
+		if (*layer_idx >= 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * A node referred only by the draft is modified in place, a shared one is
+ * copied first and the copy replaces it in the draft.
+ */
+static scene_screen_t *screen_writable(scene_t *scene, unsigned int idx)
+{
+	scene_screen_t *screen = scene->screens[idx];
+	scene_screen_t *copy;
+	unsigned int i;
+
+	if (screen->refcnt == 1) {
+		return screen;
+	}
+
+	copy = node_alloc(&screen_pool, sizeof(*copy));
+	if (copy == NULL) {
+		return NULL;
+	}
+	*copy = *screen;
+	copy->refcnt = 1;
+	copy->layers = table_dup(&screen_pool, copy, screen->layers,
+				 screen->nlayers, sizeof(*screen->layers));
+	if ((copy->layers == NULL) && (screen->nlayers > 0)) {
+		node_free(&screen_pool, copy, NULL);
+		return NULL;
+	}
+	for (i = 0; i < copy->nlayers; i++) {
+		copy->layers[i]->refcnt++;
+	}
+
+	screen->refcnt--;
+	scene->screens[idx] = copy;
+	return copy;
+}
+
+static scene_layer_t *layer_writable(scene_screen_t *screen, unsigned int idx)
+{
+	scene_layer_t *layer = screen->layers[idx];
+	scene_layer_t *copy;
+
+	if (layer->refcnt == 1) {
+		return layer;
+	}
+
+	copy = node_alloc(&layer_pool, sizeof(*copy));
+	if (copy == NULL) {
+		return NULL;
+	}
+	*copy = *layer;
+	copy->refcnt = 1;
+	copy->surfaces = table_dup(&layer_pool, copy, layer->surfaces,
+				   layer->nsurfaces, sizeof(*layer->surfaces));
+	if ((copy->surfaces == NULL) && (layer->nsurfaces > 0)) {
+		node_free(&layer_pool, copy, NULL);
+		return NULL;
+	}
+
+	layer->refcnt--;
+	screen->layers[idx] = copy;
+	return copy;
+}
+
+static scene_surface_t *surface_writable(scene_t *scene, unsigned int idx)
+{
+	scene_surface_t *surface = scene->surfaces[idx];
+	scene_surface_t *copy;
+
+	if (surface->refcnt == 1) {
+		return surface;
+	}
+
+	copy = node_alloc(&surface_pool, sizeof(*copy));
+	if (copy == NULL) {
+		return NULL;
+	}
+	*copy = *surface;
+	copy->refcnt = 1;
+
+	surface->refcnt--;
+	scene->surfaces[idx] = copy;
+	return copy;
+}
+
+/* writable path down to a layer */
+static scene_layer_t *layer_writable_by_id(scene_t *scene, t_ilm_uint id)
+{
+	int layer_idx;
+	int screen_idx = find_layer(scene, id, &layer_idx);
+	if (screen_idx < 0) {
+		return NULL;
+	}
+
+	scene_screen_t *screen = screen_writable(scene, screen_idx);
+	if (screen == NULL) {
+		return NULL;
+	}
+	return layer_writable(screen, layer_idx);
+}
+
+/* takes the layer out of its screen, the caller owns the reference */
+static scene_layer_t *pop_layer(scene_t *scene, t_ilm_uint id)
+{
+	int layer_idx;
+	int screen_idx = find_layer(scene, id, &layer_idx);
+	if (screen_idx < 0) {
+		return NULL;
+	}
+
+	scene_screen_t *screen = screen_writable(scene, screen_idx);
+	if (screen == NULL) {
+		return NULL;
+	}
+	scene_layer_t *layer = screen->layers[layer_idx];
+	array_remove(screen->layers, &screen->nlayers, sizeof(*screen->layers),
+		     layer_idx);
+	return layer;
+}
+
+/* a layer refers to the surface one more time */
+static surface_properties_t *refer_surface(scene_t *scene, t_ilm_uint id,
+					   int new_reference)
+{
+	scene_surface_t *surface;
+	int found;
+	unsigned int idx = surface_table_search(scene, id, &found);
+
+	if (!found) {
+		if (capacity_reached(scene->nsurfaces,
+				     limits.layers * limits.surfaces_per_layer,
+				     "surfaces")) {
+			return NULL;
+		}
+		surface = node_alloc(&surface_pool, sizeof(*surface));
+		if (surface == NULL) {
+			return NULL;
+		}
+		surface->refcnt = 1;
+		surface->id = id;
+		if (array_insert((void **)&scene->surfaces, &scene->nsurfaces,
+				 sizeof(*scene->surfaces), idx, &surface) < 0) {
+			node_free(&surface_pool, surface, NULL);
+			return NULL;
+		}
+	}
+
+	surface = surface_writable(scene, idx);
+	if (surface == NULL) {
+		return NULL;
+	}
+	if (new_reference) {
+		surface->prop.referred_cnt++;
+	}
+	return &surface->prop;
+}
+
+/* a layer no longer refers to the surface */
+static void unrefer_surface(scene_t *scene, t_ilm_uint id)
+{
+	int found;
+	unsigned int idx = surface_table_search(scene, id, &found);
+	if (!found) {
+		return;
+	}
+
+	if (scene->surfaces[idx]->prop.referred_cnt <= 1) {
+		surface_release(scene->surfaces[idx]);
+		array_remove(scene->surfaces, &scene->nsurfaces,
+			     sizeof(*scene->surfaces), idx);
+		return;
+	}
+
+	scene_surface_t *surface = surface_writable(scene, idx);
+	if (surface) {
+		surface->prop.referred_cnt--;
+	}
+}
+
+int scene_set_limits(const scene_limits_t *l)
+{
+	unsigned int surfaces = l->layers * l->surfaces_per_layer;
+
+	limits = *l;
+	if ((pool_init(&scene_pool, "scene versions", sizeof(scene_t),
+		       (l->screens + surfaces) * sizeof(void *),
+		       SCENE_VERSIONS) < 0) ||
+	    (pool_init(&screen_pool, "screens", sizeof(scene_screen_t),
+		       l->layers * sizeof(scene_layer_t *),
+		       SCENE_VERSIONS * l->screens) < 0) ||
+	    (pool_init(&layer_pool, "layers", sizeof(scene_layer_t),
+		       l->surfaces_per_layer * sizeof(t_ilm_uint),
+		       SCENE_VERSIONS * l->layers) < 0) ||
+	    (pool_init(&surface_pool, "surfaces", sizeof(scene_surface_t), 0,
+		       SCENE_VERSIONS * surfaces) < 0)) {
+		fprintf(stderr, "%s(%d) ERROR: Out of memory\n", __func__,
+			__LINE__);
+		return -1;
+	}
+	return 0;
+}
+
+const scene_limits_t *scene_get_limits(void)
+{
+	return &limits;
+}
+
+scene_t *scene_new(void)
+{
+	scene_t *scene = node_alloc(&scene_pool, sizeof(*scene));
+	if (scene) {
+		scene->refcnt = 1;
+		scene->screens = node_table(&scene_pool, scene);
+		if (scene->screens) {
+			scene->surfaces = (scene_surface_t **)&scene
+						  ->screens[limits.screens];
+		}
+	}
+	return scene;
+}
+
+scene_t *scene_begin(scene_t *base)
+{
+	scene_t *scene;
+	unsigned int i;
+
+	scene = scene_new();
+	if (scene == NULL) {
+		return NULL;
+	}
+	scene->refcnt = 1;
+	scene->version = base->version + 1;
+
+	if (bounded()) {
+		memcpy(scene->screens, base->screens,
+		       base->nscreens * sizeof(*base->screens));
+		memcpy(scene->surfaces, base->surfaces,
+		       base->nsurfaces * sizeof(*base->surfaces));
+	} else {
+		scene->screens = array_dup(base->screens, base->nscreens,
+					   sizeof(*base->screens));
+		scene->surfaces = array_dup(base->surfaces, base->nsurfaces,
+					    sizeof(*base->surfaces));
+	}
+	if (((scene->screens == NULL) && (base->nscreens > 0)) ||
+	    ((scene->surfaces == NULL) && (base->nsurfaces > 0))) {
+		scene_release(scene);
+		return NULL;
+	}
+
+	scene->nscreens = base->nscreens;
+	for (i = 0; i < scene->nscreens; i++) {
+		scene->screens[i]->refcnt++;
+	}
+	scene->nsurfaces = base->nsurfaces;
+	for (i = 0; i < scene->nsurfaces; i++) {
+		scene->surfaces[i]->refcnt++;
+	}
+	scene->nlayers = base->nlayers;
+
+	return scene;
+}
+
+void scene_release(scene_t *scene)
+{
+	if ((scene == NULL) || (--scene->refcnt > 0)) {
+		return;
+	}
+
+	scene_clear(scene);
+	node_free(&scene_pool, scene, NULL);
+}
+
+scene_screen_t *scene_get_screen(const scene_t *scene, t_ilm_uint id)
+{
+	int idx = screen_index(scene, id);
+	return (idx < 0) ? NULL : scene->screens[idx];
+}
+
+scene_layer_t *scene_get_layer(const scene_t *scene, t_ilm_uint id)
+{
+	int layer_idx;
+	int screen_idx = find_layer(scene, id, &layer_idx);
+	if (screen_idx < 0) {
+		return NULL;
+	}
+	return scene->screens[screen_idx]->layers[layer_idx];
+}
+
+scene_surface_t *scene_get_surface(const scene_t *scene, t_ilm_uint id)
+{
+	int found;
+	unsigned int idx = surface_table_search(scene, id, &found);
+	return found ? scene->surfaces[idx] : NULL;
+}
+
+int scene_layer_has_surface(const scene_layer_t *layer, t_ilm_uint id)
+{
+	return surface_index(layer, id) >= 0;
+}
+
+void scene_clear(scene_t *scene)
+{
+	unsigned int i;
+
+	for (i = 0; i < scene->nscreens; i++) {
+		screen_release(scene->screens[i]);
+	}
+	scene->nscreens = 0;
+	scene->nlayers = 0;
+
+	for (i = 0; i < scene->nsurfaces; i++) {
+		surface_release(scene->surfaces[i]);
+	}
+	scene->nsurfaces = 0;
+
+	/* bounded tables belong to the scene node */
+	if (!bounded()) {
+		free(scene->screens);
+		scene->screens = NULL;
+		free(scene->surfaces);
+		scene->surfaces = NULL;
+	}
+}
+
+int scene_add_screen(scene_t *scene, t_ilm_uint id)
+{
+	scene_screen_t *screen;
+
+	if (screen_index(scene, id) >= 0) {
+		return 0;
+	}
+	if (capacity_reached(scene->nscreens, limits.screens, "screens")) {
+		return -1;
+	}
+
+	screen = node_alloc(&screen_pool, sizeof(*screen));
+	if (screen == NULL) {
+		return -1;
+	}
+	screen->refcnt = 1;
+	screen->id = id;
+	screen->layers = node_table(&screen_pool, screen);
+
+	if (array_insert((void **)&scene->screens, &scene->nscreens,
+			 sizeof(*scene->screens), scene->nscreens,
+			 &screen) < 0) {
+		node_free(&screen_pool, screen, NULL);
+		return -1;
+	}
+	return 0;
+}
+
+layer_properties_t *scene_set_layer(scene_t *scene, t_ilm_uint screen_id,
+				    t_ilm_uint layer_id,
+				    insert_info_t insert_info)
+{
+	int screen_idx = screen_index(scene, screen_id);
+	if (screen_idx < 0) {
+		return NULL;
+	}
+
+	scene_layer_t *layer = pop_layer(scene, layer_id);
+	int created = (layer == NULL);
+	if (created) {
+		if (capacity_reached(scene->nlayers, limits.layers, "layers")) {
+			return NULL;
+		}
+		layer = node_alloc(&layer_pool, sizeof(*layer));
+		if (layer == NULL) {
+			return NULL;
+		}
+		layer->refcnt = 1;
+		layer->id = layer_id;
+		layer->surfaces = node_table(&layer_pool, layer);
+	}
+
+	scene_screen_t *screen = screen_writable(scene, screen_idx);
+	if (screen == NULL) {
+		layer_release(layer);
+		return NULL;
+	}
+
+	unsigned int pos = insert_position(insert_info, screen->nlayers,
+					   layer_index(screen,
+						       insert_info.refid));
+	if (array_insert((void **)&screen->layers, &screen->nlayers,
+			 sizeof(*screen->layers), pos, &layer) < 0) {
+		layer_release(layer);
+		return NULL;
+	}
+	if (created) {
+		scene->nlayers++;
+	}
+
+	layer = layer_writable(screen, pos);
+	return layer ? &layer->prop : NULL;
+}
+
+layer_properties_t *scene_modify_layer(scene_t *scene, t_ilm_uint layer_id)
+{
+	scene_layer_t *layer = layer_writable_by_id(scene, layer_id);
+	return layer ? &layer->prop : NULL;
+}
+
+int scene_remove_layer(scene_t *scene, t_ilm_uint layer_id)
+{
+	unsigned int i;
+
+	scene_layer_t *layer = pop_layer(scene, layer_id);
+	if (layer == NULL) {
+		return 0;
+	}
+
+	for (i = 0; i < layer->nsurfaces; i++) {
+		unrefer_surface(scene, layer->surfaces[i]);
+	}
+	layer_release(layer);
+	scene->nlayers--;
+	return 1;
+}
+
+surface_properties_t *scene_set_surface(scene_t *scene, t_ilm_uint layer_id,
+					t_ilm_uint surface_id,
+					insert_info_t insert_info)
+{
+	scene_layer_t *layer = layer_writable_by_id(scene, layer_id);
+	if (layer == NULL) {
+		return NULL;
+	}
+
+	int idx = surface_index(layer, surface_id);
+	if ((idx < 0) && capacity_reached(layer->nsurfaces,
+					  limits.surfaces_per_layer,
+					  "surfaces per layer")) {
+		return NULL;
+	}
+	if (idx >= 0) {
+		array_remove(layer->surfaces, &layer->nsurfaces,
+			     sizeof(*layer->surfaces), idx);
+	}
+
+	surface_properties_t *prop =
+		refer_surface(scene, surface_id, idx < 0);
+	if (prop == NULL) {
+		return NULL;
+	}
+
+	unsigned int pos = insert_position(
+		insert_info, layer->nsurfaces,
+		surface_index(layer, insert_info.refid));
+	if (array_insert((void **)&layer->surfaces, &layer->nsurfaces,
+			 sizeof(*layer->surfaces), pos, &surface_id) < 0) {
+		unrefer_surface(scene, surface_id);
+		return NULL;
+	}
+
+	return prop;
+}
+
+surface_properties_t *scene_modify_surface(scene_t *scene,
+					   t_ilm_uint surface_id)
+{
+	int found;
+	unsigned int idx = surface_table_search(scene, surface_id, &found);
+	if (!found) {
+		return NULL;
+	}
+
+	scene_surface_t *surface = surface_writable(scene, idx);
+	return surface ? &surface->prop : NULL;
+}
+
+int scene_remove_surface(scene_t *scene, t_ilm_uint layer_id,
+			 t_ilm_uint surface_id)
+{
+	scene_layer_t *layer = scene_get_layer(scene, layer_id);
+	if ((layer == NULL) || !scene_layer_has_surface(layer, surface_id)) {
+		return 0;
+	}
+
+	layer = layer_writable_by_id(scene, layer_id);
+	if (layer == NULL) {
+		return -1;
+	}
+	array_remove(layer->surfaces, &layer->nsurfaces,
+		     sizeof(*layer->surfaces),
+		     surface_index(layer, surface_id));
+	unrefer_surface(scene, surface_id);
+	return 1;
+}
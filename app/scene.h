@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <ilm/ilm_control.h>
+#include "comm_parser.h"
+#include "comm_binary.h"
+
+/*
+ * Scene versions.
+ *
+ * A version is immutable once published. Changes are made to a draft that
+ * starts as a shallow copy of a version: screens, layers and surfaces are
+ * shared through reference counts, and a node is copied only when the draft
+ * modifies it while another version still refers to it. Unchanged nodes
+ * therefore keep their address, which lets the publisher compare two
+ * versions by pointer.
+ */
+typedef struct _insert_info {
+	int order;
+	int refid;
+} insert_info_t;
+
+typedef struct _scene_layer {
+	unsigned int refcnt;
+	t_ilm_uint id;
+	layer_properties_t prop;
+
+	/* surface ids in render order */
+	unsigned int nsurfaces;
+	t_ilm_uint *surfaces;
+} scene_layer_t;
+
+typedef struct _scene_screen {
+	unsigned int refcnt;
+	t_ilm_uint id;
+
+	/* layers in render order */
+	unsigned int nlayers;
+	scene_layer_t **layers;
+} scene_screen_t;
+
+typedef struct _scene_surface {
+	unsigned int refcnt;
+	t_ilm_uint id;
+	surface_properties_t prop;
+} scene_surface_t;
+
+typedef struct _scene {
+	unsigned int refcnt;
+	unsigned long version;
+
+	unsigned int nscreens;
+	scene_screen_t **screens;
+	/* in all screens */
+	unsigned int nlayers;
+
+	/* surface properties, sorted by id */
+	unsigned int nsurfaces;
+	scene_surface_t **surfaces;
+} scene_t;
+
+/*
+ * Capacity of a version, unbounded until scene_set_limits is called. The
+ * nodes and tables of two versions, the committed one and a draft, are
+ * then preallocated and nothing is allocated afterwards; a change that
+ * would go over a limit fails, which drops the draft.
+ */
+typedef struct _scene_limits {
+	unsigned int screens;
+	unsigned int layers; /* in all screens */
+	unsigned int surfaces_per_layer;
+} scene_limits_t;
+
+/* once, before the first scene_new; all limits are at least 1 */
+int scene_set_limits(const scene_limits_t *limits);
+
+/* all 0 when unbounded */
+const scene_limits_t *scene_get_limits(void);
+
+scene_t *scene_new(void);
+scene_t *scene_begin(scene_t *base);
+void scene_release(scene_t *scene);
+
+/* lookup */
+scene_screen_t *scene_get_screen(const scene_t *scene, t_ilm_uint id);
+scene_layer_t *scene_get_layer(const scene_t *scene, t_ilm_uint id);
+scene_surface_t *scene_get_surface(const scene_t *scene, t_ilm_uint id);
+int scene_layer_has_surface(const scene_layer_t *layer, t_ilm_uint id);
+
+/* draft modification */
+void scene_clear(scene_t *scene);
+int scene_add_screen(scene_t *scene, t_ilm_uint id);
+layer_properties_t *scene_set_layer(scene_t *scene, t_ilm_uint screen_id,
+				    t_ilm_uint layer_id,
+				    insert_info_t insert_info);
+layer_properties_t *scene_modify_layer(scene_t *scene, t_ilm_uint layer_id);
+int scene_remove_layer(scene_t *scene, t_ilm_uint layer_id);
+surface_properties_t *scene_set_surface(scene_t *scene, t_ilm_uint layer_id,
+					t_ilm_uint surface_id,
+					insert_info_t insert_info);
+surface_properties_t *scene_modify_surface(scene_t *scene,
+					   t_ilm_uint surface_id);
+int scene_remove_surface(scene_t *scene, t_ilm_uint layer_id,
+			 t_ilm_uint surface_id);
+
+#endif //__SCENE_H__
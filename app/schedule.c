@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "schedule.h"
+
+typedef struct _schedule_entry {
+	uint64_t deadline;
+	uint64_t seq;
+	void *data;
+} schedule_entry_t;
+
+static schedule_entry_t heap[SCHEDULE_MAX_ENTRIES];
+static unsigned int heap_size;
+static uint64_t next_seq;
+static int timer_fd = -1;
+
+static int entry_before(const schedule_entry_t *a, const schedule_entry_t *b)
+{
+	if (a->deadline != b->deadline) {
+		return a->deadline < b->deadline;
+	}
+	return a->seq < b->seq;
+}
+
+static void swap_entry(unsigned int i, unsigned int j)
+{
+	schedule_entry_t tmp = heap[i];
+	heap[i] = heap[j];
+	heap[j] = tmp;
+}
+
+static void sift_up(unsigned int idx)
+{
+	while (idx > 0) {
+		unsigned int parent = (idx - 1) / 2;
+		if (!entry_before(&heap[idx], &heap[parent])) {
+			break;
+		}
+		swap_entry(idx, parent);
+		idx = parent;
+	}
+}
+
+static void sift_down(unsigned int idx)
+{
+	while (1) {
+		unsigned int left = idx * 2 + 1;
+		unsigned int right = left + 1;
+		unsigned int min = idx;
+
+		if ((left < heap_size) && entry_before(&heap[left], &heap[min]))
+			min = left;
+		if ((right < heap_size) &&
+		    entry_before(&heap[right], &heap[min]))
+			min = right;
+		if (min == idx) {
+			break;
+		}
+		swap_entry(idx, min);
+		idx = min;
+	}
+}
+
+/* arm the timer for the earliest deadline, or disarm it */
+static void arm_timer(void)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (heap_size > 0) {
+		/* a zero value would disarm the timer */
+		uint64_t deadline = heap[0].deadline ? heap[0].deadline : 1;
+		its.it_value.tv_sec = deadline / 1000000000ULL;
+		its.it_value.tv_nsec = deadline % 1000000000ULL;
+	}
+
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		fprintf(stderr, "%s(%d) ERROR: timerfd_settime\n", __func__,
+			__LINE__);
+	}
+}
+
+int schedule_init(void)
+{
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd < 0) {
+		fprintf(stderr, "%s(%d) ERROR: timerfd_create\n", __func__,
+			__LINE__);
+	}
+	return timer_fd;
+}
+
+uint64_t schedule_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int schedule_add(uint64_t deadline, void *data)
+{
+	if ((timer_fd < 0) || (heap_size >= SCHEDULE_MAX_ENTRIES)) {
+		fprintf(stderr, "%s(%d) ERROR: Schedule queue is full\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	heap[heap_size].deadline = deadline;
+	heap[heap_size].seq = next_seq++;
+	heap[heap_size].data = data;
+	sift_up(heap_size);
+	heap_size++;
+
+	if (heap[0].seq == next_seq - 1) {
+		arm_timer();
+	}
+	return 0;
+}
+
+unsigned int schedule_pop_due(uint64_t now, void **data, uint64_t *deadlines,
+			      unsigned int max)
+{
+	unsigned int count = 0;
+	uint64_t expirations;
+
+	if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+		/* not expired yet, only entries already due are taken */
+	}
+
+	while ((count < max) && (heap_size > 0) && (heap[0].deadline <= now)) {
+		data[count] = heap[0].data;
+		deadlines[count] = heap[0].deadline;
+		count++;
+
+		heap_size--;
+		heap[0] = heap[heap_size];
+		sift_down(0);
+	}
+
+	arm_timer();
+	return count;
+}
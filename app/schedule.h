@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __SCHEDULE_H__
+#define __SCHEDULE_H__
+
+#include <stdint.h>
+
+/*
+ * Deadlines are CLOCK_MONOTONIC nanoseconds. Entries are kept in a min-heap
+ * and the timerfd is armed for the earliest one; entries with the same
+ * deadline come out in the order they were added.
+ */
+#define SCHEDULE_MAX_ENTRIES 256
+
+int schedule_init(void);
+uint64_t schedule_now(void);
+
+int schedule_add(uint64_t deadline, void *data);
+
+/* called when the timerfd is readable, takes up to max entries due by now */
+unsigned int schedule_pop_due(uint64_t now, void **data, uint64_t *deadlines,
+			      unsigned int max);
+
+#endif //__SCHEDULE_H__
@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "shm_ring.h"
+
+shm_ring_t *shm_ring_create(int *memfd, int *eventfd_out)
+{
+	shm_ring_t *ring;
+
+	int fd = memfd_create("uhmi-ivi-wm-ring",
+			      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		fprintf(stderr, "%s(%d) ERROR: memfd_create\n", __func__,
+			__LINE__);
+		return NULL;
+	}
+
+	if ((ftruncate(fd, sizeof(*ring)) < 0) ||
+	    (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0)) {
+		fprintf(stderr, "%s(%d) ERROR: memfd setup\n", __func__,
+			__LINE__);
+		close(fd);
+		return NULL;
+	}
+
+	ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	if (ring == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	ring->magic = SHM_RING_MAGIC;
+	ring->slots = SHM_RING_SLOTS;
+
+	int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (efd < 0) {
+		munmap(ring, sizeof(*ring));
+		close(fd);
+		return NULL;
+	}
+
+	*memfd = fd;
+	*eventfd_out = efd;
+	return ring;
+}
+
+/* returns -1 when the daemon has not caught up with the ring */
+int shm_ring_push(shm_ring_t *ring, const wm_record_t *rec)
+{
+	uint32_t head = ring->head;
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= SHM_RING_SLOTS) {
+		return -1;
+	}
+
+	ring->records[head % SHM_RING_SLOTS] = *rec;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int shm_ring_notify(int eventfd)
+{
+	uint64_t one = 1;
+
+	return (write(eventfd, &one, sizeof(one)) == sizeof(one)) ? 0 : -1;
+}
+
+void shm_ring_destroy(shm_ring_t *ring)
+{
+	munmap(ring, sizeof(*ring));
+}
+
+shm_ring_t *shm_ring_map(int memfd)
+{
+	struct stat st;
+	shm_ring_t *ring;
+
+	/* a client shrinking the memfd under the mapping would fault us */
+	int seals = fcntl(memfd, F_GET_SEALS);
+	if ((seals < 0) || !(seals & F_SEAL_SHRINK) ||
+	    (fstat(memfd, &st) < 0) || (st.st_size < (off_t)sizeof(*ring))) {
+		fprintf(stderr, "%s(%d) ERROR: Illegal ring memfd\n", __func__,
+			__LINE__);
+		return NULL;
+	}
+
+	ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED,
+		    memfd, 0);
+	if (ring == MAP_FAILED) {
+		return NULL;
+	}
+
+	if ((ring->magic != SHM_RING_MAGIC) ||
+	    (ring->slots != SHM_RING_SLOTS)) {
+		fprintf(stderr, "%s(%d) ERROR: Illegal ring header\n", __func__,
+			__LINE__);
+		munmap(ring, sizeof(*ring));
+		return NULL;
+	}
+
+	return ring;
+}
+
+/* copies the pending records out, -1 when the indexes are corrupted */
+int shm_ring_pop(shm_ring_t *ring, wm_record_t *recs, unsigned int max)
+{
+	uint32_t tail = ring->tail;
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint32_t i, count = head - tail;
+
+	if (count > SHM_RING_SLOTS) {
+		return -1;
+	}
+	if (count > max) {
+		count = max;
+	}
+
+	for (i = 0; i < count; i++) {
+		recs[i] = ring->records[(tail + i) % SHM_RING_SLOTS];
+	}
+	__atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+static void merge_record(wm_record_t *to, const wm_record_t *from)
+{
+	uint32_t fields = from->fields;
+
+	if (fields & WM_FIELD_WIDTH)
+		to->width = from->width;
+	if (fields & WM_FIELD_HEIGHT)
+		to->height = from->height;
+	if (fields & WM_FIELD_SRCX)
+		to->src_x = from->src_x;
+	if (fields & WM_FIELD_SRCY)
+		to->src_y = from->src_y;
+	if (fields & WM_FIELD_SRCW)
+		to->src_w = from->src_w;
+	if (fields & WM_FIELD_SRCH)
+		to->src_h = from->src_h;
+	if (fields & WM_FIELD_DSTX)
+		to->dst_x = from->dst_x;
+	if (fields & WM_FIELD_DSTY)
+		to->dst_y = from->dst_y;
+	if (fields & WM_FIELD_DSTW)
+		to->dst_w = from->dst_w;
+	if (fields & WM_FIELD_DSTH)
+		to->dst_h = from->dst_h;
+	if (fields & WM_FIELD_OPACITY)
+		to->opacity = from->opacity;
+	if (fields & WM_FIELD_VISIBILITY)
+		to->visibility = from->visibility;
+	to->fields |= fields;
+}
+
+/*
+ * Keeps one record per object, in the order of their first update, with
+ * the latest value of every field. Records other than layer and surface
+ * are dropped. Returns the number of records left.
+ */
+unsigned int shm_ring_coalesce(wm_record_t *recs, unsigned int count)
+{
+	unsigned int i, j, n = 0;
+
+	for (i = 0; i < count; i++) {
+		if ((recs[i].kind != WM_RECORD_LAYER) &&
+		    (recs[i].kind != WM_RECORD_SURFACE)) {
+			continue;
+		}
+		recs[i].fields &= WM_FIELD_LAYER_ALL;
+
+		for (j = 0; j < n; j++) {
+			if ((recs[j].kind == recs[i].kind) &&
+			    (recs[j].id == recs[i].id)) {
+				break;
+			}
+		}
+		if (j < n) {
+			merge_record(&recs[j], &recs[i]);
+		} else {
+			recs[n++] = recs[i];
+		}
+	}
+
+	return n;
+}
+
+void shm_ring_unmap(shm_ring_t *ring)
+{
+	munmap(ring, sizeof(*ring));
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+#include <stdint.h>
+
+#include "comm_binary.h"
+
+#define SHM_RING_MAGIC 0x31524c55 /* "ULR1" */
+#define SHM_RING_SLOTS 256
+
+/*
+ * Ring of layout records in a memfd shared between one client and the
+ * daemon, for clients updating layers and surfaces every frame.
+ *
+ * The client writes records and moves head, the daemon reads them and
+ * moves tail; both indexes run freely and are taken modulo
+ * SHM_RING_SLOTS. Records are layer or surface records carrying the
+ * fields of modify_layer and modify_surface. After pushing the records of
+ * a frame, the client writes the eventfd handed over with the memfd.
+ */
+typedef struct _shm_ring {
+	uint32_t magic;
+	uint32_t slots;
+	uint32_t reserved0[14];
+
+	/* on cache lines of their own, written by one side each */
+	uint32_t head;
+	uint32_t reserved1[15];
+	uint32_t tail;
+	uint32_t reserved2[15];
+
+	wm_record_t records[SHM_RING_SLOTS];
+} shm_ring_t;
+
+/* client, the memfd is sealed against shrinking */
+shm_ring_t *shm_ring_create(int *memfd, int *eventfd);
+int shm_ring_push(shm_ring_t *ring, const wm_record_t *rec);
+int shm_ring_notify(int eventfd);
+void shm_ring_destroy(shm_ring_t *ring);
+
+/* daemon */
+shm_ring_t *shm_ring_map(int memfd);
+int shm_ring_pop(shm_ring_t *ring, wm_record_t *recs, unsigned int max);
+unsigned int shm_ring_coalesce(wm_record_t *recs, unsigned int count);
+void shm_ring_unmap(shm_ring_t *ring);
+
+#endif //__SHM_RING_H__
@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+/* the arrays follow the header in one block */
+#define SNAPSHOT_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+static snapshot_t *current;
+static uint64_t epoch = 1;
+static uint64_t seq;
+static snapshot_handler_t publish_handler;
+
+/* epoch each reader thread reads in, 0 when it does not read */
+static uint64_t readers[SNAPSHOT_MAX_READERS];
+static unsigned int nreaders;
+static __thread int reader_slot = -1;
+
+/* replaced snapshots, only touched by the apply thread */
+static snapshot_t *retired;
+
+static snapshot_t *snapshot_build(const scene_t *scene,
+				  const t_ilm_uint *live, unsigned int nlive)
+{
+	unsigned int i, j, k, nlayers = 0, nsurface_ids = 0;
+	size_t size, screens_off, layers_off, surfaces_off, ids_off, live_off;
+
+	for (i = 0; i < scene->nscreens; i++) {
+		const scene_screen_t *screen = scene->screens[i];
+		nlayers += screen->nlayers;
+		for (j = 0; j < screen->nlayers; j++) {
+			nsurface_ids += screen->layers[j]->nsurfaces;
+		}
+	}
+
+	screens_off = SNAPSHOT_ALIGN(sizeof(snapshot_t));
+	layers_off = screens_off +
+		     SNAPSHOT_ALIGN(scene->nscreens * sizeof(snapshot_screen_t));
+	surfaces_off = layers_off +
+		       SNAPSHOT_ALIGN(nlayers * sizeof(snapshot_layer_t));
+	ids_off = surfaces_off + SNAPSHOT_ALIGN(scene->nsurfaces *
+						sizeof(snapshot_surface_t));
+	live_off = ids_off + nsurface_ids * sizeof(t_ilm_uint);
+	size = live_off + nlive * sizeof(t_ilm_uint);
+
+	char *block = malloc(size);
+	if (block == NULL) {
+		return NULL;
+	}
+	snapshot_t *snapshot = (snapshot_t *)block;
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->version = scene->version;
+	snapshot->seq = ++seq;
+	snapshot->screens = (snapshot_screen_t *)&block[screens_off];
+	snapshot->layers = (snapshot_layer_t *)&block[layers_off];
+	snapshot->surfaces = (snapshot_surface_t *)&block[surfaces_off];
+	snapshot->surface_ids = (t_ilm_uint *)&block[ids_off];
+	snapshot->live = (t_ilm_uint *)&block[live_off];
+	memcpy(snapshot->live, live, nlive * sizeof(t_ilm_uint));
+	snapshot->nlive = nlive;
+
+	for (i = 0; i < scene->nscreens; i++) {
+		const scene_screen_t *screen = scene->screens[i];
+		snapshot_screen_t *sscreen = &snapshot->screens[i];
+
+		sscreen->id = screen->id;
+		sscreen->first_layer = snapshot->nlayers;
+		sscreen->nlayers = screen->nlayers;
+		for (j = 0; j < screen->nlayers; j++) {
+			const scene_layer_t *layer = screen->layers[j];
+			snapshot_layer_t *slayer =
+				&snapshot->layers[snapshot->nlayers++];
+
+			slayer->id = layer->id;
+			slayer->prop = layer->prop;
+			slayer->first_surface = snapshot->nsurface_ids;
+			slayer->nsurfaces = layer->nsurfaces;
+			for (k = 0; k < layer->nsurfaces; k++) {
+				snapshot->surface_ids[snapshot->nsurface_ids++] =
+					layer->surfaces[k];
+			}
+		}
+	}
+	snapshot->nscreens = scene->nscreens;
+
+	for (i = 0; i < scene->nsurfaces; i++) {
+		snapshot->surfaces[i].id = scene->surfaces[i]->id;
+		snapshot->surfaces[i].prop = scene->surfaces[i]->prop;
+	}
+	snapshot->nsurfaces = scene->nsurfaces;
+
+	return snapshot;
+}
+
+/* frees the replaced snapshots no reader can still have */
+static void snapshot_reclaim(void)
+{
+	unsigned int i, n = __atomic_load_n(&nreaders, __ATOMIC_SEQ_CST);
+	uint64_t oldest = UINT64_MAX;
+	snapshot_t **p = &retired;
+
+	if (n > SNAPSHOT_MAX_READERS) {
+		n = SNAPSHOT_MAX_READERS;
+	}
+	for (i = 0; i < n; i++) {
+		uint64_t e = __atomic_load_n(&readers[i], __ATOMIC_SEQ_CST);
+		if ((e != 0) && (e < oldest)) {
+			oldest = e;
+		}
+	}
+
+	/*
+	 * A reader that announced an epoch at least the one of the
+	 * replacement loaded the pointer after it was swapped. A hold is
+	 * taken before the unlock, so it is seen once the reader is gone.
+	 */
+	while (*p) {
+		snapshot_t *snapshot = *p;
+		if ((snapshot->retired <= oldest) &&
+		    (__atomic_load_n(&snapshot->holds, __ATOMIC_SEQ_CST) == 0)) {
+			*p = snapshot->next;
+			free(snapshot);
+		} else {
+			p = &snapshot->next;
+		}
+	}
+}
+
+int snapshot_publish(const scene_t *scene, const t_ilm_uint *live,
+		     unsigned int nlive)
+{
+	snapshot_t *snapshot = snapshot_build(scene, live, nlive);
+	if (snapshot == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Cannot publish scene %lu\n",
+			__func__, __LINE__, scene->version);
+		return -1;
+	}
+
+	snapshot_t *old =
+		__atomic_exchange_n(&current, snapshot, __ATOMIC_SEQ_CST);
+	uint64_t replaced = __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+	if (old) {
+		old->retired = replaced;
+		old->next = retired;
+		retired = old;
+	}
+	if (publish_handler) {
+		publish_handler(old, snapshot);
+	}
+	snapshot_reclaim();
+
+	return 0;
+}
+
+void snapshot_set_publish_handler(snapshot_handler_t handler)
+{
+	publish_handler = handler;
+}
+
+const snapshot_t *snapshot_read_lock(void)
+{
+	if (reader_slot < 0) {
+		unsigned int slot =
+			__atomic_fetch_add(&nreaders, 1, __ATOMIC_SEQ_CST);
+		if (slot >= SNAPSHOT_MAX_READERS) {
+			fprintf(stderr, "%s(%d) ERROR: Too many readers\n",
+				__func__, __LINE__);
+			return NULL;
+		}
+		reader_slot = slot;
+	}
+
+	__atomic_store_n(&readers[reader_slot],
+			 __atomic_load_n(&epoch, __ATOMIC_SEQ_CST),
+			 __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+}
+
+void snapshot_read_unlock(void)
+{
+	if (reader_slot >= 0) {
+		__atomic_store_n(&readers[reader_slot], 0, __ATOMIC_SEQ_CST);
+	}
+}
+
+void snapshot_hold(const snapshot_t *snapshot)
+{
+	__atomic_add_fetch(&((snapshot_t *)snapshot)->holds, 1,
+			   __ATOMIC_SEQ_CST);
+}
+
+/* freed by a later publish once it is replaced */
+void snapshot_release(const snapshot_t *snapshot)
+{
+	__atomic_sub_fetch(&((snapshot_t *)snapshot)->holds, 1,
+			   __ATOMIC_SEQ_CST);
+}
+
+const snapshot_surface_t *snapshot_get_surface(const snapshot_t *snapshot,
+					       t_ilm_uint id)
+{
+	unsigned int lo = 0, hi = snapshot->nsurfaces;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (snapshot->surfaces[mid].id == id) {
+			return &snapshot->surfaces[mid];
+		}
+		if (snapshot->surfaces[mid].id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return NULL;
+}
+
+int snapshot_surface_alive(const snapshot_t *snapshot, t_ilm_uint id)
+{
+	unsigned int lo = 0, hi = snapshot->nlive;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (snapshot->live[mid] == id) {
+			return 1;
+		}
+		if (snapshot->live[mid] < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "scene.h"
+
+/*
+ * Snapshots of the scene for threads other than the apply thread.
+ *
+ * After every commit, the apply thread copies the scene version into one
+ * flat block and publishes it behind an atomically swapped pointer.
+ * Readers never take a lock: snapshot_read_lock announces the epoch the
+ * thread reads in, and a replaced snapshot is freed by a later publish
+ * once no thread reads in an epoch older than its replacement.
+ */
+typedef struct _snapshot_screen {
+	t_ilm_uint id;
+	/* layers[first_layer .. first_layer + nlayers - 1], in render order */
+	unsigned int first_layer;
+	unsigned int nlayers;
+} snapshot_screen_t;
+
+typedef struct _snapshot_layer {
+	t_ilm_uint id;
+	layer_properties_t prop;
+	/* surface_ids[first_surface ..], in render order */
+	unsigned int first_surface;
+	unsigned int nsurfaces;
+} snapshot_layer_t;
+
+typedef struct _snapshot_surface {
+	t_ilm_uint id;
+	surface_properties_t prop;
+} snapshot_surface_t;
+
+typedef struct _snapshot {
+	unsigned long version;
+	/* one more with every publish */
+	uint64_t seq;
+
+	unsigned int nscreens;
+	snapshot_screen_t *screens;
+	unsigned int nlayers;
+	snapshot_layer_t *layers;
+	unsigned int nsurface_ids;
+	t_ilm_uint *surface_ids;
+
+	/* surface properties, sorted by id */
+	unsigned int nsurfaces;
+	snapshot_surface_t *surfaces;
+
+	/* surfaces the compositor has, sorted */
+	unsigned int nlive;
+	t_ilm_uint *live;
+
+	/* epoch of the publish that replaced it, and the retired list */
+	uint64_t retired;
+	struct _snapshot *next;
+
+	/* snapshot_hold calls not released yet */
+	unsigned int holds;
+} snapshot_t;
+
+/* the most threads reading snapshots */
+#define SNAPSHOT_MAX_READERS 32
+
+/*
+ * apply thread, after the scene version is committed or the live surfaces
+ * changed; live is sorted
+ */
+int snapshot_publish(const scene_t *scene, const t_ilm_uint *live,
+		     unsigned int nlive);
+
+/*
+ * called by snapshot_publish with the snapshot it replaced, NULL on the
+ * first publish; both stay valid until the handler returns
+ */
+typedef void (*snapshot_handler_t)(const snapshot_t *old,
+				   const snapshot_t *snapshot);
+void snapshot_set_publish_handler(snapshot_handler_t handler);
+
+/*
+ * Any thread. The snapshot stays valid until snapshot_read_unlock; it is
+ * NULL before the first publish or when SNAPSHOT_MAX_READERS threads
+ * already read snapshots. Locks do not nest.
+ */
+const snapshot_t *snapshot_read_lock(void);
+void snapshot_read_unlock(void);
+
+/*
+ * Any thread, on a snapshot it has from snapshot_read_lock before the
+ * unlock: the snapshot stays valid until snapshot_release.
+ */
+void snapshot_hold(const snapshot_t *snapshot);
+void snapshot_release(const snapshot_t *snapshot);
+
+const snapshot_surface_t *snapshot_get_surface(const snapshot_t *snapshot,
+					       t_ilm_uint id);
+int snapshot_surface_alive(const snapshot_t *snapshot, t_ilm_uint id);
+
+#endif //__SNAPSHOT_H__
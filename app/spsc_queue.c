@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "spsc_queue.h"
+
+int spsc_queue_init(spsc_queue_t *queue, unsigned int size)
+{
+	if ((size == 0) || (size & (size - 1))) {
+		fprintf(stderr, "%s(%d) ERROR: Size %u is not a power of two\n",
+			__func__, __LINE__, size);
+		return -1;
+	}
+
+	queue->slots = calloc(size, sizeof(*queue->slots));
+	if (queue->slots == NULL) {
+		return -1;
+	}
+	queue->size = size;
+	queue->head = 0;
+	queue->tail = 0;
+
+	return 0;
+}
+
+void spsc_queue_release(spsc_queue_t *queue)
+{
+	free(queue->slots);
+	queue->slots = NULL;
+}
+
+/*
+ * The producer stores head before it loads tail and the consumer stores
+ * tail before it loads head, all sequentially consistent: when the
+ * consumer stops on an empty queue, the producer of the next item sees it
+ * as the only one and knows to wake the consumer up.
+ */
+int spsc_queue_push(spsc_queue_t *queue, void *item)
+{
+	unsigned int head = queue->head;
+	unsigned int tail = __atomic_load_n(&queue->tail, __ATOMIC_SEQ_CST);
+
+	if (head - tail >= queue->size) {
+		return -1;
+	}
+
+	queue->slots[head & (queue->size - 1)] = item;
+	__atomic_store_n(&queue->head, head + 1, __ATOMIC_SEQ_CST);
+
+	tail = __atomic_load_n(&queue->tail, __ATOMIC_SEQ_CST);
+	return head + 1 - tail;
+}
+
+void *spsc_queue_pop(spsc_queue_t *queue)
+{
+	unsigned int tail = queue->tail;
+	unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST);
+
+	if (tail == head) {
+		return NULL;
+	}
+
+	void *item = queue->slots[tail & (queue->size - 1)];
+	__atomic_store_n(&queue->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+	return item;
+}
+
+void *spsc_queue_peek(spsc_queue_t *queue)
+{
+	unsigned int tail = queue->tail;
+	unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST);
+
+	if (tail == head) {
+		return NULL;
+	}
+	return queue->slots[tail & (queue->size - 1)];
+}
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+/*
+ * Lock-free queue of pointers between one producer thread and one consumer
+ * thread. The producer only writes head and the consumer only writes tail,
+ * both run freely and are taken modulo the size, a power of two.
+ */
+typedef struct _spsc_queue {
+	void **slots;
+	unsigned int size;
+
+	/* on cache lines of their own, written by one side each */
+	unsigned int head __attribute__((aligned(64)));
+	unsigned int tail __attribute__((aligned(64)));
+} spsc_queue_t;
+
+int spsc_queue_init(spsc_queue_t *queue, unsigned int size);
+void spsc_queue_release(spsc_queue_t *queue);
+
+/*
+ * -1 when the queue is full, otherwise the number of items in the queue
+ * after this one was added: 1 means the consumer may have found it empty
+ */
+int spsc_queue_push(spsc_queue_t *queue, void *item);
+/* NULL when the queue is empty */
+void *spsc_queue_pop(spsc_queue_t *queue);
+/* the item pop would return, left in the queue */
+void *spsc_queue_peek(spsc_queue_t *queue);
+
+#endif //__SPSC_QUEUE_H__
@@ -0,0 +1,252 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+
+#include "stats.h"
+#include "comm_json.h"
+
+/* upper bounds of the lateness histogram, in microseconds */
+static const uint64_t lateness_bounds_us[] = { 100, 1000, 4000, 16667, 33333 };
+#define LATENESS_BUCKETS \
+	(sizeof(lateness_bounds_us) / sizeof(lateness_bounds_us[0]) + 1)
+
+static struct {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[LATENESS_BUCKETS];
+} lateness;
+
+/*
+ * Latency of the commands of each priority class, in a histogram of powers
+ * of two microseconds: bucket b counts the latencies below 2^b us.
+ */
+#define LATENCY_BUCKETS 32
+static struct {
+	uint64_t count;
+	uint64_t max_ns;
+	uint64_t buckets[LATENCY_BUCKETS];
+} priorities[COMM_PRIORITIES];
+
+static struct {
+	uint64_t commits;
+	uint64_t commands;
+	uint64_t records;
+	uint64_t merged;
+} merges;
+
+static uint64_t messages;
+static uint64_t buffer_allocs;
+static uint64_t message_allocs;
+static uint64_t socket_calls;
+
+static const char *stage_names[STATS_STAGES] = { "parse", "wait", "apply",
+						  "return" };
+static struct {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+} stages[STATS_STAGES];
+
+/* by receiving thread */
+static const char *queue_names[2] = { "to io", "to apply" };
+static struct {
+	uint64_t pushes;
+	uint64_t total_depth;
+	uint64_t max_depth;
+	uint64_t max_backlog;
+} queues[2];
+
+#define STAT_ADD(var, n) __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define STAT_GET(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+/* only the writing thread updates a maximum */
+#define STAT_MAX(var, n)                                              \
+	do {                                                          \
+		if ((n) > STAT_GET(var)) {                            \
+			__atomic_store_n(&(var), (n), __ATOMIC_RELAXED); \
+		}                                                     \
+	} while (0)
+
+void stats_count_message(void)
+{
+	STAT_ADD(messages, 1);
+}
+
+void stats_count_buffer_alloc(void)
+{
+	STAT_ADD(buffer_allocs, 1);
+}
+
+void stats_count_message_alloc(void)
+{
+	STAT_ADD(message_allocs, 1);
+}
+
+void stats_count_socket_call(void)
+{
+	STAT_ADD(socket_calls, 1);
+}
+
+void stats_add_stage(int stage, uint64_t ns)
+{
+	STAT_ADD(stages[stage].count, 1);
+	STAT_ADD(stages[stage].total_ns, ns);
+	STAT_MAX(stages[stage].max_ns, ns);
+}
+
+void stats_add_queue_depth(int thread, unsigned int depth)
+{
+	STAT_ADD(queues[thread].pushes, 1);
+	STAT_ADD(queues[thread].total_depth, depth);
+	STAT_MAX(queues[thread].max_depth, (uint64_t)depth);
+}
+
+void stats_add_backlog(int thread, unsigned int length)
+{
+	/* backlog of the sending thread, in front of the other's queue */
+	STAT_MAX(queues[!thread].max_backlog, (uint64_t)length);
+}
+
+void stats_add_lateness(uint64_t lateness_ns)
+{
+	unsigned int i;
+
+	lateness.count++;
+	lateness.total_ns += lateness_ns;
+	if (lateness_ns > lateness.max_ns) {
+		lateness.max_ns = lateness_ns;
+	}
+
+	for (i = 0; i < LATENESS_BUCKETS - 1; i++) {
+		if (lateness_ns < lateness_bounds_us[i] * 1000) {
+			break;
+		}
+	}
+	lateness.buckets[i]++;
+}
+
+void stats_add_priority_latency(int priority, uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	unsigned int b = 0;
+
+	while ((b < LATENCY_BUCKETS - 1) && (us >= (1ULL << b))) {
+		b++;
+	}
+	priorities[priority].count++;
+	priorities[priority].buckets[b]++;
+	if (ns > priorities[priority].max_ns) {
+		priorities[priority].max_ns = ns;
+	}
+}
+
+void stats_add_merge(unsigned int commands, unsigned int records,
+		     unsigned int merged)
+{
+	merges.commits++;
+	merges.commands += commands;
+	merges.records += records;
+	merges.merged += merged;
+}
+
+/* upper bound of the bucket holding the given share of the latencies */
+static unsigned long long latency_percentile(int priority, unsigned int pct)
+{
+	uint64_t rank = (priorities[priority].count * pct + 99) / 100;
+	uint64_t seen = 0;
+	unsigned int b;
+
+	for (b = 0; b < LATENCY_BUCKETS - 1; b++) {
+		seen += priorities[priority].buckets[b];
+		if (seen >= rank) {
+			break;
+		}
+	}
+	return 1ULL << b;
+}
+
+void stats_print(void)
+{
+	unsigned int i;
+
+	fprintf(stderr,
+		"messages: %llu, buffer allocations: %llu, message allocations: %llu, socket calls: %llu\n",
+		(unsigned long long)STAT_GET(messages),
+		(unsigned long long)STAT_GET(buffer_allocs),
+		(unsigned long long)STAT_GET(message_allocs),
+		(unsigned long long)STAT_GET(socket_calls));
+	for (i = 0; i < 2; i++) {
+		uint64_t pushes = STAT_GET(queues[i].pushes);
+		fprintf(stderr,
+			"queue %s: %llu items, depth avg %llu max %llu, backlog max %llu\n",
+			queue_names[i], (unsigned long long)pushes,
+			(unsigned long long)(pushes ? STAT_GET(queues[i].total_depth) /
+							      pushes :
+						      0),
+			(unsigned long long)STAT_GET(queues[i].max_depth),
+			(unsigned long long)STAT_GET(queues[i].max_backlog));
+	}
+	for (i = 0; i < STATS_STAGES; i++) {
+		uint64_t count = STAT_GET(stages[i].count);
+		fprintf(stderr, "stage %s: avg %llu us, max %llu us\n",
+			stage_names[i],
+			(unsigned long long)(count ? STAT_GET(stages[i].total_ns) /
+							     count / 1000 :
+						     0),
+			(unsigned long long)(STAT_GET(stages[i].max_ns) / 1000));
+	}
+	for (i = 0; i < COMM_PRIORITIES; i++) {
+		if (priorities[i].count == 0) {
+			continue;
+		}
+		fprintf(stderr,
+			"priority %s: %llu commands, latency p50 < %llu us, p99 < %llu us, max %llu us\n",
+			comm_json_priority_name(i),
+			(unsigned long long)priorities[i].count,
+			latency_percentile(i, 50), latency_percentile(i, 99),
+			(unsigned long long)(priorities[i].max_ns / 1000));
+	}
+	if (merges.commits > 0) {
+		fprintf(stderr,
+			"merged modify commands: %llu in %llu commits (%llu.%02llu per commit), records %llu -> %llu\n",
+			(unsigned long long)merges.commands,
+			(unsigned long long)merges.commits,
+			(unsigned long long)(merges.commands / merges.commits),
+			(unsigned long long)(merges.commands * 100 /
+					     merges.commits % 100),
+			(unsigned long long)merges.records,
+			(unsigned long long)merges.merged);
+	}
+	fprintf(stderr, "scheduled commands: %llu\n",
+		(unsigned long long)lateness.count);
+	if (lateness.count == 0) {
+		return;
+	}
+
+	fprintf(stderr, "  lateness avg %llu us, max %llu us\n",
+		(unsigned long long)(lateness.total_ns / lateness.count / 1000),
+		(unsigned long long)(lateness.max_ns / 1000));
+	for (i = 0; i < LATENESS_BUCKETS - 1; i++) {
+		fprintf(stderr, "  < %6llu us: %llu\n",
+			(unsigned long long)lateness_bounds_us[i],
+			(unsigned long long)lateness.buckets[i]);
+	}
+	fprintf(stderr, "  >=%6llu us: %llu\n",
+		(unsigned long long)lateness_bounds_us[i - 1],
+		(unsigned long long)lateness.buckets[i]);
+}
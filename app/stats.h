@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+
+/*
+ * Every counter has one writing thread and is printed from the apply
+ * thread, so all of them are accessed atomically.
+ */
+
+/* delay between the deadline of a scheduled command and its commit */
+void stats_add_lateness(uint64_t lateness_ns);
+
+/* messages received from clients */
+void stats_count_message(void);
+
+/* growths of the per-connection buffers, flat once they fit the traffic */
+void stats_count_buffer_alloc(void);
+
+/*
+ * allocations of pipeline items, parse tasks and their copies of bodies;
+ * these are reused, so the count is flat once enough are in circulation
+ */
+void stats_count_message_alloc(void);
+
+/* receive and send calls on client sockets */
+void stats_count_socket_call(void);
+
+/*
+ * Stages of a message through the I/O and apply threads, see pipeline.h:
+ * parsed on the I/O thread, waiting for the apply thread, applied and
+ * committed, then waiting for the I/O thread to queue the response.
+ */
+#define STATS_STAGE_PARSE 0
+#define STATS_STAGE_WAIT 1
+#define STATS_STAGE_APPLY 2
+#define STATS_STAGE_RETURN 3
+#define STATS_STAGES 4
+void stats_add_stage(int stage, uint64_t ns);
+
+/*
+ * from receiving a command to its commit, by priority class; only called
+ * by the apply thread
+ */
+void stats_add_priority_latency(int priority, uint64_t ns);
+
+/*
+ * modify commands merged into one commit, and their records before and
+ * after merging; only called by the apply thread
+ */
+void stats_add_merge(unsigned int commands, unsigned int records,
+		     unsigned int merged);
+
+/* items in the queue to a thread after each push, and in its backlog */
+void stats_add_queue_depth(int thread, unsigned int depth);
+void stats_add_backlog(int thread, unsigned int length);
+
+void stats_print(void);
+
+#endif //__STATS_H__
@@ -0,0 +1,424 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+/*
+ * wmbench: concurrent senders against a running uhmi-ivi-wm.
+ *
+ * Every sender connects, sends a command and waits for its result, the
+ * same way as wmsendcmd, as fast as it can. With -p a sender keeps one v1
+ * connection instead and pipelines up to a window of frames, and with -q
+ * it does the same on a seqpacket connection, one datagram per command.
+ * With -r the frames carry request ids, and with -d some commands are
+ * scheduled, which v2 answers once they are applied. The command
+ * moves a layer so that each one really changes the scene, and with -b it
+ * is a batch moving the layer several times, which takes longer to parse.
+ * -P sends the commands with a priority class, to compare the latencies of
+ * the classes with several wmbench running at once.
+ * Throughput and the round trip latency of the commands are printed at
+ * the end. Commands answered busy, over a quota of the daemon, are counted
+ * apart and left out of both.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "../app/comm_receiver.h"
+#include "../lib/wm_client.h"
+
+static int senders = 32;
+static int messages = 100;
+static int layer_id = 1000;
+static int persistent = 0;
+static int seqpacket = 0;
+static int request_ids = 0;
+static int deferred = 0;
+static int window = 16;
+static int batch = 0;
+/* "priority":"<class>", when given */
+static char priority_field[64] = "";
+
+/* the batch results of a command fit in a response buffer */
+#define MAX_BATCH 1000
+#define RESPONSE_SIZE (4 * (MAX_BATCH + 2))
+
+typedef struct _sender {
+	pthread_t thread;
+	int index;
+	int errors;
+	int busy;
+	int reordered;
+	/* of the commands that were not answered busy */
+	uint64_t *latencies;
+	int completed;
+} sender_t;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int send_command(const char *cmd, unsigned int size)
+{
+	char magic[4] = { 0 };
+	int res = -1;
+
+	int fd = connect_to_server();
+	if (fd < 0) {
+		return -1;
+	}
+
+	if ((send_data_to_server(fd, (void *)MAGIC_CODE, 4) == 0) &&
+	    (send_body_size_to_server(fd, size) == 0) &&
+	    (send_data_to_server(fd, (void *)cmd, size) == 0) &&
+	    (recv_data_from_server(fd, magic, sizeof(magic)) == 0)) {
+		res = recv_response_from_server(fd);
+	}
+
+	close(fd);
+	return res;
+}
+
+static int format_command(char *cmd, size_t size, int value, int later)
+{
+	int len, i;
+
+	if (batch == 0) {
+		return snprintf(cmd, size,
+				"{\"version\":\"1.0.0\","
+				"\"command\":\"modify_layer\",%s%s"
+				"\"layers\":[{\"id\":%d,\"dst_x\":%d}]}",
+				later ? "\"apply_in\":10000000," : "",
+				priority_field, layer_id, value % 640) +
+		       1;
+	}
+
+	len = snprintf(cmd, size,
+		       "{\"version\":\"1.0.0\",\"command\":\"batch\",%s%s"
+		       "\"commands\":[",
+		       later ? "\"apply_in\":10000000," : "", priority_field);
+	for (i = 0; i < batch; i++) {
+		len += snprintf(&cmd[len], size - len,
+				"%s{\"command\":\"modify_layer\","
+				"\"layers\":[{\"id\":%d,\"dst_x\":%d}]}",
+				i ? "," : "", layer_id, (value + i) % 640);
+	}
+	return snprintf(&cmd[len], size - len, "]}") + len + 1;
+}
+
+/* room for the command and for a batch of moves */
+static size_t command_size(void)
+{
+	return 256 + (size_t)batch * 96;
+}
+
+static void run_oneshot(sender_t *sender)
+{
+	char *cmd = malloc(command_size());
+	int i;
+
+	if (cmd == NULL) {
+		sender->errors = messages;
+		return;
+	}
+
+	for (i = 0; i < messages; i++) {
+		int len = format_command(cmd, command_size(),
+					 sender->index * messages + i,
+					 deferred && (i % deferred ==
+						      deferred - 1));
+
+		uint64_t start = now_ns();
+		int res = send_command(cmd, len);
+		if (res == WM_CLIENT_RESULT_BUSY) {
+			sender->busy++;
+			continue;
+		}
+		if (res < 0) {
+			sender->errors++;
+		}
+		sender->latencies[sender->completed++] = now_ns() - start;
+	}
+	free(cmd);
+}
+
+static int send_one(int fd, uint32_t request_id, const char *cmd, int len)
+{
+	if (seqpacket) {
+		return send_packet_to_server(fd, MAGIC_CODE, cmd, len);
+	}
+	if (request_ids) {
+		return send_request_to_server(fd, request_id, cmd, len);
+	}
+	return send_frame_to_server(fd, cmd, len);
+}
+
+/* v2 responses name their command, others come back in order */
+static int recv_one(int fd, uint32_t *request_id, int *res)
+{
+	char buf[RESPONSE_SIZE];
+	unsigned int payload_size;
+	int ret;
+
+	if (seqpacket) {
+		return recv_packet_from_server(fd, res, buf, sizeof(buf));
+	}
+	if (request_ids) {
+		ret = recv_reply_from_server(fd, request_id, res,
+					     &payload_size);
+	} else {
+		ret = recv_frame_from_server(fd, res, &payload_size);
+	}
+
+	/* the batch results are not looked at */
+	if ((ret == 0) && (payload_size > 0)) {
+		if (payload_size > sizeof(buf)) {
+			return -1;
+		}
+		ret = recv_data_from_server(fd, buf, payload_size);
+	}
+	return ret;
+}
+
+static void run_persistent(sender_t *sender)
+{
+	char *cmd = malloc(command_size());
+	char magic[4];
+	int sent = 0, received = 0;
+	const char *code = request_ids ? MAGIC_CODE_V2 : MAGIC_CODE_V1;
+
+	uint64_t *start = calloc(messages, sizeof(*start));
+	int fd = seqpacket ? connect_to_server_seqpacket() : connect_to_server();
+	if ((cmd == NULL) || (start == NULL) || (fd < 0)) {
+		sender->errors = messages;
+		goto out;
+	}
+	if (!seqpacket &&
+	    ((send_data_to_server(fd, (void *)code, 4) < 0) ||
+	     (recv_data_from_server(fd, magic, sizeof(magic)) < 0))) {
+		sender->errors = messages;
+		goto out;
+	}
+
+	while (received < messages) {
+		if ((sent < messages) && (sent - received < window)) {
+			int len = format_command(cmd, command_size(),
+						 sender->index * messages +
+							 sent,
+						 deferred && (sent % deferred ==
+							      deferred - 1));
+			start[sent] = now_ns();
+			if (send_one(fd, sent, cmd, len) < 0) {
+				break;
+			}
+			sent++;
+			continue;
+		}
+
+		int res;
+		uint32_t idx = received;
+		if ((recv_one(fd, &idx, &res) < 0) || (idx >= (uint32_t)sent)) {
+			break;
+		}
+		if (idx != (uint32_t)received) {
+			sender->reordered++;
+		}
+		received++;
+		if (res == WM_CLIENT_RESULT_BUSY) {
+			sender->busy++;
+			continue;
+		}
+		if (res < 0) {
+			sender->errors++;
+		}
+		sender->latencies[sender->completed++] = now_ns() - start[idx];
+	}
+	sender->errors += messages - received;
+
+out:
+	if (fd >= 0) {
+		close(fd);
+	}
+	free(start);
+	free(cmd);
+}
+
+static void *sender_main(void *arg)
+{
+	sender_t *sender = arg;
+
+	if (persistent || seqpacket || request_ids) {
+		run_persistent(sender);
+	} else {
+		run_oneshot(sender);
+	}
+
+	return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int usage(int ret)
+{
+	fprintf(stderr,
+		" usage \n"
+		"    -h,  --help                  display this help and exit \n"
+		"    -s,  --senders               concurrent senders (32) \n"
+		"    -n,  --messages              commands per sender (100) \n"
+		"    -l,  --layer                 layer id to move (1000) \n"
+		"    -p,  --persistent            one v1 connection per sender \n"
+		"    -q,  --seqpacket             one seqpacket connection per sender \n"
+		"    -r,  --request-ids           one v2 connection per sender \n"
+		"    -d,  --deferred              every n-th command applied 10 ms later \n"
+		"    -w,  --window                commands in flight with -p, -q (16) \n"
+		"    -b,  --batch                 moves per command, sent as a batch \n"
+		"    -P,  --priority              critical, interactive or background \n");
+	exit(ret);
+}
+
+static void parse_option(int argc, char *argv[])
+{
+	int opt;
+	static const struct option options[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "senders", required_argument, NULL, 's' },
+		{ "messages", required_argument, NULL, 'n' },
+		{ "layer", required_argument, NULL, 'l' },
+		{ "persistent", no_argument, NULL, 'p' },
+		{ "seqpacket", no_argument, NULL, 'q' },
+		{ "request-ids", no_argument, NULL, 'r' },
+		{ "deferred", required_argument, NULL, 'd' },
+		{ "window", required_argument, NULL, 'w' },
+		{ "batch", required_argument, NULL, 'b' },
+		{ "priority", required_argument, NULL, 'P' },
+		{ 0, 0, NULL, 0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "hs:n:l:pqrd:w:b:P:", options, NULL)) !=
+	       -1) {
+		switch (opt) {
+		case 'h':
+			usage(0);
+			break;
+		case 's':
+			senders = atoi(optarg);
+			break;
+		case 'n':
+			messages = atoi(optarg);
+			break;
+		case 'l':
+			layer_id = atoi(optarg);
+			break;
+		case 'p':
+			persistent = 1;
+			break;
+		case 'q':
+			seqpacket = 1;
+			break;
+		case 'r':
+			request_ids = 1;
+			break;
+		case 'd':
+			deferred = atoi(optarg);
+			break;
+		case 'w':
+			window = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'P':
+			snprintf(priority_field, sizeof(priority_field),
+				 "\"priority\":\"%.32s\",", optarg);
+			break;
+		default:
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if ((senders <= 0) || (messages <= 0) || (window <= 0) ||
+	    (deferred < 0) || (batch < 0) || (batch > MAX_BATCH)) {
+		usage(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int i, errors = 0, busy = 0, reordered = 0;
+	size_t total = 0;
+
+	parse_option(argc, argv);
+
+	sender_t *sender = calloc(senders, sizeof(*sender));
+	uint64_t *latencies = calloc((size_t)senders * messages,
+				     sizeof(*latencies));
+	if ((sender == NULL) || (latencies == NULL)) {
+		return EXIT_FAILURE;
+	}
+
+	uint64_t start = now_ns();
+	for (i = 0; i < senders; i++) {
+		sender[i].index = i;
+		sender[i].latencies = &latencies[(size_t)i * messages];
+		if (pthread_create(&sender[i].thread, NULL, sender_main,
+				   &sender[i]) != 0) {
+			fprintf(stderr, "error: cannot start sender %d\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+	for (i = 0; i < senders; i++) {
+		pthread_join(sender[i].thread, NULL);
+		errors += sender[i].errors;
+		busy += sender[i].busy;
+		reordered += sender[i].reordered;
+	}
+	uint64_t elapsed = now_ns() - start;
+
+	/* the latencies of every sender, one after the other */
+	for (i = 0; i < senders; i++) {
+		memmove(&latencies[total], sender[i].latencies,
+			sender[i].completed * sizeof(*latencies));
+		total += sender[i].completed;
+	}
+	qsort(latencies, total, sizeof(*latencies), compare_u64);
+
+	printf("senders %d, commands %zu, errors %d, busy %d, out of order %d\n",
+	       senders, total, errors, busy, reordered);
+	printf("elapsed %.3f s, %.0f commands/s\n", elapsed / 1e9,
+	       total / (elapsed / 1e9));
+	if (total > 0) {
+		printf("latency us: p50 %llu, p99 %llu, max %llu\n",
+		       (unsigned long long)(latencies[total / 2] / 1000),
+		       (unsigned long long)(latencies[total * 99 / 100] / 1000),
+		       (unsigned long long)(latencies[total - 1] / 1000));
+	}
+
+	free(latencies);
+	free(sender);
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
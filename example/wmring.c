@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+/*
+ * wmring: moves a layer every frame through a shared memory ring.
+ *
+ * The ring and its eventfd are handed to uhmi-ivi-wm once with the ring
+ * magic code. Every frame then only writes a record to the ring and the
+ * eventfd, without a message on the socket or waiting for a result.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include "../app/comm_receiver.h"
+#include "../app/shm_ring.h"
+
+static int frames = 300;
+static int fps = 60;
+static int layer_id = 1000;
+
+int usage(int ret)
+{
+	fprintf(stderr,
+		"    -h,  --help                  display this help and exit.\n"
+		"    -n,  --frames                number of frames (300)\n"
+		"    -f,  --fps                   frames per second (60)\n"
+		"    -l,  --layer                 layer id to move (1000)\n");
+	exit(ret);
+}
+
+static void parse_option(int argc, char *argv[])
+{
+	int opt;
+	static const struct option options[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "frames", required_argument, NULL, 'n' },
+		{ "fps", required_argument, NULL, 'f' },
+		{ "layer", required_argument, NULL, 'l' },
+		{ 0, 0, NULL, 0 }
+	};
+
+	while (1) {
+		opt = getopt_long(argc, argv, "hn:f:l:", options, NULL);
+
+		if (opt == -1)
+			break;
+
+		switch (opt) {
+		case 'h':
+			usage(0);
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'f':
+			fps = atoi(optarg);
+			break;
+		case 'l':
+			layer_id = atoi(optarg);
+			break;
+		default:
+			usage(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if (fps <= 0) {
+		usage(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int fds[2];
+	char magic[4] = { 0 };
+	struct timespec next;
+	int i, dropped = 0;
+
+	parse_option(argc, argv);
+
+	shm_ring_t *ring = shm_ring_create(&fds[0], &fds[1]);
+	if (ring == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	int fd = connect_to_server();
+	if ((fd < 0) ||
+	    (send_fds_to_server(fd, MAGIC_CODE_RING, 4, fds, 2) < 0) ||
+	    (recv_data_from_server(fd, magic, sizeof(magic)) < 0) ||
+	    (memcmp(magic, MAGIC_CODE_RING, 4) != 0)) {
+		fprintf(stderr, "error: ring not accepted\n");
+		return EXIT_FAILURE;
+	}
+	close(fds[0]);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < frames; i++) {
+		wm_record_t rec = { 0 };
+		rec.kind = WM_RECORD_LAYER;
+		rec.id = layer_id;
+		rec.fields = WM_FIELD_DSTX;
+		rec.dst_x = (i * 4) % 640;
+
+		if (shm_ring_push(ring, &rec) < 0) {
+			dropped++;
+		}
+		shm_ring_notify(fds[1]);
+
+		next.tv_nsec += 1000000000L / fps;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	printf("frames %d, dropped %d\n", frames, dropped);
+
+	close(fd);
+	shm_ring_destroy(ring);
+	return 0;
+}
@@ -20,17 +20,35 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
 #include <arpa/inet.h>
-#include "../app/comm_receiver.h"
+#include "wm_client.h"
+#include "comm_json.h"
 
 json_t *jobject;
 char *json_conf_path = NULL;
+char *binary_out_path = NULL;
+int binary_mode = 0;
+int persistent_mode = 0;
+int seqpacket_mode = 0;
+int report_mode = 0;
+int is_batch = 0;
+int is_subscribe = 0;
+int is_query = 0;
+int binary_scene = 0;
+int last_result = -1;
 
 int usage(int ret)
 {
 	fprintf(stderr,
 		"    -h,  --help                  display this help and exit.\n"
-		"    -c,  --path                  json config file path\n");
+		"    -c,  --path                  json config file path\n"
+		"    -b,  --binary                send the command in binary encoding\n"
+		"    -o,  --output                write the binary encoding to a file\n"
+		"    -p,  --persistent            send the command as a v1 frame\n"
+		"    -q,  --seqpacket             send the command as one datagram\n"
+		"    -r,  --request               send the command as a v2 frame (default)\n");
 	exit(ret);
 }
 
@@ -40,11 +58,16 @@ static void parse_option(int argc, char *argv[])
 	static const struct option options[] = {
 		{ "help", no_argument, NULL, 'h' },
 		{ "path", optional_argument, NULL, 'c' },
+		{ "binary", no_argument, NULL, 'b' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "persistent", no_argument, NULL, 'p' },
+		{ "seqpacket", no_argument, NULL, 'q' },
+		{ "request", no_argument, NULL, 'r' },
 		{ 0, 0, NULL, 0 }
 	};
 
 	while (1) {
-		opt = getopt_long(argc, argv, "hc:", options, NULL);
+		opt = getopt_long(argc, argv, "hc:bo:pqr", options, NULL);
 
 		if (opt == -1)
 			break;
@@ -56,6 +79,20 @@ static void parse_option(int argc, char *argv[])
 		case 'c':
 			json_conf_path = optarg;
 			break;
+		case 'b':
+			binary_mode = 1;
+			break;
+		case 'o':
+			binary_out_path = optarg;
+			break;
+		case 'p':
+			persistent_mode = 1;
+			break;
+		case 'q':
+			seqpacket_mode = 1;
+			break;
+		case 'r':
+			break;
 		default:
 			usage(EXIT_FAILURE);
 			break;
@@ -63,6 +100,147 @@ static void parse_option(int argc, char *argv[])
 	}
 }
 
+static int encode_binary_command(json_t *jobject, wm_command_t *command)
+{
+	char cmd_name[32] = { 0 };
+	if (comm_json_parse_command(jobject, cmd_name, sizeof(cmd_name)) < 0) {
+		return -1;
+	}
+
+	WM_CMD_TYPE type = comm_json_command_type(cmd_name);
+	if (type == WM_CMD_NONE) {
+		fprintf(stderr, "error: %s has no binary encoding\n", cmd_name);
+		return -1;
+	}
+
+	/* binary commands are applied at once, without a report */
+	uint64_t deadline;
+	if ((comm_json_parse_deadline(jobject, 0, &deadline) != 0) ||
+	    (comm_json_parse_priority(jobject) != COMM_PRIORITY_NONE) ||
+	    comm_json_parse_report(jobject)) {
+		fprintf(stderr,
+			"error: apply_at, apply_in, priority and report have no binary encoding\n");
+		return -1;
+	}
+
+	return comm_json_encode_command(jobject, type, command);
+}
+
+static int write_binary_command(const wm_command_t *command)
+{
+	size_t size = comm_binary_encoded_size(command);
+	char *buf = malloc(size);
+	if (buf == NULL) {
+		return -1;
+	}
+	comm_binary_encode(command, buf);
+
+	FILE *fp = fopen(binary_out_path, "wb");
+	int ret = ((fp != NULL) && (fwrite(buf, 1, size, fp) == size)) ? 0 : -1;
+	if (fp) {
+		fclose(fp);
+	}
+	free(buf);
+	if (ret < 0) {
+		fprintf(stderr, "%s(%d) ERROR: cannot write %s\n", __func__,
+			__LINE__, binary_out_path);
+	}
+
+	return ret;
+}
+
+/* get_scene answers with a json text or a binary body */
+static void print_scene(const char *scene, unsigned int size)
+{
+	WM_CMD_TYPE type;
+	uint32_t nrecords, i;
+	wm_record_t rec;
+
+	if (!binary_scene) {
+		fprintf(stderr, "scene: %.*s \n", (int)size, scene);
+		return;
+	}
+	if (comm_binary_parse_header(scene, size, &type, &nrecords) < 0) {
+		return;
+	}
+	for (i = 0; i < nrecords; i++) {
+		comm_binary_get_record(scene, i, &rec);
+		if (rec.kind == WM_RECORD_SCREEN) {
+			fprintf(stderr, "screen %u\n", rec.id);
+			continue;
+		}
+		fprintf(stderr,
+			"%s %u: src %u,%u %ux%u dst %u,%u %ux%u opacity %.2f visibility %u",
+			(rec.kind == WM_RECORD_LAYER) ? "  layer" :
+							"    surface",
+			rec.id, rec.src_x, rec.src_y, rec.src_w, rec.src_h,
+			rec.dst_x, rec.dst_y, rec.dst_w, rec.dst_h,
+			rec.opacity, rec.visibility);
+		if (rec.kind == WM_RECORD_SURFACE) {
+			fprintf(stderr, "%s",
+				(rec.fields & WM_FIELD_ALIVE) ? "" : " (gone)");
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+/*
+ * the result is followed by the report (u32 length and json text) or by
+ * the batch results (u32 count and one s32 per command)
+ */
+static void command_done(void *data, uint32_t request_id, int result,
+			 const void *payload, unsigned int size)
+{
+	const char *p = payload;
+	uint32_t n;
+
+	(void)data;
+	(void)request_id;
+	last_result = result;
+	fprintf(stderr, "resp: %d \n", result);
+	if (size < sizeof(n)) {
+		return;
+	}
+	memcpy(&n, p, sizeof(n));
+	n = ntohl(n);
+
+	if (report_mode) {
+		if (n <= size - sizeof(n)) {
+			fprintf(stderr, "report: %.*s \n", (int)n, &p[sizeof(n)]);
+		}
+		return;
+	}
+	if (is_query && (n <= size - sizeof(n))) {
+		print_scene(&p[sizeof(n)], n);
+		return;
+	}
+	for (uint32_t i = 0;
+	     is_batch && (i < n) && ((i + 2) * sizeof(n) <= size); i++) {
+		int32_t res;
+		memcpy(&res, &p[(i + 1) * sizeof(n)], sizeof(res));
+		fprintf(stderr, "  [%u]: %d \n", i, (int)ntohl(res));
+	}
+}
+
+static void print_event(void *data, const char *event, unsigned int size)
+{
+	(void)data;
+	fprintf(stderr, "event: %.*s \n", (int)size, event);
+}
+
+/* events are printed until the connection is closed */
+static void wait_events(wm_client_t *client)
+{
+	struct pollfd pfd = { wm_client_get_fd(client), POLLIN, 0 };
+
+	while (wm_client_dispatch(client) >= 0) {
+		pfd.events = wm_client_get_events(client);
+		if ((poll(&pfd, 1, -1) < 0) && (errno != EINTR)) {
+			break;
+		}
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	parse_option(argc, argv);
@@ -82,30 +260,80 @@ int main(int argc, char *argv[])
 		usage(EXIT_FAILURE);
 	}
 
-	//parse json cmd
-	char *cmd =
-		(char *)malloc(strlen(json_dumps(jobject, JSON_COMPACT)) + 1);
-	sprintf(cmd, "%s", json_dumps(jobject, JSON_COMPACT));
-	unsigned int cmdsize = strlen(cmd) + 1;
+	//batch commands are answered with one result per command
+	json_t *cmd_name_jobj = json_object_get(jobject, "command");
+	is_batch = json_is_string(cmd_name_jobj) &&
+		   (strcmp(json_string_value(cmd_name_jobj), "batch") == 0);
+	is_subscribe =
+		json_is_string(cmd_name_jobj) &&
+		(strcmp(json_string_value(cmd_name_jobj), "subscribe") == 0);
+	is_query =
+		json_is_string(cmd_name_jobj) &&
+		(strcmp(json_string_value(cmd_name_jobj), "get_scene") == 0);
+	json_t *format_jobj = json_object_get(jobject, "format");
+	binary_scene = binary_mode ||
+		       (json_is_string(format_jobj) &&
+			(strcmp(json_string_value(format_jobj), "binary") == 0));
+
+	//a report replaces the batch results
+	int binary = binary_mode || binary_out_path;
+	report_mode = json_is_true(json_object_get(jobject, "report")) &&
+		      !binary;
 
-	//send data
-	int fd = connect_to_server();
-	char magic[4] = { 0x55, 0x4C, 0x41, 0x30 };
-	send_data_to_server(fd, magic, 4);
-	send_body_size_to_server(fd, cmdsize);
-	send_data_to_server(fd, cmd, cmdsize);
+	//encode the command
+	char *cmd = NULL;
+	wm_command_t command = { 0 };
+	int ret = 0;
+	if (binary) {
+		ret = encode_binary_command(jobject, &command);
+	} else {
+		cmd = json_dumps(jobject, JSON_COMPACT);
+		ret = cmd ? 0 : -1;
+	}
+	json_decref(jobject);
+	if (ret < 0) {
+		fprintf(stderr, "%s(%d) ERROR: command encoding failed\n",
+			__func__, __LINE__);
+		comm_binary_free_command(&command);
+		return EXIT_FAILURE;
+	}
 
-	//receive resp
-	char resp[4] = { 0 };
-	recv_str_response_from_server(fd, resp);
-	if (strncmp(resp, magic, 4) != 0) {
-		fprintf(stderr, "recv magic code NG  %s\n", resp);
+	if (binary_out_path) {
+		ret = write_binary_command(&command);
+		comm_binary_free_command(&command);
+		return (ret < 0) ? EXIT_FAILURE : 0;
 	}
 
-	int res;
-	res = recv_response_from_server(fd);
-	fprintf(stderr, "resp: %d \n", res);
+	//send it and wait for its response
+	int transport = seqpacket_mode	 ? WM_CLIENT_SEQPACKET :
+			persistent_mode ? WM_CLIENT_PIPELINE :
+					  WM_CLIENT_STREAM;
+	wm_client_t *client = wm_client_connect(
+		transport, binary ? WM_CLIENT_BINARY : WM_CLIENT_JSON);
+	if (client == NULL) {
+		ret = -1;
+	} else if (is_subscribe) {
+		ret = wm_client_subscribe(client, cmd, strlen(cmd) + 1,
+					  command_done, print_event, NULL);
+	} else if (binary) {
+		ret = wm_client_send_command(client, &command, command_done,
+					     NULL);
+	} else {
+		ret = wm_client_send_json(client, cmd, strlen(cmd) + 1,
+					  command_done, NULL);
+	}
+	if (ret < 0) {
+		fprintf(stderr, "resp: %d \n", -1);
+	} else {
+		//a lost connection completes the command with -1
+		if ((wm_client_wait(client, ret, -1) == 0) && is_subscribe &&
+		    (last_result == 0)) {
+			wait_events(client);
+		}
+	}
 
+	wm_client_close(client);
+	comm_binary_free_command(&command);
 	free(cmd);
 
 	return 0;
@@ -0,0 +1,644 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+
+#include "wm_client.h"
+#include "comm_receiver.h"
+
+#define WM_CLIENT_MIN_BUFFER 4096
+#define WM_CLIENT_MAX_RESPONSE (16 * 1024 * 1024)
+
+typedef struct _wm_request {
+	uint32_t id;
+	wm_client_done_t done;
+	void *data;
+	int subscribe;
+	TAILQ_ENTRY(_wm_request) entry;
+} wm_request_t;
+
+struct _wm_client {
+	int fd;
+	int transport;
+	int encoding;
+	const char *magic;
+	int handshake; /* the magic code is not echoed yet */
+	int lost;
+	uint32_t next_id;
+	unsigned int npending;
+
+	/* frames are events once subscribe succeeded */
+	int subscribed;
+	wm_client_event_t event_handler;
+	void *event_data;
+
+	/* seqpacket output is kept as host-order size and datagram */
+	char *out;
+	unsigned int out_len, out_size;
+	char *in;
+	unsigned int in_len, in_size;
+
+	TAILQ_HEAD(_wm_request_head, _wm_request) requests;
+};
+
+static const char *lookup_magic(int transport, int encoding)
+{
+	int binary = (encoding == WM_CLIENT_BINARY);
+
+	switch (transport) {
+	case WM_CLIENT_STREAM:
+		return binary ? MAGIC_CODE_BINARY_V2 : MAGIC_CODE_V2;
+	case WM_CLIENT_PIPELINE:
+		return binary ? MAGIC_CODE_BINARY_V1 : MAGIC_CODE_V1;
+	case WM_CLIENT_SEQPACKET:
+		return binary ? MAGIC_CODE_BINARY : MAGIC_CODE;
+	}
+	return NULL;
+}
+
+static int grow_buffer(char **buf, unsigned int *size, unsigned int need)
+{
+	unsigned int new_size = *size ? *size : WM_CLIENT_MIN_BUFFER;
+
+	if (*size >= need) {
+		return 0;
+	}
+	while (new_size < need) {
+		new_size *= 2;
+	}
+
+	char *new_buf = realloc(*buf, new_size);
+	if (new_buf == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Cannot allocate %u bytes\n",
+			__func__, __LINE__, new_size);
+		return -1;
+	}
+	*buf = new_buf;
+	*size = new_size;
+
+	return 0;
+}
+
+static void *queue_output(wm_client_t *client, unsigned int size)
+{
+	if (grow_buffer(&client->out, &client->out_size,
+			client->out_len + size) < 0) {
+		return NULL;
+	}
+	void *p = &client->out[client->out_len];
+	client->out_len += size;
+
+	return p;
+}
+
+wm_client_t *wm_client_connect(int transport, int encoding)
+{
+	const char *magic = lookup_magic(transport, encoding);
+	if (magic == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Unknown transport %d\n",
+			__func__, __LINE__, transport);
+		return NULL;
+	}
+
+	wm_client_t *client = calloc(1, sizeof(*client));
+	if (client == NULL) {
+		return NULL;
+	}
+	client->transport = transport;
+	client->encoding = encoding;
+	client->magic = magic;
+	client->next_id = 1;
+	TAILQ_INIT(&client->requests);
+
+	client->fd = (transport == WM_CLIENT_SEQPACKET) ?
+			     connect_to_server_seqpacket() :
+			     connect_to_server();
+	if (client->fd < 0) {
+		free(client);
+		return NULL;
+	}
+
+	int flags = fcntl(client->fd, F_GETFL);
+	if ((flags < 0) ||
+	    (fcntl(client->fd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+		fprintf(stderr, "%s(%d) ERROR: %s\n", __func__, __LINE__,
+			strerror(errno));
+		wm_client_close(client);
+		return NULL;
+	}
+
+	/* frames follow the magic code once, datagrams carry their own */
+	if (transport != WM_CLIENT_SEQPACKET) {
+		void *p = queue_output(client, 4);
+		if (p == NULL) {
+			wm_client_close(client);
+			return NULL;
+		}
+		memcpy(p, magic, 4);
+		client->handshake = 1;
+	}
+
+	return client;
+}
+
+void wm_client_close(wm_client_t *client)
+{
+	wm_request_t *req;
+
+	if (client == NULL) {
+		return;
+	}
+	while ((req = TAILQ_FIRST(&client->requests)) != NULL) {
+		TAILQ_REMOVE(&client->requests, req, entry);
+		free(req);
+	}
+	if (client->fd >= 0) {
+		close(client->fd);
+	}
+	free(client->out);
+	free(client->in);
+	free(client);
+}
+
+int wm_client_get_fd(const wm_client_t *client)
+{
+	return client->fd;
+}
+
+short wm_client_get_events(const wm_client_t *client)
+{
+	return POLLIN | ((client->out_len > 0) ? POLLOUT : 0);
+}
+
+unsigned int wm_client_pending(const wm_client_t *client)
+{
+	return client->npending;
+}
+
+static int flush_packets(wm_client_t *client)
+{
+	unsigned int offset = 0;
+	uint32_t size;
+	int ret = 0;
+
+	while (offset < client->out_len) {
+		memcpy(&size, &client->out[offset], sizeof(size));
+		ssize_t len = send(client->fd,
+				   &client->out[offset + sizeof(size)], size,
+				   MSG_NOSIGNAL);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				ret = -1;
+			}
+			break;
+		}
+		offset += sizeof(size) + size;
+	}
+
+	memmove(client->out, &client->out[offset], client->out_len - offset);
+	client->out_len -= offset;
+
+	return ret;
+}
+
+static int flush_output(wm_client_t *client)
+{
+	if (client->transport == WM_CLIENT_SEQPACKET) {
+		return flush_packets(client);
+	}
+
+	while (client->out_len > 0) {
+		ssize_t len = send(client->fd, client->out, client->out_len,
+				   MSG_NOSIGNAL);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				break;
+			}
+			return -1;
+		}
+		memmove(client->out, &client->out[len], client->out_len - len);
+		client->out_len -= len;
+	}
+
+	return 0;
+}
+
+/* reserves the frame or datagram of a command, returns its body */
+static void *begin_request(wm_client_t *client, unsigned int size)
+{
+	uint32_t header[2];
+	unsigned int n = 0;
+
+	if (client->lost || client->subscribed) {
+		return NULL;
+	}
+
+	switch (client->transport) {
+	case WM_CLIENT_STREAM:
+		header[n++] = htonl(sizeof(header[0]) + size);
+		header[n++] = htonl(client->next_id);
+		break;
+	case WM_CLIENT_PIPELINE:
+		header[n++] = htonl(size);
+		break;
+	case WM_CLIENT_SEQPACKET:
+		header[n++] = 4 + size;
+		memcpy(&header[n++], client->magic, 4);
+		break;
+	}
+
+	char *p = queue_output(client, n * sizeof(header[0]) + size);
+	if (p == NULL) {
+		return NULL;
+	}
+	memcpy(p, header, n * sizeof(header[0]));
+
+	return &p[n * sizeof(header[0])];
+}
+
+static int end_request(wm_client_t *client, wm_client_done_t done,
+		       void *data)
+{
+	wm_request_t *req = malloc(sizeof(*req));
+	if (req == NULL) {
+		client->lost = 1;
+		return -1;
+	}
+	req->id = client->next_id;
+	req->done = done;
+	req->data = data;
+	req->subscribe = 0;
+	TAILQ_INSERT_TAIL(&client->requests, req, entry);
+	client->npending++;
+
+	client->next_id = (client->next_id < INT_MAX) ? client->next_id + 1 :
+							1;
+
+	/* a broken connection is reported by the next dispatch */
+	if (flush_output(client) < 0) {
+		client->lost = 1;
+	}
+
+	return req->id;
+}
+
+int wm_client_send_json(wm_client_t *client, const char *json,
+			unsigned int size, wm_client_done_t done, void *data)
+{
+	if (client->encoding != WM_CLIENT_JSON) {
+		fprintf(stderr, "%s(%d) ERROR: Connection is not json\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	void *body = begin_request(client, size);
+	if (body == NULL) {
+		return -1;
+	}
+	memcpy(body, json, size);
+
+	return end_request(client, done, data);
+}
+
+int wm_client_subscribe(wm_client_t *client, const char *json,
+			unsigned int size, wm_client_done_t done,
+			wm_client_event_t handler, void *data)
+{
+	int id = wm_client_send_json(client, json, size, done, data);
+	if (id < 0) {
+		return -1;
+	}
+
+	TAILQ_LAST(&client->requests, _wm_request_head)->subscribe = 1;
+	client->event_handler = handler;
+	client->event_data = data;
+
+	return id;
+}
+
+int wm_client_send_command(wm_client_t *client, const wm_command_t *cmd,
+			   wm_client_done_t done, void *data)
+{
+	if (client->encoding != WM_CLIENT_BINARY) {
+		fprintf(stderr, "%s(%d) ERROR: Connection is not binary\n",
+			__func__, __LINE__);
+		return -1;
+	}
+
+	void *body = begin_request(client, comm_binary_encoded_size(cmd));
+	if (body == NULL) {
+		return -1;
+	}
+	comm_binary_encode(cmd, body);
+
+	return end_request(client, done, data);
+}
+
+int wm_client_send_modify(wm_client_t *client, const wm_record_t *rec,
+			  wm_client_done_t done, void *data)
+{
+	wm_command_t cmd = { 0 };
+
+	switch (rec->kind) {
+	case WM_RECORD_LAYER:
+		cmd.type = WM_CMD_MODIFY_LAYER;
+		break;
+	case WM_RECORD_SURFACE:
+		cmd.type = WM_CMD_MODIFY_SURFACE;
+		break;
+	default:
+		fprintf(stderr, "%s(%d) ERROR: Record kind %u cannot be modified\n",
+			__func__, __LINE__, rec->kind);
+		return -1;
+	}
+	cmd.nrecords = 1;
+	cmd.capacity = 1;
+	cmd.records = (wm_record_t *)rec;
+
+	return wm_client_send_command(client, &cmd, done, data);
+}
+
+static wm_request_t *find_request(wm_client_t *client, uint32_t id)
+{
+	wm_request_t *req;
+
+	TAILQ_FOREACH(req, &client->requests, entry)
+	{
+		if (req->id == id) {
+			return req;
+		}
+	}
+	return NULL;
+}
+
+static void complete_request(wm_client_t *client, wm_request_t *req,
+			     int result, const void *payload,
+			     unsigned int size)
+{
+	TAILQ_REMOVE(&client->requests, req, entry);
+	client->npending--;
+	if (req->subscribe && (result == WM_CLIENT_RESULT_OK)) {
+		client->subscribed = 1;
+	}
+	if (req->done) {
+		req->done(req->data, req->id, result, payload, size);
+	}
+	free(req);
+}
+
+static void fail_requests(wm_client_t *client)
+{
+	wm_request_t *req;
+
+	while ((req = TAILQ_FIRST(&client->requests)) != NULL) {
+		complete_request(client, req, WM_CLIENT_RESULT_ERROR, NULL, 0);
+	}
+}
+
+/* v1 and seqpacket responses come in the order of the commands */
+static int complete_response(wm_client_t *client, uint32_t id, int result,
+			     const void *payload, unsigned int size)
+{
+	wm_request_t *req = (client->transport == WM_CLIENT_STREAM) ?
+				    find_request(client, id) :
+				    TAILQ_FIRST(&client->requests);
+	if (req == NULL) {
+		fprintf(stderr, "%s(%d) ERROR: Response to unknown request %u\n",
+			__func__, __LINE__, id);
+		return -1;
+	}
+	complete_request(client, req, result, payload, size);
+
+	return 0;
+}
+
+/* frames in the input buffer, what is left of the last one is kept */
+static int process_frames(wm_client_t *client)
+{
+	unsigned int offset = 0, header, count = 0;
+	uint32_t words[3];
+	int ret = 0;
+
+	if (client->handshake) {
+		if (client->in_len < 4) {
+			return 0;
+		}
+		if (memcmp(client->in, client->magic, 4) != 0) {
+			fprintf(stderr, "%s(%d) ERROR: Magic code not echoed\n",
+				__func__, __LINE__);
+			return -1;
+		}
+		client->handshake = 0;
+		offset = 4;
+	}
+
+	/*
+	 * v1: u32 length, s32 result; v2: u32 length, u32 id, s32 result;
+	 * events: u32 length
+	 */
+	while (client->in_len - offset >= sizeof(words[0])) {
+		header = client->subscribed ? 1 :
+			 (client->transport == WM_CLIENT_STREAM) ? 3 : 2;
+		if (client->in_len - offset < header * sizeof(words[0])) {
+			break;
+		}
+		memcpy(words, &client->in[offset], header * sizeof(words[0]));
+		uint32_t len = ntohl(words[0]);
+		if ((len < (header - 1) * sizeof(words[0])) ||
+		    (len > WM_CLIENT_MAX_RESPONSE)) {
+			fprintf(stderr, "%s(%d) ERROR: Bad response of %u bytes\n",
+				__func__, __LINE__, len);
+			ret = -1;
+			break;
+		}
+		if (client->in_len - offset < sizeof(words[0]) + len) {
+			/* room for the rest of the frame */
+			if (grow_buffer(&client->in, &client->in_size,
+					sizeof(words[0]) + len) < 0) {
+				ret = -1;
+			}
+			break;
+		}
+
+		if (client->subscribed) {
+			if (client->event_handler) {
+				client->event_handler(
+					client->event_data,
+					&client->in[offset + sizeof(words[0])],
+					len);
+			}
+			offset += sizeof(words[0]) + len;
+			continue;
+		}
+
+		uint32_t id = (header == 3) ? ntohl(words[1]) : 0;
+		int result = (int32_t)ntohl(words[header - 1]);
+		unsigned int size = sizeof(words[0]) + len -
+				    header * sizeof(words[0]);
+		if (complete_response(client, id, result,
+				      &client->in[offset +
+						  header * sizeof(words[0])],
+				      size) < 0) {
+			ret = -1;
+			break;
+		}
+		offset += sizeof(words[0]) + len;
+		count++;
+	}
+
+	memmove(client->in, &client->in[offset], client->in_len - offset);
+	client->in_len -= offset;
+
+	return (ret < 0) ? ret : (int)count;
+}
+
+static int read_stream(wm_client_t *client)
+{
+	int count = 0;
+
+	while (1) {
+		if (grow_buffer(&client->in, &client->in_size,
+				client->in_len + WM_CLIENT_MIN_BUFFER / 4) < 0) {
+			return -1;
+		}
+		ssize_t len = recv(client->fd, &client->in[client->in_len],
+				   client->in_size - client->in_len, 0);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				return count;
+			}
+			return -1;
+		}
+		if (len == 0) {
+			return -1;
+		}
+		client->in_len += len;
+
+		int n = process_frames(client);
+		if (n < 0) {
+			return -1;
+		}
+		count += n;
+	}
+}
+
+/* s32 result and data in one datagram */
+static int read_packets(wm_client_t *client)
+{
+	int count = 0;
+	int32_t result;
+
+	while (1) {
+		ssize_t len = recv(client->fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+		if ((len > 0) &&
+		    (grow_buffer(&client->in, &client->in_size, len) < 0)) {
+			return -1;
+		}
+		if (len >= 0) {
+			len = recv(client->fd, client->in, client->in_size, 0);
+		}
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				return count;
+			}
+			return -1;
+		}
+		if (len == 0) {
+			return -1;
+		}
+		if (client->subscribed) {
+			if (client->event_handler) {
+				client->event_handler(client->event_data,
+						      client->in, len);
+			}
+			continue;
+		}
+		if (len < (ssize_t)sizeof(result)) {
+			return -1;
+		}
+
+		memcpy(&result, client->in, sizeof(result));
+		if (complete_response(client, 0, (int32_t)ntohl(result),
+				      &client->in[sizeof(result)],
+				      len - sizeof(result)) < 0) {
+			return -1;
+		}
+		count++;
+	}
+}
+
+int wm_client_dispatch(wm_client_t *client)
+{
+	int count = -1;
+
+	if (!client->lost && (flush_output(client) == 0)) {
+		count = (client->transport == WM_CLIENT_SEQPACKET) ?
+				read_packets(client) :
+				read_stream(client);
+	}
+	if (count < 0) {
+		client->lost = 1;
+		fail_requests(client);
+	}
+
+	return count;
+}
+
+int wm_client_wait(wm_client_t *client, int request_id, int timeout_ms)
+{
+	while (find_request(client, request_id)) {
+		struct pollfd pfd = { client->fd, wm_client_get_events(client),
+				      0 };
+		int ret = poll(&pfd, 1, timeout_ms);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (ret == 0) {
+			return -1;
+		}
+		if (wm_client_dispatch(client) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
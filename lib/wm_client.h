@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: Apache-2.0
+/**                                                                                                                                                                                                                       
+ * Copyright (c) 2024  Panasonic Automotive Systems, Co., Ltd.                                                                                                                                                            
+ *                                                                                                                                                                                                                        
+ * Licensed under the Apache License, Version 2.0 (the "License");                                                                                                                                                        
+ * you may not use this file except in compliance with the License.                                                                                                                                                       
+ * You may obtain a copy of the License at                                                                                                                                                                                
+ *                                                                                                                                                                                                                        
+ *     http://www.apache.org/licenses/LICENSE-2.0                                                                                                                                                                         
+ *                                                                                                                                                                                                                        
+ * Unless required by applicable law or agreed to in writing, software                                                                                                                                                    
+ * distributed under the License is distributed on an "AS IS" BASIS,                                                                                                                                                      
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.                                                                                                                                               
+ * See the License for the specific language governing permissions and                                                                                                                                                    
+ * limitations under the License.                                                                                                                                                                                         
+ */
+
+#ifndef __WM_CLIENT_H__
+#define __WM_CLIENT_H__
+
+#include <stdint.h>
+
+#include "comm_binary.h"
+
+/*
+ * Client library of uhmi-ivi-wm.
+ *
+ * A client keeps one connection to the daemon and sends any number of
+ * commands on it without waiting for their responses. The socket is
+ * non-blocking: wm_client_get_fd() and wm_client_get_events() give what to
+ * poll for, and wm_client_dispatch() writes pending commands and reads the
+ * responses that arrived, calling the completion callback of each command.
+ * wm_client_wait() does the polling for clients without an event loop.
+ *
+ * The encoding is chosen when connecting: json connections send json
+ * texts, binary connections send commands built in memory with
+ * comm_binary_add_record(), which are encoded straight into the output
+ * buffer.
+ */
+
+/* transports */
+#define WM_CLIENT_STREAM 0 /* v2 frames, completions in any order */
+#define WM_CLIENT_PIPELINE 1 /* v1 frames, completions in order */
+#define WM_CLIENT_SEQPACKET 2 /* one datagram per command, in order */
+
+/* encodings */
+#define WM_CLIENT_JSON 0
+#define WM_CLIENT_BINARY 1
+
+/* results passed to the completion callback */
+#define WM_CLIENT_RESULT_OK 0
+#define WM_CLIENT_RESULT_ERROR -1
+#define WM_CLIENT_RESULT_NOT_APPLIED 1
+#define WM_CLIENT_RESULT_QUEUED 2
+#define WM_CLIENT_RESULT_BUSY 4
+
+typedef struct _wm_client wm_client_t;
+
+/*
+ * Called once per command with its result and the data that follows it:
+ * the batch results (u32 count, then one s32 per command) or the report
+ * (u32 length, then json text), all big-endian. The data is only valid
+ * during the call. A lost connection completes every pending command with
+ * WM_CLIENT_RESULT_ERROR and no data.
+ */
+typedef void (*wm_client_done_t)(void *data, uint32_t request_id, int result,
+				 const void *payload, unsigned int size);
+
+/* gets the json text of an event, not terminated, see app/comm_event.h */
+typedef void (*wm_client_event_t)(void *data, const char *event,
+				  unsigned int size);
+
+WM_EXPORT wm_client_t *wm_client_connect(int transport, int encoding);
+/* pending commands are dropped without calling their callbacks */
+WM_EXPORT void wm_client_close(wm_client_t *client);
+
+WM_EXPORT int wm_client_get_fd(const wm_client_t *client);
+/* POLLIN, and POLLOUT while commands wait to be written */
+WM_EXPORT short wm_client_get_events(const wm_client_t *client);
+/* number of commands not completed yet */
+WM_EXPORT unsigned int wm_client_pending(const wm_client_t *client);
+
+/*
+ * Queue a command and write what the socket takes. The request id passed
+ * to done is returned, -1 on error. done may be NULL.
+ */
+WM_EXPORT int wm_client_send_json(wm_client_t *client, const char *json,
+				  unsigned int size, wm_client_done_t done,
+				  void *data);
+WM_EXPORT int wm_client_send_command(wm_client_t *client,
+				     const wm_command_t *cmd,
+				     wm_client_done_t done, void *data);
+/* modify_layer or modify_surface of one layer or surface record */
+WM_EXPORT int wm_client_send_modify(wm_client_t *client,
+				    const wm_record_t *rec,
+				    wm_client_done_t done, void *data);
+
+/*
+ * Send a subscribe command (json text with optional "events" and "ids"
+ * filters). Once it succeeded, the connection only carries events, each
+ * passed to handler; nothing else can be sent on it.
+ */
+WM_EXPORT int wm_client_subscribe(wm_client_t *client, const char *json,
+				  unsigned int size, wm_client_done_t done,
+				  wm_client_event_t handler, void *data);
+
+/*
+ * Write pending commands and read available responses without blocking.
+ * Returns the number of completed commands, -1 when the connection is
+ * lost. Callbacks must not close the client or dispatch again.
+ */
+WM_EXPORT int wm_client_dispatch(wm_client_t *client);
+/* dispatch until request_id completes, -1 on error or after timeout_ms */
+WM_EXPORT int wm_client_wait(wm_client_t *client, int request_id,
+			     int timeout_ms);
+
+#endif //__WM_CLIENT_H__